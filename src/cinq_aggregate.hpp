@@ -0,0 +1,338 @@
+#ifndef __cinq_aggregate_hpp__
+#define __cinq_aggregate_hpp__
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Reducers for enumerable::aggregate(), which computes several of them in one pass:
+//
+//     auto [low, high, mean, days] = cinq::from(weather)
+//         .aggregate(cinq::min(&weather_point::temp_min), cinq::max(&weather_point::temp_max),
+//                    cinq::avg(&weather_point::temp_max), cinq::count());
+//
+// A reducer maps each element to a value and feeds it to an accumulator, which folds it in
+// with add(), folds in another accumulator with merge() and produces the aggregate with
+// result(). Accumulators of different chunks of a sequence can be merged in any grouping,
+// which lets aggregate() run in parallel.
+
+namespace cinq
+{
+    namespace aggregation
+    {
+        using namespace std;
+
+        /**
+         * @brief Mapper returning the element itself, used by reducers given no mapper.
+         */
+        struct identity
+        {
+            template <typename T>
+            const T& operator()(const T& x) const { return x; }
+        };
+
+        /**
+         * @brief Type of the value a mapper, function or pointer to member, gives for an element.
+         */
+        template <typename TMapper, typename TElement>
+        using mapped_type = typename decay<typename result_of<const TMapper&(const TElement&)>::type>::type;
+
+        inline void ensure_nonempty(size_t count)
+        {
+            if (count == 0) throw length_error("cinq: sequence is empty");
+        }
+
+        template <typename TValue>
+        class min_accumulator
+        {
+        public:
+            void add(TValue value)
+            {
+                if (value < smallest) smallest = value;
+                count++;
+            }
+
+            void merge(const min_accumulator& other)
+            {
+                if (other.smallest < smallest) smallest = other.smallest;
+                count += other.count;
+            }
+
+            TValue result() const
+            {
+                ensure_nonempty(count);
+                return smallest;
+            }
+
+        private:
+            TValue smallest = numeric_limits<TValue>::max();
+            size_t count = 0;
+        };
+
+        template <typename TValue>
+        class max_accumulator
+        {
+        public:
+            void add(TValue value)
+            {
+                if (largest < value) largest = value;
+                count++;
+            }
+
+            void merge(const max_accumulator& other)
+            {
+                if (largest < other.largest) largest = other.largest;
+                count += other.count;
+            }
+
+            TValue result() const
+            {
+                ensure_nonempty(count);
+                return largest;
+            }
+
+        private:
+            TValue largest = numeric_limits<TValue>::lowest();
+            size_t count = 0;
+        };
+
+        template <typename TValue>
+        class sum_accumulator
+        {
+        public:
+            void add(TValue value)
+            {
+                total += value;
+            }
+
+            void merge(const sum_accumulator& other)
+            {
+                total += other.total;
+            }
+
+            TValue result() const
+            {
+                return total;
+            }
+
+        private:
+            TValue total = 0;
+        };
+
+        // Like enumerable::average(), integers average to a double and floating point
+        // numbers to their own type.
+        template <typename TValue>
+        class avg_accumulator
+        {
+        public:
+            using result_type = typename conditional<is_integral<TValue>::value, double, TValue>::type;
+
+            void add(TValue value)
+            {
+                total += value;
+                count++;
+            }
+
+            void merge(const avg_accumulator& other)
+            {
+                total += other.total;
+                count += other.count;
+            }
+
+            result_type result() const
+            {
+                ensure_nonempty(count);
+                return (result_type)total / count;
+            }
+
+        private:
+            TValue total = 0;
+            size_t count = 0;
+        };
+
+        // Takes the result of the predicate.
+        template <typename TValue>
+        class count_accumulator
+        {
+        public:
+            void add(bool matches)
+            {
+                if (matches) count++;
+            }
+
+            void merge(const count_accumulator& other)
+            {
+                count += other.count;
+            }
+
+            size_t result() const
+            {
+                return count;
+            }
+
+        private:
+            size_t count = 0;
+        };
+
+        /**
+         * @brief A reducer: applies func to each element and feeds the value to a
+         * TAccumulator. The accumulators only hold plain values, so they can be copied and
+         * assigned even when func is a lambda.
+         */
+        template <template <typename> class TAccumulator, typename TFunc>
+        struct reducer
+        {
+            TFunc func;
+
+            template <typename TElement>
+            TAccumulator<mapped_type<TFunc, TElement>> accumulator() const
+            {
+                return TAccumulator<mapped_type<TFunc, TElement>>();
+            }
+
+            template <typename TAccumulatorOf, typename TElement>
+            void add(TAccumulatorOf& accumulator, const TElement& x) const
+            {
+                accumulator.add(invoke(func, x));
+            }
+        };
+
+        struct always
+        {
+            template <typename T>
+            bool operator()(const T&) const { return true; }
+        };
+
+        template <typename ... TReducers, typename ... TAccumulators, typename TElement, size_t ... I>
+        void add_all(const tuple<TReducers...>& reducers, tuple<TAccumulators...>& totals, const TElement& x, index_sequence<I...>)
+        {
+            (get<I>(reducers).add(get<I>(totals), x), ...);
+        }
+
+        /**
+         * @brief Adds an element to each accumulator through the matching reducer.
+         */
+        template <typename ... TReducers, typename ... TAccumulators, typename TElement>
+        void add_all(const tuple<TReducers...>& reducers, tuple<TAccumulators...>& totals, const TElement& x)
+        {
+            add_all(reducers, totals, x, index_sequence_for<TReducers...>());
+        }
+
+        template <typename ... TAccumulators, size_t ... I>
+        void merge_all(tuple<TAccumulators...>& into, const tuple<TAccumulators...>& from, index_sequence<I...>)
+        {
+            (get<I>(into).merge(get<I>(from)), ...);
+        }
+
+        /**
+         * @brief Merges each accumulator of from into the matching one of into.
+         */
+        template <typename ... TAccumulators>
+        void merge_all(tuple<TAccumulators...>& into, const tuple<TAccumulators...>& from)
+        {
+            merge_all(into, from, index_sequence_for<TAccumulators...>());
+        }
+    }
+
+    /**
+     * @brief Reducer for the smallest mapped value of a sequence.
+     *
+     * @param mapper function or pointer to member exposing the field of interest
+     */
+    template <typename TMapper>
+    auto min(TMapper mapper)
+    {
+        return aggregation::reducer<aggregation::min_accumulator, TMapper> { mapper };
+    }
+
+    /**
+     * @brief Reducer for the smallest element of a sequence of numbers.
+     */
+    inline auto min()
+    {
+        return min(aggregation::identity());
+    }
+
+    /**
+     * @brief Reducer for the largest mapped value of a sequence.
+     *
+     * @param mapper function or pointer to member exposing the field of interest
+     */
+    template <typename TMapper>
+    auto max(TMapper mapper)
+    {
+        return aggregation::reducer<aggregation::max_accumulator, TMapper> { mapper };
+    }
+
+    /**
+     * @brief Reducer for the largest element of a sequence of numbers.
+     */
+    inline auto max()
+    {
+        return max(aggregation::identity());
+    }
+
+    /**
+     * @brief Reducer for the sum of the mapped values of a sequence.
+     *
+     * @param mapper function or pointer to member exposing the field of interest
+     */
+    template <typename TMapper>
+    auto sum(TMapper mapper)
+    {
+        return aggregation::reducer<aggregation::sum_accumulator, TMapper> { mapper };
+    }
+
+    /**
+     * @brief Reducer for the sum of a sequence of numbers.
+     */
+    inline auto sum()
+    {
+        return sum(aggregation::identity());
+    }
+
+    /**
+     * @brief Reducer for the average of the mapped values of a sequence: a double for
+     * integers, or the type of the values for floating point numbers.
+     *
+     * @param mapper function or pointer to member exposing the field of interest
+     */
+    template <typename TMapper>
+    auto avg(TMapper mapper)
+    {
+        return aggregation::reducer<aggregation::avg_accumulator, TMapper> { mapper };
+    }
+
+    /**
+     * @brief Reducer for the average of a sequence of numbers.
+     */
+    inline auto avg()
+    {
+        return avg(aggregation::identity());
+    }
+
+    /**
+     * @brief Reducer for the number of elements satisfying a predicate.
+     *
+     * @param predicate function or pointer to member testing each element
+     */
+    template <typename TPredicate>
+    auto count(TPredicate predicate)
+    {
+        return aggregation::reducer<aggregation::count_accumulator, TPredicate> { predicate };
+    }
+
+    /**
+     * @brief Reducer for the number of elements of a sequence.
+     */
+    inline auto count()
+    {
+        return count(aggregation::always());
+    }
+}
+
+#endif
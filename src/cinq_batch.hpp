@@ -0,0 +1,525 @@
+#ifndef __cinq_batch_hpp__
+#define __cinq_batch_hpp__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "cinq_enumerable.hpp"
+#include "cinq_simd.hpp"
+
+// Batch execution: after batched(), a query runs over the source a batch of 1024 elements at
+// a time instead of one element at a time. where() turns each batch into a bitmask of the
+// rows that satisfy its predicate, select() maps the selected rows of a batch into an output
+// batch, and the methods that produce a value fold whole batches. The loop over a batch in
+// each of these has no branches on the other operators, which lets the compiler vectorize it.
+//
+//     double wet = cinq::from(weather).batched()
+//                                     .where([](const weather_point& w) { return w.temp_max > 90; })
+//                                     .select([](const weather_point& w) { return w.precipitation; })
+//                                     .average();
+//
+// Like lazy(), nothing runs until a method that produces a value is called, and each such
+// call runs the query again from the source.
+
+namespace cinq
+{
+    using namespace std;
+    using namespace origin;
+
+    namespace batches
+    {
+        constexpr size_t batch_size = 1024;
+        constexpr size_t mask_words = batch_size / 64;
+
+        /**
+         * @brief Rows of a sequence passed between the operators of a batched query: values
+         * holds size rows, and bit i of the mask is set when row i is selected. dense is
+         * true when every row is selected.
+         */
+        template <typename T>
+        struct batch
+        {
+            const T* values;
+            const uint64_t* mask;
+            size_t size;
+            bool dense;
+        };
+
+        /**
+         * @brief Calls visit(row) for each selected row of a batch, in order.
+         */
+        template <typename T, typename TVisit>
+        void for_each_selected(const batch<T>& rows, TVisit visit)
+        {
+            if (rows.dense)
+            {
+                for (size_t row = 0; row < rows.size; row++) visit(row);
+                return;
+            }
+            for (size_t word = 0; word * 64 < rows.size; word++)
+            {
+                for (uint64_t bits = rows.mask[word]; bits != 0; bits &= bits - 1)
+                {
+                    visit(word * 64 + __builtin_ctzll(bits));
+                }
+            }
+        }
+
+        template <typename T>
+        size_t count_selected(const batch<T>& rows)
+        {
+            if (rows.dense) return rows.size;
+            size_t count = 0;
+            for (size_t word = 0; word * 64 < rows.size; word++) count += __builtin_popcountll(rows.mask[word]);
+            return count;
+        }
+
+        /**
+         * @brief Cuts a random access sequence into batches. Contiguous sequences are read
+         * in place; others are copied a batch at a time.
+         */
+        template <typename TIter>
+        class source
+        {
+        public:
+            using value_type = typename iterator_traits<TIter>::value_type;
+
+            source(TIter begin, TIter end) : begin(begin), end(end)
+            {
+            }
+
+            template <typename TSink>
+            void operator()(TSink&& sink) const
+            {
+                uint64_t mask[mask_words];
+                vector<value_type> copied;
+                size_t length = end - begin;
+                for (size_t offset = 0; offset < length; offset += batch_size)
+                {
+                    size_t size = std::min(batch_size, length - offset);
+                    for (size_t word = 0; word < mask_words; word++)
+                    {
+                        size_t first = word * 64;
+                        mask[word] = first + 64 <= size ? ~(uint64_t)0 : first < size ? ((uint64_t)1 << (size - first)) - 1 : 0;
+                    }
+
+                    const value_type* values;
+                    if constexpr (simd::is_contiguous_iterator<TIter>::value) values = std::addressof(*(begin + offset));
+                    else
+                    {
+                        copied.assign(begin + offset, begin + offset + size);
+                        values = copied.data();
+                    }
+
+                    if (!sink(batch<value_type> { values, mask, size, true })) return;
+                }
+            }
+
+        private:
+            TIter begin;
+            TIter end;
+        };
+
+        /**
+         * @brief Clears the mask bits of the rows which do not satisfy a predicate. The
+         * predicate is called on selected rows only; over a 64 row word with every row
+         * selected, it runs without branches.
+         */
+        template <typename TUpstream, typename TFunc>
+        class filter
+        {
+        public:
+            using value_type = typename TUpstream::value_type;
+
+            filter(TUpstream upstream, TFunc predicate) : upstream(upstream), predicate(predicate)
+            {
+            }
+
+            template <typename TSink>
+            void operator()(TSink&& sink) const
+            {
+                uint64_t mask[mask_words];
+                upstream([&](const batch<value_type>& rows)
+                {
+                    bool any = false;
+                    bool all = true;
+                    for (size_t word = 0; word * 64 < rows.size; word++)
+                    {
+                        uint64_t selected = rows.mask[word];
+                        const value_type* values = rows.values + word * 64;
+                        if (selected == ~(uint64_t)0)
+                        {
+                            // Full words test into bytes, a loop the compiler can vectorize, which are then packed.
+                            unsigned char hits[64];
+                            for (size_t row = 0; row < 64; row++) hits[row] = (bool)predicate(values[row]);
+                            selected = simd::pack_bits(hits);
+                        }
+                        else
+                        {
+                            // The rows an earlier step removed may hold anything, such as a map's unwritten values.
+                            for (uint64_t bits = selected; bits != 0; bits &= bits - 1)
+                            {
+                                size_t row = __builtin_ctzll(bits);
+                                if (!predicate(values[row])) selected &= ~((uint64_t)1 << row);
+                            }
+                        }
+                        mask[word] = selected;
+                        any |= selected != 0;
+                        all &= selected == rows.mask[word];
+                    }
+                    if (!any) return true;
+                    return sink(batch<value_type> { rows.values, mask, rows.size, rows.dense && all });
+                });
+            }
+
+        private:
+            TUpstream upstream;
+            TFunc predicate;
+        };
+
+        /**
+         * @brief Maps the selected rows of each batch into an output batch. The mapper is
+         * called only on selected rows.
+         */
+        template <typename TUpstream, typename TFunc>
+        class map
+        {
+            using TSource = typename TUpstream::value_type;
+
+        public:
+            using value_type = typename decay<typename result_of<TFunc(const TSource&)>::type>::type;
+
+            map(TUpstream upstream, TFunc mapper) : upstream(upstream), mapper(mapper)
+            {
+            }
+
+            template <typename TSink>
+            void operator()(TSink&& sink) const
+            {
+                // An array rather than a vector, since vector<bool> does not store bools.
+                unique_ptr<value_type[]> mapped(new value_type[batch_size]);
+                upstream([&](const batch<TSource>& rows)
+                {
+                    if (rows.dense)
+                    {
+                        for (size_t row = 0; row < rows.size; row++) mapped[row] = mapper(rows.values[row]);
+                    }
+                    else for_each_selected(rows, [&](size_t row) { mapped[row] = mapper(rows.values[row]); });
+                    return sink(batch<value_type> { mapped.get(), rows.mask, rows.size, rows.dense });
+                });
+            }
+
+        private:
+            TUpstream upstream;
+            TFunc mapper;
+        };
+
+        /**
+         * @brief Skips the first skipped selected rows, then passes on at most taken more.
+         */
+        template <typename TUpstream>
+        class slice
+        {
+        public:
+            using value_type = typename TUpstream::value_type;
+
+            slice(TUpstream upstream, size_t skipped, size_t taken) : upstream(upstream), skipped(skipped), taken(taken)
+            {
+            }
+
+            template <typename TSink>
+            void operator()(TSink&& sink) const
+            {
+                if (taken == 0) return;
+
+                uint64_t mask[mask_words];
+                size_t to_skip = skipped;
+                size_t to_take = taken;
+                upstream([&](const batch<value_type>& rows)
+                {
+                    size_t count = count_selected(rows);
+                    if (to_skip == 0 && count <= to_take)
+                    {
+                        to_take -= count;
+                        return sink(rows) && to_take > 0;
+                    }
+                    if (count <= to_skip)
+                    {
+                        to_skip -= count;
+                        return true;
+                    }
+
+                    // The batch straddles where the slice starts or ends: keep the rows in between.
+                    std::fill(mask, mask + mask_words, 0);
+                    size_t kept = 0;
+                    for_each_selected(rows, [&](size_t row)
+                    {
+                        if (to_skip > 0) to_skip--;
+                        else if (kept < to_take)
+                        {
+                            mask[row / 64] |= (uint64_t)1 << (row % 64);
+                            kept++;
+                        }
+                    });
+                    to_take -= kept;
+                    if (kept > 0 && !sink(batch<value_type> { rows.values, mask, rows.size, false })) return false;
+                    return to_take > 0;
+                });
+            }
+
+        private:
+            TUpstream upstream;
+            size_t skipped;
+            size_t taken;
+        };
+    }
+
+    /**
+     * @brief A query which runs over its source in batches of rows. Made by
+     * enumerable::batched(); it has the same names for the methods it supports.
+     */
+    template <typename TProducer>
+    class batch_enumerable
+    {
+        using TElement = typename TProducer::value_type;
+        using TBatch = batches::batch<TElement>;
+
+    public:
+        explicit batch_enumerable(TProducer producer) : producer(producer)
+        {
+        }
+
+        /**
+         * @brief Filters a sequence of values based on a predicate. The predicate is called
+         * on whole batches.
+         *
+         * @param predicate A function to test each element for a condition.
+         * @return A batch_enumerable over the elements which satisfy the condition.
+         */
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        batch_enumerable<batches::filter<TProducer, TFunc>> where(TFunc predicate) const
+        {
+            return batch_enumerable<batches::filter<TProducer, TFunc>>(batches::filter<TProducer, TFunc>(producer, predicate));
+        }
+
+        /**
+         * @brief Projects each element of a sequence into a new form, a batch at a time.
+         * The mapped type must be default constructible.
+         *
+         * @param mapper A transform function to apply to each element.
+         * @return A batch_enumerable over the mapped elements.
+         */
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        batch_enumerable<batches::map<TProducer, TFunc>> select(TFunc mapper) const
+        {
+            return batch_enumerable<batches::map<TProducer, TFunc>>(batches::map<TProducer, TFunc>(producer, mapper));
+        }
+
+        /**
+         * @brief Returns a specified number of contiguous elements from the start of a sequence.
+         */
+        batch_enumerable<batches::slice<TProducer>> take(size_t count) const
+        {
+            return batch_enumerable<batches::slice<TProducer>>(batches::slice<TProducer>(producer, 0, count));
+        }
+
+        /**
+         * @brief Bypasses a specified number of elements in a sequence and then returns the
+         * remaining elements.
+         */
+        batch_enumerable<batches::slice<TProducer>> skip(size_t count) const
+        {
+            return batch_enumerable<batches::slice<TProducer>>(batches::slice<TProducer>(producer, count, SIZE_MAX));
+        }
+
+        size_t count()
+        {
+            size_t count = 0;
+            producer([&](const TBatch& rows)
+            {
+                count += batches::count_selected(rows);
+                return true;
+            });
+            return count;
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        size_t count(TFunc predicate)
+        {
+            return where(predicate).count();
+        }
+
+        bool any()
+        {
+            bool found = false;
+            producer([&](const TBatch&)
+            {
+                found = true;
+                return false;
+            });
+            return found;
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        bool any(TFunc predicate)
+        {
+            return where(predicate).any();
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        bool all(TFunc predicate)
+        {
+            return !where([predicate](const TElement& element) { return !predicate(element); }).any();
+        }
+
+        /**
+         * @brief The sum of the elements. Each batch is summed on its own first, so floating
+         * point sums may differ in the last bits from a plain loop.
+         */
+        TElement sum() requires Number<TElement>()
+        {
+            TElement total = 0;
+            producer([&](const TBatch& rows)
+            {
+                total += fold(rows, TElement(0), simd::sum_op());
+                return true;
+            });
+            return total;
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto sum(TFunc mapper)
+        {
+            return select(mapper).sum();
+        }
+
+        TElement min() requires Number<TElement>()
+        {
+            return extreme(simd::min_op(),
+                           numeric_limits<TElement>::has_infinity ? numeric_limits<TElement>::infinity() : numeric_limits<TElement>::max());
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto min(TFunc mapper)
+        {
+            return select(mapper).min();
+        }
+
+        TElement max() requires Number<TElement>()
+        {
+            return extreme(simd::max_op(),
+                           numeric_limits<TElement>::has_infinity ? -numeric_limits<TElement>::infinity() : numeric_limits<TElement>::lowest());
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto max(TFunc mapper)
+        {
+            return select(mapper).max();
+        }
+
+        /**
+         * @brief The average of the elements: a double for integers, and the element type for
+         * floating point numbers.
+         */
+        auto average() requires Number<TElement>()
+        {
+            using TTotal = typename conditional<is_integral<TElement>::value, long long, TElement>::type;
+            using TResult = typename conditional<is_integral<TElement>::value, double, TElement>::type;
+
+            TTotal total = 0;
+            size_t count = 0;
+            producer([&](const TBatch& rows)
+            {
+                total += fold(rows, TTotal(0), simd::sum_op());
+                count += batches::count_selected(rows);
+                return true;
+            });
+            if (count == 0) throw length_error("cinq: sequence is empty");
+            return (TResult)total / (TResult)count;
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto average(TFunc mapper)
+        {
+            return select(mapper).average();
+        }
+
+        TElement first()
+        {
+            optional<TElement> found;
+            producer([&](const TBatch& rows)
+            {
+                batches::for_each_selected(rows, [&](size_t row)
+                {
+                    if (!found) found = rows.values[row];
+                });
+                return false;
+            });
+            if (!found) throw out_of_range("cinq: cannot get first element of empty enumerable");
+            return *found;
+        }
+
+        vector<TElement> to_vector()
+        {
+            vector<TElement> result;
+            producer([&](const TBatch& rows)
+            {
+                if (rows.dense) result.insert(result.end(), rows.values, rows.values + rows.size);
+                else batches::for_each_selected(rows, [&](size_t row) { result.push_back(rows.values[row]); });
+                return true;
+            });
+            return result;
+        }
+
+    private:
+        // Folds the selected rows of a batch into init with op, one of the operations of
+        // cinq_simd.hpp. Dense batches of int, float or double go through its kernels.
+        template <typename TTotal, typename TOp>
+        static TTotal fold(const TBatch& rows, TTotal init, TOp op)
+        {
+            if constexpr (simd::vectorizable_type<TElement> && is_same<TTotal, TElement>::value)
+            {
+                if (rows.dense) return simd::reduce(rows.values, rows.size, init, op);
+            }
+            TTotal total = init;
+            batches::for_each_selected(rows, [&](size_t row) { total = op(total, (TTotal)rows.values[row]); });
+            return total;
+        }
+
+        template <typename TOp>
+        TElement extreme(TOp op, TElement identity)
+        {
+            TElement best = identity;
+            bool found = false;
+            producer([&](const TBatch& rows)
+            {
+                best = fold(rows, best, op);
+                found = true;
+                return true;
+            });
+            if (!found) throw length_error("cinq: sequence is empty");
+            return best;
+        }
+
+        TProducer producer;
+    };
+}
+
+#endif
@@ -0,0 +1,601 @@
+#ifndef __cinq_columns_hpp__
+#define __cinq_columns_hpp__
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cinq_enumerable.hpp"
+#include "cinq_expression.hpp"
+#include "cinq_lazy.hpp"
+
+// Column-wise storage of records: each member of interest is kept in its own array, so a
+// query about one member reads only that member's array instead of every whole record.
+//
+//     auto days = cinq::to_columns(weather, &weather_point::temp_max, &weather_point::snow);
+//     int hottest = cinq::from(days).max(&weather_point::temp_max);
+//     auto snowy = cinq::from(days).where(&weather_point::snow, [](bool snow) { return snow; }).count();
+//
+// cinq::columns holds the arrays in memory and a snapshot maps them from a file; both are
+// column_tables. from() over a column_table gives a column_enumerable, whose where(), select(),
+// min(), max(), sum() and average() take a pointer to the member they look at.
+
+namespace cinq
+{
+    using namespace std;
+
+    /**
+     * @brief How the values of a member of type T are kept in a column: by default as they
+     * are. A type can instead be kept as a number by specializing this with that number type
+     * and the two conversions, which snapshots need for anything other than numbers:
+     *
+     *     template <> struct column_storage<tm>
+     *     {
+     *         using type = int32_t;
+     *         static int32_t store(const tm& date);
+     *         static tm load(int32_t days);
+     *     };
+     */
+    template <typename T>
+    struct column_storage
+    {
+        using type = T;
+
+        static const T& store(const T& value) { return value; }
+        static const T& load(const T& value) { return value; }
+    };
+
+    template <typename T>
+    using stored_t = typename column_storage<T>::type;
+
+    // Converts to any type, so that an aggregate can be brace initialized from as many of
+    // them as it has members, and no more.
+    struct any_member
+    {
+        template <typename T>
+        operator T() const;
+    };
+
+    template <typename TRecord, typename ... TMembers>
+    constexpr size_t member_count(...)
+    {
+        return sizeof...(TMembers);
+    }
+
+    /**
+     * @brief The number of members of an aggregate, found by trying to initialize it from
+     * one more any_member at a time.
+     */
+    template <typename TRecord, typename ... TMembers>
+    constexpr auto member_count(int) -> decltype(TRecord { TMembers()..., any_member() }, size_t())
+    {
+        return member_count<TRecord, TMembers..., any_member>(0);
+    }
+
+    template <typename TRecord>
+    constexpr size_t members_of()
+    {
+        if constexpr (is_aggregate<TRecord>::value) return member_count<TRecord>(0);
+        else return 0;
+    }
+
+    /**
+     * @brief Random access iterator over the records of a column_table, rebuilt one at a
+     * time from their rows. With a selection, it visits only the listed rows; the iterators
+     * share the selection, so it lives as long as any copy of the enumerable reading it.
+     */
+    template <typename TTable>
+    class row_iterator
+    {
+    public:
+        using iterator_category = random_access_iterator_tag;
+        using value_type = typename TTable::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        row_iterator() = default;
+
+        row_iterator(const TTable* table, shared_ptr<const vector<size_t>> selection, size_t position)
+            : table(table), selection(std::move(selection)), position(position)
+        {
+        }
+
+        reference operator*() const { return table->at(row(position)); }
+        reference operator[](difference_type n) const { return table->at(row(position + n)); }
+
+        row_iterator& operator++() { position++; return *this; }
+        row_iterator& operator--() { position--; return *this; }
+        row_iterator operator++(int) { row_iterator old = *this; position++; return old; }
+        row_iterator operator--(int) { row_iterator old = *this; position--; return old; }
+        row_iterator& operator+=(difference_type n) { position += n; return *this; }
+        row_iterator& operator-=(difference_type n) { position -= n; return *this; }
+        row_iterator operator+(difference_type n) const { return row_iterator(table, selection, position + n); }
+        row_iterator operator-(difference_type n) const { return row_iterator(table, selection, position - n); }
+        friend row_iterator operator+(difference_type n, const row_iterator& i) { return i + n; }
+        difference_type operator-(const row_iterator& other) const { return (difference_type)position - (difference_type)other.position; }
+
+        bool operator==(const row_iterator& other) const { return position == other.position; }
+        bool operator!=(const row_iterator& other) const { return position != other.position; }
+        bool operator<(const row_iterator& other) const { return position < other.position; }
+        bool operator>(const row_iterator& other) const { return position > other.position; }
+        bool operator<=(const row_iterator& other) const { return position <= other.position; }
+        bool operator>=(const row_iterator& other) const { return position >= other.position; }
+
+    private:
+        size_t row(size_t at) const
+        {
+            return selection ? (*selection)[at] : at;
+        }
+
+        const TTable* table = nullptr;
+        shared_ptr<const vector<size_t>> selection;
+        size_t position = 0;
+    };
+
+    /**
+     * @brief Records stored as one array per member. Derived classes own the arrays and
+     * point the table at them with set_column().
+     */
+    template <typename TRecord, typename ... TFields>
+    class column_table
+    {
+    public:
+        using value_type = TRecord;
+        using const_iterator = row_iterator<column_table>;
+
+        /**
+         * @brief true when the table has a column for each member of the record, which must
+         * be an aggregate. Whole records can only be rebuilt from such a table: anything
+         * else would hand out records with members silently zeroed.
+         */
+        static constexpr bool stores_every_member = members_of<TRecord>() == sizeof...(TFields);
+
+        size_t size() const
+        {
+            return rows;
+        }
+
+        /**
+         * @brief The record of the given row. Members kept as another type are converted
+         * back. Only compiles for a table which stores every member of the record.
+         */
+        TRecord at(size_t row) const
+        {
+            static_assert(stores_every_member, "cinq: whole records can only be rebuilt from columns of all their members");
+            TRecord record {};
+            fill(record, row, index_sequence_for<TFields...>());
+            return record;
+        }
+
+        TRecord operator[](size_t row) const
+        {
+            return at(row);
+        }
+
+        const_iterator begin() const { return const_iterator(this, nullptr, 0); }
+        const_iterator end() const { return const_iterator(this, nullptr, rows); }
+        const_iterator cbegin() const { return begin(); }
+        const_iterator cend() const { return end(); }
+
+        /**
+         * @brief The array of one member across all rows, which cinq::from() can query
+         * without rebuilding any record. It holds the member's values as stored, see
+         * column_storage.
+         *
+         * @param member pointer to a data member stored in the table
+         */
+        template <typename TField>
+        iterator_range<const stored_t<TField>*> column(TField TRecord::* member) const
+        {
+            const stored_t<TField>* values = nullptr;
+            bool found = false;
+            find_column(member, values, found, index_sequence_for<TFields...>());
+            if (!found) throw invalid_argument("cinq: the table has no column for this member");
+            return iterator_range<const stored_t<TField>*>(values, values + (values ? rows : 0));
+        }
+
+    protected:
+        explicit column_table(tuple<TFields TRecord::*...> members) : members(members)
+        {
+        }
+
+        template <size_t I>
+        void set_column(const stored_t<typename tuple_element<I, tuple<TFields...>>::type>* values)
+        {
+            get<I>(columns) = values;
+        }
+
+        tuple<TFields TRecord::*...> members;
+        size_t rows = 0;
+
+    private:
+        template <typename TField, size_t ... I>
+        void find_column(TField TRecord::* member, const stored_t<TField>*& values, bool& found, index_sequence<I...>) const
+        {
+            auto match = [&](auto candidate, auto column)
+            {
+                if constexpr (is_same<decltype(candidate), TField TRecord::*>::value)
+                {
+                    if (candidate == member && !found)
+                    {
+                        values = column;
+                        found = true;
+                    }
+                }
+            };
+            (match(get<I>(members), get<I>(columns)), ...);
+        }
+
+        template <size_t ... I>
+        void fill(TRecord& record, size_t row, index_sequence<I...>) const
+        {
+            ((record.*(get<I>(members)) = column_storage<TFields>::load(get<I>(columns)[row])), ...);
+        }
+
+        tuple<const stored_t<TFields>*...> columns;
+    };
+
+    /**
+     * @brief Records held in memory as one array per member. Made by cinq::to_columns().
+     * Copies share the same arrays, which cannot be changed once filled.
+     */
+    template <typename TRecord, typename ... TFields>
+    class columns : public column_table<TRecord, TFields...>
+    {
+    public:
+        /**
+         * @brief Copies the given members of some records into arrays.
+         *
+         * @param records a container of records
+         * @param members pointers to the data members to store
+         */
+        template <typename TRange>
+        requires Range<TRange>()
+        columns(const TRange& records, TFields TRecord::* ... members) : column_table<TRecord, TFields...>(make_tuple(members...))
+        {
+            this->rows = distance(std::begin(records), std::end(records));
+            store(records, index_sequence_for<TFields...>());
+        }
+
+    private:
+        template <typename TRange, size_t ... I>
+        void store(const TRange& records, index_sequence<I...>)
+        {
+            (store<I>(records), ...);
+        }
+
+        // Arrays rather than vectors, since vector<bool> has no array to point at.
+        template <size_t I, typename TRange>
+        void store(const TRange& records)
+        {
+            using TField = typename tuple_element<I, tuple<TFields...>>::type;
+            shared_ptr<stored_t<TField>[]> values(new stored_t<TField>[this->rows]);
+            size_t row = 0;
+            for (const auto& record : records) values[row++] = column_storage<TField>::store(record.*(get<I>(this->members)));
+
+            get<I>(arrays) = values;
+            this->template set_column<I>(values.get());
+        }
+
+        tuple<shared_ptr<stored_t<TFields>[]>...> arrays;
+    };
+
+    /**
+     * @brief Stores the given members of some records as one array per member.
+     *
+     * @param records a container of records
+     * @param members pointers to the data members to store
+     */
+    template <typename TRange, typename TRecord, typename ... TFields>
+    requires Range<TRange>()
+    columns<TRecord, TFields...> to_columns(const TRange& records, TFields TRecord::* ... members)
+    {
+        return columns<TRecord, TFields...>(records, members...);
+    }
+
+    /**
+     * @brief An enumerable over a column_table. Its where(), select(), min(), max(), sum()
+     * and average() can be given a pointer to a member instead of a function, and then read
+     * only that member's array. where() keeps the numbers of the matching rows rather than
+     * copies of them, so later calls only read their members at those rows.
+     *
+     * Every other method, and the ones above when given a function, is inherited from
+     * enumerable and works on whole records rebuilt from the columns, so it only compiles
+     * when the table stores every member of the record.
+     */
+    template <typename TTable>
+    class column_enumerable : public enumerable<iterator_range<row_iterator<TTable>>>
+    {
+        using base = enumerable<iterator_range<row_iterator<TTable>>>;
+        using TRecord = typename TTable::value_type;
+
+    public:
+        column_enumerable(const TTable& table, size_t thread_count)
+            : column_enumerable(table, thread_count, shared_ptr<const vector<size_t>>())
+        {
+        }
+
+        using base::where;
+        using base::select;
+        using base::min;
+        using base::max;
+        using base::sum;
+        using base::average;
+        using base::count;
+
+        /**
+         * @brief Filters the rows on the value of one member.
+         *
+         * @param member pointer to the member the predicate tests
+         * @param predicate A function to test each value for a condition.
+         * @return the rows whose value satisfies the condition
+         */
+        template <typename TField, typename TFunc>
+        requires Predicate<TFunc, TField>()
+        column_enumerable<TTable> where(TField TRecord::* member, TFunc predicate)
+        {
+            const TField* values = table->column(member).begin();
+            vector<size_t> rows;
+            if (selection)
+            {
+                rows = this->template fill_chunks<size_t>(selection->cbegin(), selection->cend(),
+                    [&](vector<size_t>::const_iterator chunk_begin, vector<size_t>::const_iterator chunk_end, size_t, vector<size_t>& kept)
+                    {
+                        for (auto row = chunk_begin; row != chunk_end; ++row)
+                        {
+                            if (predicate(values[*row])) kept.push_back(*row);
+                        }
+                    });
+            }
+            else
+            {
+                rows = this->template fill_chunks<size_t>(values, values + table->size(),
+                    [&](const TField* chunk_begin, const TField* chunk_end, size_t offset, vector<size_t>& kept)
+                    {
+                        for (const TField* value = chunk_begin; value != chunk_end; ++value)
+                        {
+                            if (predicate(*value)) kept.push_back(offset + (value - chunk_begin));
+                        }
+                    });
+            }
+            return column_enumerable<TTable>(*table, this->thread_count, make_shared<const vector<size_t>>(std::move(rows)));
+        }
+
+        /**
+         * @brief Filters the rows on a comparison of one member with a number, such as
+         * cinq::element > 90. Over a whole int, float or double column the vectorized
+         * kernels compare the member's array and pack the numbers of the matching rows.
+         */
+        template <typename TField, typename TCompare, typename TBound>
+        requires simd::vectorizable_type<TField> && expressions::is_comparison<TCompare>
+        column_enumerable<TTable> where(TField TRecord::* member, expressions::element_comparison<TCompare, TBound> predicate)
+        {
+            TField bound;
+            if (selection || !predicate.right.bound_as(bound))
+            {
+                return where(member, [predicate](const TField& value) { return predicate(value); });
+            }
+
+            const TField* values = table->column(member).begin();
+            vector<size_t> rows = this->template fill_chunks<size_t>(values, values + table->size(),
+                [&](const TField* chunk_begin, const TField* chunk_end, size_t offset, vector<size_t>& kept)
+                {
+                    simd::append_filtered_rows(chunk_begin, chunk_end - chunk_begin, TCompare(), bound, offset, kept);
+                });
+            return column_enumerable<TTable>(*table, this->thread_count, make_shared<const vector<size_t>>(std::move(rows)));
+        }
+
+        /**
+         * @brief Filters the rows on an expression, such as
+         * cinq::field(&weather_point::temp_max) > 90 && cinq::field(&weather_point::rain).
+         * A comparison of a member with a number runs the filter kernels on the member's
+         * array, as where(member, cinq::element > 90) does, the sides of && narrow the rows
+         * one after the other, and anything else is evaluated on the arrays of the members it
+         * names, without rebuilding whole records.
+         */
+        template <typename TOp, typename TLeft, typename TRight>
+        column_enumerable<TTable> where(const expressions::binary<TOp, TLeft, TRight>& predicate)
+        {
+            return narrow(predicate);
+        }
+
+        template <typename TOp, typename TOperand>
+        column_enumerable<TTable> where(const expressions::unary<TOp, TOperand>& predicate)
+        {
+            return narrow(predicate);
+        }
+
+        template <typename TField>
+        column_enumerable<TTable> where(const expressions::field<TRecord, TField>& predicate)
+        {
+            return narrow(predicate);
+        }
+
+        /**
+         * @brief The values of one member at each row, read from its array.
+         *
+         * @param member pointer to the member to read
+         * @return an enumerable owning the values
+         */
+        template <typename TField>
+        enumerable<vector<TField>> select(TField TRecord::* member)
+        {
+            const TField* values = table->column(member).begin();
+            vector<TField> picked;
+            if (selection)
+            {
+                picked.resize(selection->size());
+                for (size_t i = 0; i < selection->size(); i++) picked[i] = values[(*selection)[i]];
+            }
+            else picked.assign(values, values + table->size());
+
+            enumerable<vector<TField>> result(std::move(picked));
+            result.thread_count = this->thread_count;
+            return result;
+        }
+
+        /**
+         * @brief The values of the member a field expression reads, from its array.
+         */
+        template <typename TField>
+        enumerable<vector<TField>> select(const expressions::field<TRecord, TField>& mapper)
+        {
+            return select(mapper.member);
+        }
+
+        /**
+         * @brief The smallest value of a member.
+         */
+        template <typename TField>
+        requires Number<TField>()
+        TField min(TField TRecord::* member)
+        {
+            return over(member, [](auto&& values) { return values.min(); });
+        }
+
+        /**
+         * @brief The largest value of a member.
+         */
+        template <typename TField>
+        requires Number<TField>()
+        TField max(TField TRecord::* member)
+        {
+            return over(member, [](auto&& values) { return values.max(); });
+        }
+
+        /**
+         * @brief The sum of the values of a member.
+         */
+        template <typename TField>
+        requires Number<TField>()
+        TField sum(TField TRecord::* member)
+        {
+            return over(member, [](auto&& values) { return values.sum(); });
+        }
+
+        /**
+         * @brief The average of the values of a member, a double for integers.
+         */
+        template <typename TField>
+        requires Number<TField>()
+        auto average(TField TRecord::* member)
+        {
+            return over(member, [](auto&& values) { return values.average(); });
+        }
+
+        size_t count()
+        {
+            return selection ? selection->size() : table->size();
+        }
+
+    private:
+        column_enumerable(const TTable& table, size_t thread_count, shared_ptr<const vector<size_t>> selection)
+            : base(row_iterator<TTable>(&table, selection, 0),
+                   row_iterator<TTable>(&table, selection, selection ? selection->size() : table.size())),
+              table(&table), selection(selection)
+        {
+            this->thread_count = thread_count;
+        }
+
+        template <typename TLeft, typename TRight>
+        column_enumerable<TTable> narrow(const expressions::binary<logical_and<>, TLeft, TRight>& predicate)
+        {
+            return narrow(predicate.left).narrow(predicate.right);
+        }
+
+        template <typename TOp, typename TField, typename TBound>
+        requires expressions::is_comparison<TOp>
+        column_enumerable<TTable> narrow(const expressions::binary<TOp, expressions::field<TRecord, TField>, expressions::constant<TBound>>& predicate)
+        {
+            return where(predicate.left.member, expressions::element_comparison<TOp, TBound> { {}, predicate.right });
+        }
+
+        template <typename TOp, typename TField, typename TBound>
+        requires expressions::is_comparison<TOp>
+        column_enumerable<TTable> narrow(const expressions::binary<TOp, expressions::constant<TBound>, expressions::field<TRecord, TField>>& predicate)
+        {
+            return where(predicate.right.member, expressions::element_comparison<typename expressions::flipped<TOp>::type, TBound> { {}, predicate.left });
+        }
+
+        template <typename TExpr>
+        column_enumerable<TTable> narrow(const TExpr& predicate)
+        {
+            auto test = predicate.bind(*table);
+            vector<size_t> rows = this->template fill_chunks<size_t>(this->begin, this->end,
+                [&](row_iterator<TTable> chunk_begin, row_iterator<TTable> chunk_end, size_t offset, vector<size_t>& kept)
+                {
+                    for (size_t i = offset; i < offset + (chunk_end - chunk_begin); i++)
+                    {
+                        size_t row = selection ? (*selection)[i] : i;
+                        if (test(row)) kept.push_back(row);
+                    }
+                });
+            return column_enumerable<TTable>(*table, this->thread_count, make_shared<const vector<size_t>>(std::move(rows)));
+        }
+
+        // Without a selection the member's array is queried in place, where the vectorized
+        // kernels can read it. Selected rows are gathered first.
+        template <typename TField, typename TFunc>
+        auto over(TField TRecord::* member, TFunc reduce)
+        {
+            if (selection) return reduce(select(member));
+
+            auto values = table->column(member);
+            enumerable<iterator_range<const TField*>> query(values);
+            query.thread_count = this->thread_count;
+            return reduce(query);
+        }
+
+        const TTable* table;
+        shared_ptr<const vector<size_t>> selection;
+    };
+
+    template <typename TRecord, typename ... TFields>
+    column_table<TRecord, TFields...> column_table_of(const column_table<TRecord, TFields...>*);
+
+    /**
+     * @brief The column_table a type derives from: columns and snapshots.
+     */
+    template <typename T>
+    using column_table_t = decltype(column_table_of((T*)nullptr));
+
+    template <typename T>
+    concept bool Column_table()
+    {
+        return requires { typename column_table_t<T>; };
+    }
+
+    /**
+     * @brief Constructs a column_enumerable over records stored in columns or a snapshot.
+     *
+     * @param source the columns or snapshot, which must outlive the query
+     */
+    template <typename T>
+    requires Range<T>() && Column_table<T>()
+    auto from(T& source)
+    {
+        return column_enumerable<column_table_t<T>>(source, 1);
+    }
+
+    /**
+     * @brief Constructs a column_enumerable over records stored in columns or a snapshot,
+     * whose queries run in parallel.
+     *
+     * @param source the columns or snapshot, which must outlive the query
+     * @param policy cinq::par, or cinq::par(n) to limit the query to n threads
+     */
+    template <typename T>
+    requires Range<T>() && Column_table<T>()
+    auto from(T& source, parallel_policy policy)
+    {
+        return column_enumerable<column_table_t<T>>(source, resolve_thread_count(policy.thread_count));
+    }
+}
+
+#endif
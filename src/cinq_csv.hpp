@@ -0,0 +1,396 @@
+#ifndef __cinq_csv_hpp__
+#define __cinq_csv_hpp__
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cinq_enumerable.hpp"
+#include "cinq_mapped_file.hpp"
+
+// from_csv() reads a comma separated file with a header line into an enumerable of records,
+// filling each record through one column binding per field of interest:
+//
+//     auto days = cinq::from_csv<weather_point>("weather.csv",
+//         cinq::column("Max TemperatureF", &weather_point::temp_max),
+//         cinq::column("Events", [](string_view cell, weather_point& w) { w.rain = cell == "Rain"; }));
+//
+// The file is mapped into memory instead of being read into strings, and each line is cut
+// into string_views pointing into the mapping. Header names are resolved to column positions
+// once, and numbers are parsed with from_chars, which neither allocates nor consults the
+// locale.
+
+namespace cinq
+{
+    namespace csv
+    {
+        using namespace std;
+
+        /**
+         * @brief Parses a cell into a number. An empty cell gives 0.
+         */
+        template <typename T>
+        requires is_arithmetic<T>::value && !is_same<T, bool>::value
+        void parse(string_view cell, T& value)
+        {
+            if (cell.empty())
+            {
+                value = T();
+                return;
+            }
+
+            const char* last = cell.data() + cell.size();
+            auto parsed = from_chars(cell.data(), last, value);
+            if (parsed.ec == errc::result_out_of_range) throw out_of_range("cinq: " + string(cell) + " is out of range");
+            if (parsed.ec != errc() || parsed.ptr != last) throw invalid_argument("cinq: " + string(cell) + " is not a number");
+        }
+
+        /**
+         * @brief Parses true, false, 1 or 0. An empty cell gives false.
+         */
+        inline void parse(string_view cell, bool& value)
+        {
+            if (cell == "1" || cell == "true") value = true;
+            else if (cell.empty() || cell == "0" || cell == "false") value = false;
+            else throw invalid_argument("cinq: " + string(cell) + " is not a boolean");
+        }
+
+        /**
+         * @brief Copies a cell into a string, turning the doubled quotes of a quoted cell back
+         * into single ones.
+         */
+        inline void parse(string_view cell, string& value)
+        {
+            value.assign(cell.data(), cell.size());
+            for (size_t quote = value.find("\"\""); quote != string::npos; quote = value.find("\"\"", quote + 1))
+            {
+                value.erase(quote, 1);
+            }
+        }
+
+        /**
+         * @brief Parses a cell into a data member of a record.
+         */
+        template <typename TRecord, typename TField>
+        struct field_parser
+        {
+            TField TRecord::* field;
+
+            void operator()(string_view cell, TRecord& record) const
+            {
+                parse(cell, record.*field);
+            }
+        };
+
+        /**
+         * @brief Binds the column with a given header name to a function parse(cell, record)
+         * which stores the cell in the record. Made by cinq::column().
+         */
+        template <typename TParse>
+        struct column_binding
+        {
+            string name;
+            TParse parse;
+        };
+
+        /**
+         * @brief Splits the line [first, last) at commas into cells, and returns the number
+         * of cells. Only as many cells as cells.size() are stored.
+         *
+         * A cell starting with a double quote runs to the next lone double quote, so it may
+         * contain commas; the quotes are left out of the cell. Cells cannot span lines.
+         */
+        inline size_t split_line(const char* first, const char* last, vector<string_view>& cells)
+        {
+            size_t count = 0;
+            const char* cell = first;
+            while (true)
+            {
+                const char* stop;
+                string_view text;
+                if (cell != last && *cell == '"')
+                {
+                    const char* closing = cell + 1;
+                    while ((closing = (const char*)memchr(closing, '"', last - closing)) && closing + 1 != last && closing[1] == '"')
+                    {
+                        closing += 2;
+                    }
+                    if (!closing) closing = last;
+                    text = string_view(cell + 1, closing - cell - 1);
+                    stop = closing == last ? nullptr : (const char*)memchr(closing, ',', last - closing);
+                }
+                else
+                {
+                    // Cells are mostly a few characters long, too short for memchr() to pay off.
+                    const char* end = cell;
+                    while (end != last && *end != ',') end++;
+                    stop = end == last ? nullptr : end;
+                    text = string_view(cell, end - cell);
+                }
+
+                if (count < cells.size()) cells[count] = text;
+                count++;
+                if (!stop) return count;
+                cell = stop + 1;
+            }
+        }
+
+        /**
+         * @brief Reads the records of a CSV file held in memory. The constructor parses the
+         * header line and finds the position of each bound column in it; read() then parses
+         * any range of whole lines after the header.
+         */
+        template <typename TRecord, typename ... TParses>
+        class reader
+        {
+        public:
+            reader(const char* first, const char* last, const string& path, const tuple<column_binding<TParses>...>& columns)
+                : file_end(last), path(path), columns(columns)
+            {
+                const char* header_end = line_end(first, last);
+                vector<string_view> names;
+                names.resize(split_line(first, trim(first, header_end), names));
+                split_line(first, trim(first, header_end), names);
+                width = names.size();
+                body = header_end == last ? last : header_end + 1;
+
+                find_columns(names, index_sequence_for<TParses...>());
+            }
+
+            /**
+             * @brief The first byte after the header line.
+             */
+            const char* body_begin() const
+            {
+                return body;
+            }
+
+            /**
+             * @brief Parses the lines in [first, last), which must start at the beginning of
+             * a line, into consecutive value initialized records from out, and returns the
+             * number of records filled. Blank lines are skipped.
+             *
+             * A line with a different number of cells than the header is an error, except for
+             * a short last line of the file, which is taken for a record cut off while the file
+             * was being written and dropped.
+             *
+             * @param line the number of the line at first, counting from 1 for the header
+             */
+            size_t read(const char* first, const char* last, size_t line, TRecord* out) const
+            {
+                vector<string_view> cells(width);
+                size_t filled = 0;
+                for (const char* start = first; start < last; line++)
+                {
+                    const char* stop = line_end(start, last);
+                    const char* next = stop == last ? last : stop + 1;
+                    const char* content_end = trim(start, stop);
+                    if (content_end == start)
+                    {
+                        start = next;
+                        continue;
+                    }
+
+                    size_t count = split_line(start, content_end, cells);
+                    if (count < width && next == file_end) break;
+                    if (count != width)
+                    {
+                        throw runtime_error("cinq: " + path + " line " + to_string(line) + " has " + to_string(count)
+                                            + " cells, expected " + to_string(width));
+                    }
+
+                    fill(cells, out[filled++], line, index_sequence_for<TParses...>());
+                    start = next;
+                }
+                return filled;
+            }
+
+        private:
+            static const char* line_end(const char* first, const char* last)
+            {
+                const char* stop = (const char*)memchr(first, '\n', last - first);
+                return stop ? stop : last;
+            }
+
+            // Leaves out the carriage return of a line ending in \r\n.
+            static const char* trim(const char* first, const char* stop)
+            {
+                return stop != first && stop[-1] == '\r' ? stop - 1 : stop;
+            }
+
+            template <size_t ... I>
+            void find_columns(const vector<string_view>& names, index_sequence<I...>)
+            {
+                (find_column(names, get<I>(columns).name, positions[I]), ...);
+            }
+
+            void find_column(const vector<string_view>& names, const string& name, size_t& position)
+            {
+                auto found = find(names.begin(), names.end(), name);
+                if (found == names.end()) throw invalid_argument("cinq: " + path + " has no column named " + name);
+                position = found - names.begin();
+            }
+
+            template <size_t ... I>
+            void fill(const vector<string_view>& cells, TRecord& record, size_t line, index_sequence<I...>) const
+            {
+                size_t column = 0;
+                try
+                {
+                    ((column = I, get<I>(columns).parse(cells[positions[I]], record)), ...);
+                }
+                catch (const logic_error& error)
+                {
+                    // Names the cell: parsers only know its text.
+                    string names[] = { get<I>(columns).name... };
+                    throw invalid_argument("cinq: " + path + " line " + to_string(line) + ", column " + names[column] + ": " + error.what());
+                }
+            }
+
+            const char* body;
+            const char* file_end;
+            size_t width;
+            string path;
+            tuple<column_binding<TParses>...> columns;
+            array<size_t, sizeof...(TParses)> positions;
+        };
+
+        /**
+         * @brief Smallest number of bytes worth parsing on another thread.
+         */
+        constexpr size_t parallel_grain = 256 * 1024;
+
+        /**
+         * @brief Parses the records of the CSV data in [first, last) on up to the given
+         * number of threads.
+         *
+         * The lines after the header are cut into chunks of about the same number of bytes,
+         * each starting at the beginning of a line. Cells cannot span lines, so each chunk
+         * parses on its own. The lines of every chunk are counted first, which gives the
+         * chunk its own slice of the result: records are written once, straight into their
+         * place in file order.
+         */
+        template <typename TRecord, typename ... TParses>
+        vector<TRecord> read(const char* first, const char* last, const string& path, const tuple<column_binding<TParses>...>& columns,
+                             size_t threads)
+        {
+            vector<TRecord> records;
+            if (first == last) return records;
+
+            reader<TRecord, TParses...> parser(first, last, path, columns);
+            const char* body = parser.body_begin();
+            size_t length = last - body;
+            size_t chunks = std::max<size_t>(1, std::min(threads, length / parallel_grain));
+
+            vector<const char*> cuts(chunks + 1, last);
+            cuts[0] = body;
+            for (size_t c = 1; c < chunks; c++)
+            {
+                const char* cut = std::max(body + length * c / chunks, cuts[c - 1]);
+                const char* newline = (const char*)memchr(cut - 1, '\n', last - cut + 1);
+                cuts[c] = newline ? newline + 1 : last;
+            }
+
+            // offsets[c] is the number of lines before chunk c. The last line may not end in
+            // a newline, so it is counted separately.
+            vector<size_t> offsets(chunks + 1, 0);
+            parallel_chunks(chunks, chunks, [&](size_t chunk_first, size_t chunk_last, size_t)
+            {
+                for (size_t c = chunk_first; c < chunk_last; c++) offsets[c + 1] = std::count(cuts[c], cuts[c + 1], '\n');
+            });
+            offsets[chunks]++;
+            for (size_t c = 0; c < chunks; c++) offsets[c + 1] += offsets[c];
+
+            records.resize(offsets[chunks]);
+            vector<size_t> filled(chunks);
+            parallel_chunks(chunks, chunks, [&](size_t chunk_first, size_t chunk_last, size_t)
+            {
+                for (size_t c = chunk_first; c < chunk_last; c++)
+                {
+                    filled[c] = parser.read(cuts[c], cuts[c + 1], offsets[c] + 2, records.data() + offsets[c]);
+                }
+            });
+
+            // Blank lines and a dropped last line leave room at the end of a chunk's slice.
+            size_t kept = 0;
+            for (size_t c = 0; c < chunks; c++)
+            {
+                if (kept != offsets[c]) std::move(records.begin() + offsets[c], records.begin() + offsets[c] + filled[c], records.begin() + kept);
+                kept += filled[c];
+            }
+            records.erase(records.begin() + kept, records.end());
+            return records;
+        }
+    }
+
+    /**
+     * @brief Binds a CSV column to a data member, parsed as a number, a boolean or a string.
+     * Empty cells give 0, false or an empty string. cinq::schema() takes the same binding
+     * to name the column of a snapshot which stores the member.
+     *
+     * @param name the name of the column in the header line or the snapshot
+     * @param field pointer to the data member to store the cell in
+     */
+    template <typename TRecord, typename TField>
+    auto column(string name, TField TRecord::* field)
+    {
+        return csv::column_binding<csv::field_parser<TRecord, TField>> { std::move(name), { field } };
+    }
+
+    /**
+     * @brief Binds a CSV column to a function storing its cells in a record.
+     *
+     * @param name the name of the column in the header line
+     * @param parse function called as parse(string_view cell, TRecord& record). It may throw
+     * invalid_argument for a malformed cell, and cinq::csv::parse() can be used on the parts
+     * it extracts.
+     */
+    template <typename TParse>
+    requires !is_member_object_pointer<TParse>::value
+    auto column(string name, TParse parse)
+    {
+        return csv::column_binding<TParse> { std::move(name), parse };
+    }
+
+    /**
+     * @brief Reads a CSV file with a header line into an enumerable of records. Each record is
+     * value initialized, then filled by the column bindings in turn.
+     *
+     * @param path the file to read
+     * @param columns bindings made with cinq::column(), naming only the columns of interest
+     * @return an enumerable owning the records, in file order
+     */
+    template <typename TRecord, typename ... TParses>
+    enumerable<vector<TRecord>> from_csv(const string& path, csv::column_binding<TParses> ... columns)
+    {
+        mapped_file file(path);
+        return enumerable<vector<TRecord>>(csv::read<TRecord>(file.begin(), file.end(), path, make_tuple(columns...), 1));
+    }
+
+    /**
+     * @brief Reads a CSV file with a header line into an enumerable of records, parsing
+     * parts of the file on several threads. Queries on the result run on as many threads.
+     *
+     * @param path the file to read
+     * @param policy cinq::par, or cinq::par(n) to limit parsing to n threads
+     * @param columns bindings made with cinq::column(), naming only the columns of interest
+     * @return an enumerable owning the records, in file order
+     */
+    template <typename TRecord, typename ... TParses>
+    enumerable<vector<TRecord>> from_csv(const string& path, parallel_policy policy, csv::column_binding<TParses> ... columns)
+    {
+        size_t threads = resolve_thread_count(policy.thread_count);
+        mapped_file file(path);
+        return enumerable<vector<TRecord>>(csv::read<TRecord>(file.begin(), file.end(), path, make_tuple(columns...), threads), policy);
+    }
+}
+
+#endif
@@ -1,13 +1,23 @@
 #ifndef __cinq_enumerable_hpp__
 #define __cinq_enumerable_hpp__
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <optional>
 #include <vector>
 #include <stdexcept>
 #include <tuple>
 #include <typeinfo>
 
 #include "all_concepts.hpp"
+#include "cinq_aggregate.hpp"
+#include "cinq_expression.hpp"
+#include "cinq_hash.hpp"
+#include "cinq_parallel.hpp"
+#include "cinq_radix.hpp"
+#include "cinq_simd.hpp"
 #include "cinq_test.hpp"
 
 namespace cinq
@@ -15,6 +25,46 @@ namespace cinq
     using namespace std;
     using namespace origin;
 
+    template <typename TIter>
+    class lazy_enumerable;
+
+    template <typename TTable>
+    class column_enumerable;
+
+    template <typename TIter>
+    class late_enumerable;
+
+    template <typename TProducer>
+    class batch_enumerable;
+
+    namespace batches
+    {
+        template <typename TIter>
+        class source;
+    }
+
+    template <typename TPlan>
+    class plan_enumerable;
+
+    namespace plans
+    {
+        template <typename TIter>
+        class source;
+    }
+
+    template <typename TIter, typename TFunc>
+    class select_iterator;
+
+    /**
+     * @brief The elements of a sequence sharing one key, as produced by group_by().
+     */
+    template <typename TKey, typename TElement>
+    struct grouping
+    {
+        TKey key;
+        vector<TElement> elements;
+    };
+
     template <typename TSource, typename TElement = typename TSource::value_type, typename TIter = typename TSource::const_iterator>
     class enumerable
     {
@@ -28,17 +78,64 @@ namespace cinq
         enumerable(TSource& source) requires Range<TSource>()
         {
             is_data_copied = false;
+            thread_count = 1;
             begin = source.cbegin();
             end = source.cend();
         }
 
+        /**
+         * @brief A wrapper which allows cinq to operate on various containers,
+         * running the query on several threads where the source allows it.
+         *
+         * @param source the source container which
+         * provides the data cinq operates on
+         * @param policy cinq::par, or cinq::par(n) to limit the query to n threads
+         */
+        enumerable(TSource& source, parallel_policy policy) requires Range<TSource>() : enumerable(source)
+        {
+            thread_count = resolve_thread_count(policy.thread_count);
+        }
+
+        /**
+         * @brief A wrapper which takes over a temporary container, so the enumerable
+         * owns its elements instead of pointing into the container.
+         *
+         * @param source the container whose elements cinq moves into the query
+         */
+        enumerable(TSource&& source) requires Range<TSource>()
+        {
+            is_data_copied = true;
+            thread_count = 1;
+            if constexpr (is_same<TSource, vector<TElement>>::value) data = std::move(source);
+            else data.assign(make_move_iterator(source.begin()), make_move_iterator(source.end()));
+        }
+
+        /**
+         * @brief A wrapper which takes over a temporary container, running the query on
+         * several threads where the source allows it.
+         *
+         * @param source the container whose elements cinq moves into the query
+         * @param policy cinq::par, or cinq::par(n) to limit the query to n threads
+         */
+        enumerable(TSource&& source, parallel_policy policy) requires Range<TSource>() : enumerable(std::move(source))
+        {
+            thread_count = resolve_thread_count(policy.thread_count);
+        }
+
     private:
         
         enumerable()
         {
            is_data_copied=false;
+           thread_count = 1;
         }
-        
+
+        enumerable(TIter begin, TIter end) : begin(begin), end(end)
+        {
+            is_data_copied = false;
+            thread_count = 1;
+        }
+
     public:
         
         /**
@@ -50,26 +147,40 @@ namespace cinq
          */
         template <typename TFunc>
         requires Predicate<TFunc, TElement>() || Predicate<TFunc, TElement, size_t>()
-        enumerable<TSource> where(TFunc predicate)
+        enumerable<TSource> where(TFunc predicate) &
         {
-            if (is_data_copied) where(predicate, data.cbegin(), data.cend());
+            ensure_ordered();
+            if (is_data_copied) where_in_place(predicate);
             else where(predicate, begin, end);
 
             return *this;
         }
 
+        // Chaining on a temporary moves the data vector along instead of copying it.
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>() || Predicate<TFunc, TElement, size_t>()
+        enumerable<TSource> where(TFunc predicate) &&
+        {
+            ensure_ordered();
+            if (is_data_copied) where_in_place(predicate);
+            else where(predicate, begin, end);
+
+            return std::move(*this);
+        }
+
     private:
 
         template <typename TFunc, typename TIterator>
         requires Predicate<TFunc, TElement>()
         void where(TFunc predicate, TIterator begin, TIterator end)
         {
-            vector<TElement> updated;
-            for (auto iter = begin; iter != end; ++iter)
+            data = fill_chunks<TElement>(begin, end, [&](TIterator chunk_begin, TIterator chunk_end, size_t, vector<TElement>& updated)
             {
-                if (predicate(*iter)) updated.push_back(*iter);
-            }
-            data = updated;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    if (predicate(*iter)) updated.push_back(*iter);
+                }
+            });
             is_data_copied = true;
         }
 
@@ -77,15 +188,78 @@ namespace cinq
         requires Predicate<TFunc, TElement, size_t>()
         void where(TFunc predicate, TIterator begin, TIterator end)
         {
-            vector<TElement> updated;
+            data = fill_chunks<TElement>(begin, end, [&](TIterator chunk_begin, TIterator chunk_end, size_t offset, vector<TElement>& updated)
+            {
+                size_t i = offset;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    if (predicate(*iter, i)) updated.push_back(*iter);
+                    i++;
+                }
+            });
+            is_data_copied = true;
+        }
+
+        // Comparisons with a number over contiguous int, float or double elements run the
+        // vectorized filter kernels, which pack the kept elements without a branch each.
+        template <typename TCompare, typename TBound, typename TIterator>
+        requires simd::Vectorizable_iterator<TIterator>() && expressions::is_comparison<TCompare>
+        void where(expressions::element_comparison<TCompare, TBound> predicate, TIterator begin, TIterator end)
+        {
+            TElement bound;
+            if (!predicate.right.bound_as(bound)) return where([predicate](const TElement& element) { return predicate(element); }, begin, end);
+
+            data = fill_chunks<TElement>(begin, end, [&](TIterator chunk_begin, TIterator chunk_end, size_t, vector<TElement>& updated)
+            {
+                if (chunk_begin == chunk_end) return;
+                simd::append_filtered(simd::address(chunk_begin), chunk_end - chunk_begin, TCompare(), bound, updated);
+            });
+            is_data_copied = true;
+        }
+
+        // Once the data has been copied, where() compacts it in place rather than
+        // allocating a second vector. Parallel queries filter into per-thread vectors instead.
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        void where_in_place(TFunc predicate)
+        {
+            if (chunk_count(data.size()) > 1) return where(predicate, data.cbegin(), data.cend());
+
+            auto kept = data.begin();
+            for (auto iter = data.begin(); iter != data.end(); ++iter)
+            {
+                if (!predicate(*iter)) continue;
+                if (kept != iter) *kept = std::move(*iter);
+                ++kept;
+            }
+            data.erase(kept, data.end());
+        }
+
+        template <typename TCompare, typename TBound>
+        requires simd::vectorizable_type<TElement> && expressions::is_comparison<TCompare>
+        void where_in_place(expressions::element_comparison<TCompare, TBound> predicate)
+        {
+            TElement bound;
+            if (chunk_count(data.size()) > 1 || !predicate.right.bound_as(bound)) return where(predicate, data.cbegin(), data.cend());
+
+            data.resize(simd::filter(data.data(), data.size(), TCompare(), bound, data.data()));
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement, size_t>()
+        void where_in_place(TFunc predicate)
+        {
+            if (chunk_count(data.size()) > 1) return where(predicate, data.cbegin(), data.cend());
+
+            auto kept = data.begin();
             size_t i = 0;
-            for (auto iter = begin; iter != end; ++iter)
+            for (auto iter = data.begin(); iter != data.end(); ++iter, ++i)
             {
-                if (predicate(*iter, i)) updated.push_back(*iter);
-                i++;
+                if (!predicate(*iter, i)) continue;
+                if (kept != iter) *kept = std::move(*iter);
+                ++kept;
             }
-            data = updated;
-            is_data_copied = true;
+            data.erase(kept, data.end());
         }
 
     public:
@@ -111,38 +285,161 @@ namespace cinq
         requires Predicate<TFunc,TElement>()
         bool any(TFunc predicate)
         {
-            ensure_data();
-            for(TElement i : data){
-                if(predicate(i)) return true;
-            }
+            if (is_data_copied) return any(predicate, data.cbegin(), data.cend());
+            else return any(predicate, begin, end);
+        }
 
-            return false;
+    private:
+
+        template <typename TFunc, typename TIterator>
+        bool any(TFunc predicate, TIterator seq_begin, TIterator seq_end)
+        {
+            // Lets the other threads of a parallel query stop once one of them has an answer.
+            atomic<bool> found(false);
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                for (auto iter = chunk_begin; iter != chunk_end && !found.load(memory_order_relaxed); ++iter)
+                {
+                    if (predicate(*iter))
+                    {
+                        found.store(true, memory_order_relaxed);
+                        return true;
+                    }
+                }
+                return false;
+            }, logical_or<bool>());
         }
 
+    public:
+
         /**
          * @brief Concatenate another enumerable to this enumerable.
          *
          * @param other the enumerable to append
          * @return this enumerable with the other enumerable appended
          */
-        enumerable<TSource> concat(enumerable<TSource> other)
+        enumerable<TSource> concat(enumerable<TSource> other) &
+        {
+            concat_in_place(other);
+            return *this;
+        }
+
+        enumerable<TSource> concat(enumerable<TSource> other) &&
+        {
+            concat_in_place(other);
+            return std::move(*this);
+        }
+
+    private:
+
+        void concat_in_place(enumerable<TSource>& other)
         {
             ensure_data();
+            ensure_ordered();
+            other.ensure_ordered();
 
-            if (other.is_data_copied) data.insert(data.end(), other.data.cbegin(), other.data.cend());
+            if (other.is_data_copied)
+            {
+                // other was passed by value, so its copied data can be moved.
+                data.insert(data.end(), make_move_iterator(other.data.begin()), make_move_iterator(other.data.end()));
+            }
             else data.insert(data.end(), other.begin, other.end);
-
-            return *this;
         }
 
+    public:
+
         // Workaround which allows access to other enumerable instantiations' private members.
         template <typename TSourceFriend, typename TElementFriend, typename TIterFriend>
         friend class enumerable;
 
+        template <typename TIterFriend>
+        friend class lazy_enumerable;
+
+        template <typename TTableFriend>
+        friend class column_enumerable;
+
+        template <typename TIterFriend>
+        friend class late_enumerable;
+
+        /**
+         * @brief Switches the query to lazy evaluation. where() and select() on the result
+         * compose iterator adaptors over the source instead of copying it into a new vector,
+         * and nothing is evaluated until a method that produces a value is called. The thread
+         * count carries over, though sequences behind a where() can only be read by one thread.
+         *
+         * @return a lazy_enumerable over the same sequence
+         */
+        lazy_enumerable<TIter> lazy()
+        {
+            if (is_data_copied) throw logic_error("cinq: lazy() must be called before the sequence is copied");
+            return lazy_enumerable<TIter>(begin, end, thread_count);
+        }
+
+        /**
+         * @brief Switches the query to late materialization. where() on the result keeps the
+         * positions of the matching elements instead of copying them, and the methods after
+         * it read the elements where they lie in the source.
+         *
+         * @return a late_enumerable over the same sequence
+         */
+        late_enumerable<TIter> late() requires Random_access_iterator<TIter>()
+        {
+            if (is_data_copied) throw logic_error("cinq: late() must be called before the sequence is copied");
+            return late_enumerable<TIter>(begin, end, thread_count);
+        }
+
+        /**
+         * @brief Switches the query to batch execution: the rest of the query runs over the
+         * source a batch of rows at a time, with where() producing a bitmask per batch.
+         * Nothing runs until a method that produces a value is called.
+         *
+         * @return a batch_enumerable over the same sequence
+         */
+        batch_enumerable<batches::source<TIter>> batched() requires Random_access_iterator<TIter>()
+        {
+            if (is_data_copied) throw logic_error("cinq: batched() must be called before the sequence is copied");
+            return batch_enumerable<batches::source<TIter>>(batches::source<TIter>(begin, end));
+        }
+
+        /**
+         * @brief Switches the query to planned execution: where(), select(), take(), skip()
+         * and order_by() build a plan of the query, which is rewritten to do less work before
+         * a method that produces a value runs it in one pass over the source.
+         *
+         * @return a plan_enumerable over the same sequence
+         */
+        plan_enumerable<plans::source<TIter>> planned()
+        {
+            if (is_data_copied) throw logic_error("cinq: planned() must be called before the sequence is copied");
+            return plan_enumerable<plans::source<TIter>>(plans::source<TIter>(begin, end));
+        }
+
+        /**
+         * @brief Runs the rest of the query on several threads. where(), select(), count(),
+         * sum(), min(), max(), average(), any() and all() split random access sequences into
+         * one chunk per thread and combine the partial results, keeping the original order.
+         * Predicates and mappers must be safe to call concurrently.
+         *
+         * @param thread_count number of threads to use, or 0 for all hardware threads
+         * @return this enumerable, running in parallel
+         */
+        enumerable<TSource> parallel(size_t thread_count = 0) &
+        {
+            this->thread_count = resolve_thread_count(thread_count);
+            return *this;
+        }
+
+        enumerable<TSource> parallel(size_t thread_count = 0) &&
+        {
+            this->thread_count = resolve_thread_count(thread_count);
+            return std::move(*this);
+        }
+
         template <typename TFunc>
         requires Function<TFunc, TElement>() || Function<TFunc, TElement, size_t>()
         auto select(TFunc fun)
         {
+            ensure_ordered();
             if(is_data_copied) return select(fun,data.cbegin(),data.cend());
             else return select(fun,begin,end);
         }
@@ -155,8 +452,13 @@ namespace cinq
         {
             
             enumerable<vector<TReturn>> updated;
-            for (auto iter = begin; iter != end; ++iter) updated.data.push_back(fun(*iter));
+            updated.data = fill_chunks<TReturn>(begin, end, [&](TIterator chunk_begin, TIterator chunk_end, size_t, vector<TReturn>& mapped)
+            {
+                // Assigning from mapping iterators sizes the chunk once and maps straight into it.
+                mapped.assign(select_iterator<TIterator, TFunc>(chunk_begin, fun), select_iterator<TIterator, TFunc>(chunk_end, fun));
+            });
             updated.is_data_copied = true;
+            updated.thread_count = thread_count;
 
             return updated;
         }
@@ -167,14 +469,18 @@ namespace cinq
         {
             enumerable<vector<TReturn>> updated;
 
-            size_t index = 0;
-            for (auto iter = begin; iter != end; ++iter)
+            updated.data = fill_chunks<TReturn>(begin, end, [&](TIterator chunk_begin, TIterator chunk_end, size_t offset, vector<TReturn>& mapped)
             {
-                updated.data.push_back(fun(*iter, index));
-                index++;
-            }
+                size_t index = offset;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    mapped.push_back(fun(*iter, index));
+                    index++;
+                }
+            });
             
             updated.is_data_copied = true;
+            updated.thread_count = thread_count;
             
             return updated;
         }
@@ -186,16 +492,32 @@ namespace cinq
          *
          * @return A sequence whose elements correspond to those of the input sequence in reverse order
          */
-        enumerable<TSource> reverse()
+        enumerable<TSource> reverse() &
+        {
+            reverse_in_place();
+            return *this;
+        }
+
+        enumerable<TSource> reverse() &&
+        {
+            reverse_in_place();
+            return std::move(*this);
+        }
+
+    private:
+
+        void reverse_in_place()
         {
             //actually swaps data so actual data is reversed
             //might be better to reverse direction of the iterators
             //though I'm not sure if this is possible
             ensure_data();
+            ensure_ordered();
             std::reverse(data.begin(), data.end());
-            return *this;
         }
 
+    public:
+
         /**
          * @brief Returns a number that represents how many elements in the specified sequence satisfy a condition.
          *
@@ -206,17 +528,29 @@ namespace cinq
         requires Predicate<TFunc,TElement>()
         size_t count(TFunc predicate)
         {
-            ensure_data();
-            size_t count=0;
+            if (is_data_copied) return count(predicate, data.cbegin(), data.cend());
+            else return count(predicate, begin, end);
+        }
 
-            for(TElement i : data)
-              {
-               // printf("%u\n", *iter );
-                if(predicate(i)) ++count;
-            }
-            return count;
+    private:
 
+        template <typename TFunc, typename TIterator>
+        size_t count(TFunc predicate, TIterator seq_begin, TIterator seq_end)
+        {
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                size_t count = 0;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    if (predicate(*iter)) ++count;
+                }
+                return count;
+            }, plus<size_t>());
         }
+
+    public:
+
+
         /**
          * @brief Returns the number of elements in a sequence for
          * a Random_access_iterator container
@@ -286,26 +620,46 @@ namespace cinq
         template <typename TFunc, typename TReturn = typename result_of<TFunc(TElement)>::type, typename TIterator>
         TReturn max(TFunc mapper, TIterator seq_begin, TIterator seq_end)
         {
-            TReturn max = numeric_limits<TReturn>::min();
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
             {
-                TReturn val = mapper(*iter);
-                if (val > max) max = val;
-            }
-            return max;
+                TReturn max = numeric_limits<TReturn>::lowest();
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    TReturn val = mapper(*iter);
+                    if (val > max) max = val;
+                }
+                return max;
+            }, [](TReturn a, TReturn b) { return a < b ? b : a; });
         }
         
         template <typename TIterator>
         TElement max(TIterator seq_begin, TIterator seq_end)
         {
-            TElement max = numeric_limits<TElement>::min();
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                return max_chunk(chunk_begin, chunk_end);
+            }, [](TElement a, TElement b) { return a < b ? b : a; });
+        }
+
+        template <typename TIterator>
+        TElement max_chunk(TIterator chunk_begin, TIterator chunk_end)
+        {
+            TElement max = numeric_limits<TElement>::lowest();
+            for (auto iter = chunk_begin; iter != chunk_end; ++iter)
             {
                 TElement val = *iter;
                 if (val > max) max = val;
             }
             return max;
         }
+
+        template <typename TIterator>
+        requires simd::Vectorizable_iterator<TIterator>()
+        TElement max_chunk(TIterator chunk_begin, TIterator chunk_end)
+        {
+            if (chunk_begin == chunk_end) return numeric_limits<TElement>::lowest();
+            return simd::max(simd::address(chunk_begin), chunk_end - chunk_begin);
+        }
         
     public:
 
@@ -342,26 +696,46 @@ namespace cinq
         template <typename TFunc, typename TReturn = typename result_of<TFunc(TElement)>::type, typename TIterator>
         TReturn min(TFunc mapper, TIterator seq_begin, TIterator seq_end)
         {
-            TReturn min = numeric_limits<TReturn>::max();
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
             {
-                TReturn val = mapper(*iter);
-                if (val < min) min = val;
-            }
-            return min;
+                TReturn min = numeric_limits<TReturn>::max();
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    TReturn val = mapper(*iter);
+                    if (val < min) min = val;
+                }
+                return min;
+            }, [](TReturn a, TReturn b) { return b < a ? b : a; });
         }
         
         template <typename TIterator>
         TElement min(TIterator seq_begin, TIterator seq_end)
+        {
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                return min_chunk(chunk_begin, chunk_end);
+            }, [](TElement a, TElement b) { return b < a ? b : a; });
+        }
+
+        template <typename TIterator>
+        TElement min_chunk(TIterator chunk_begin, TIterator chunk_end)
         {
             TElement min = numeric_limits<TElement>::max();
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
+            for (auto iter = chunk_begin; iter != chunk_end; ++iter)
             {
                 TElement val = *iter;
                 if (val < min) min = val;
             }
             return min;
         }
+
+        template <typename TIterator>
+        requires simd::Vectorizable_iterator<TIterator>()
+        TElement min_chunk(TIterator chunk_begin, TIterator chunk_end)
+        {
+            if (chunk_begin == chunk_end) return numeric_limits<TElement>::max();
+            return simd::min(simd::address(chunk_begin), chunk_end - chunk_begin);
+        }
         
     public:
 
@@ -376,6 +750,7 @@ namespace cinq
         TReturn sum(TFunc mapper)
         {
             ensure_nonempty();
+            ensure_ordered();
             if (is_data_copied) return sum(mapper, data.cbegin(), data.cend());
             else return sum(mapper, begin, end);
         }
@@ -389,6 +764,7 @@ namespace cinq
         TElement sum() requires Number<TElement>()
         {
             ensure_nonempty();
+            ensure_ordered();
             if (is_data_copied) return sum(data.cbegin(), data.cend());
             else return sum(begin, end);
         }
@@ -398,18 +774,39 @@ namespace cinq
         template <typename TFunc, typename TReturn = typename result_of<TFunc(TElement)>::type, typename TIterator>
         TReturn sum(TFunc mapper, TIterator seq_begin, TIterator seq_end)
         {
-            TReturn sum = 0;
-            for (auto iter = seq_begin; iter != seq_end; ++iter) sum += mapper(*iter);
-            return sum;
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                TReturn sum = 0;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter) sum += mapper(*iter);
+                return sum;
+            }, plus<TReturn>());
         }
         
         template <typename TIterator>
         TElement sum(TIterator seq_begin, TIterator seq_end)
+        {
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                return sum_chunk(chunk_begin, chunk_end);
+            }, plus<TElement>());
+        }
+
+        template <typename TIterator>
+        TElement sum_chunk(TIterator chunk_begin, TIterator chunk_end)
         {
             TElement sum = 0;
-            for (auto iter = seq_begin; iter != seq_end; ++iter) sum += *iter;
+            for (auto iter = chunk_begin; iter != chunk_end; ++iter) sum += *iter;
             return sum;
         }
+
+        // Contiguous int, float and double chunks go through the vectorized kernels.
+        template <typename TIterator>
+        requires simd::Vectorizable_iterator<TIterator>()
+        TElement sum_chunk(TIterator chunk_begin, TIterator chunk_end)
+        {
+            if (chunk_begin == chunk_end) return 0;
+            return simd::sum(simd::address(chunk_begin), chunk_end - chunk_begin);
+        }
         
     public:
         
@@ -424,6 +821,7 @@ namespace cinq
         auto average(TFunc mapper)
         {
             ensure_nonempty();
+            ensure_ordered();
             if (is_data_copied) return average(mapper, data.cbegin(), data.cend());
             else return average(mapper, begin, end);
         }
@@ -436,6 +834,7 @@ namespace cinq
         auto average() requires Number<TElement>()
         {
             ensure_nonempty();
+            ensure_ordered();
             if (is_data_copied) return average(data.cbegin(), data.cend());
             else return average(begin, end);
         }
@@ -450,62 +849,756 @@ namespace cinq
         requires is_integral<TValue>::value
         double average(TFunc mapper, TIterator seq_begin, TIterator seq_end)
         {
-            TValue sum = 0;
-            size_t count = 0;
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
-            {
-                sum += mapper(*iter);
-                count++;
-            }
-            return sum / (double)count;
+            auto total = sum_and_count<TValue>(mapper, seq_begin, seq_end);
+            return total.first / (double)total.second;
         }
         
         template <typename TIterator>
         requires is_integral<TElement>::value
         double average(TIterator seq_begin, TIterator seq_end)
         {
-            TElement sum = 0;
-            size_t count = 0;
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
-            {
-                sum += *iter;
-                count++;
-            }
-            return sum / (double)count;
+            auto total = sum_and_count(seq_begin, seq_end);
+            return total.first / (double)total.second;
         }
 
         template <typename TFunc, typename TValue = typename result_of<TFunc(TElement)>::type, typename TIterator>
-        TElement average(TFunc mapper, TIterator seq_begin, TIterator seq_end)
+        TValue average(TFunc mapper, TIterator seq_begin, TIterator seq_end)
         {
-            TValue sum = 0;
-            size_t count = 0;
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
-            {
-                sum += mapper(*iter);
-                count++;
-            }
-            return sum / count;
+            auto total = sum_and_count<TValue>(mapper, seq_begin, seq_end);
+            return total.first / total.second;
         }
         
         template <typename TIterator>
         TElement average(TIterator seq_begin, TIterator seq_end)
         {
-            TElement sum = 0;
-            size_t count = 0;
-            for (auto iter = seq_begin; iter != seq_end; ++iter)
+            auto total = sum_and_count(seq_begin, seq_end);
+            return total.first / total.second;
+        }
+
+        template <typename TValue, typename TFunc, typename TIterator>
+        pair<TValue, size_t> sum_and_count(TFunc mapper, TIterator seq_begin, TIterator seq_end)
+        {
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
             {
-                sum += *iter;
-                count++;
-            }
-            return sum / count;
+                TValue sum = 0;
+                size_t count = 0;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    sum += mapper(*iter);
+                    count++;
+                }
+                return make_pair(sum, count);
+            }, [](pair<TValue, size_t> a, pair<TValue, size_t> b)
+            {
+                return make_pair(a.first + b.first, a.second + b.second);
+            });
         }
-        
+
+        template <typename TIterator>
+        pair<TElement, size_t> sum_and_count(TIterator seq_begin, TIterator seq_end)
+        {
+            return sum_and_count<TElement>([](const TElement& x) { return x; }, seq_begin, seq_end);
+        }
+
+        template <typename TIterator>
+        requires simd::Vectorizable_iterator<TIterator>()
+        pair<TElement, size_t> sum_and_count(TIterator seq_begin, TIterator seq_end)
+        {
+            return make_pair(sum(seq_begin, seq_end), (size_t)(seq_end - seq_begin));
+        }
+
     public:
 
         /**
-         * @brief Tests whether the enumerable contains no elements.
+         * @brief Computes several aggregates of a sequence in a single pass over it, on
+         * several threads for a parallel query.
          *
-         * @return true if the enumerable contains no elements. false otherwise.
+         * @param reducers cinq::min(), cinq::max(), cinq::sum(), cinq::avg() or cinq::count(),
+         * each given a mapper or pointer to member exposing the field of interest
+         * @return a tuple of the aggregates, in the order of the reducers
+         */
+        template <typename ... TReducers>
+        auto aggregate(TReducers... reducers)
+        {
+            ensure_ordered();
+            if (is_data_copied) return aggregate(data.cbegin(), data.cend(), reducers...);
+            else return aggregate(begin, end, reducers...);
+        }
+
+    private:
+
+        template <typename TIterator, typename ... TReducers>
+        auto aggregate(TIterator seq_begin, TIterator seq_end, TReducers... reducers)
+        {
+            auto all = make_tuple(reducers...);
+            using accumulators = tuple<decltype(reducers.template accumulator<TElement>())...>;
+            auto totals = reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
+            {
+                accumulators chunk_totals;
+                for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                {
+                    // Bound once, so that a lazy select() maps each element a single time.
+                    const TElement& x = *iter;
+                    aggregation::add_all(all, chunk_totals, x);
+                }
+                return chunk_totals;
+            }, [](accumulators a, const accumulators& b)
+            {
+                aggregation::merge_all(a, b);
+                return a;
+            });
+            return apply([](const auto& ... total) { return make_tuple(total.result()...); }, totals);
+        }
+
+    public:
+
+        /**
+         * @brief Groups the elements of a sequence by a key. Groups come in the order their
+         * keys first appear, and the elements of each group keep their order. A parallel
+         * query groups each chunk of the sequence on its own thread.
+         *
+         * @param key_of function giving the key of an element
+         * @param hint cinq::expected_groups { n } to size the hash table for about n groups
+         * @return a sequence of grouping, one per distinct key
+         */
+        template <typename TKeyOf, typename TKey = typename decay<typename result_of<TKeyOf(const TElement&)>::type>::type>
+        requires Invokable<TKeyOf, TElement>()
+        enumerable<vector<grouping<TKey, TElement>>> group_by(TKeyOf key_of, expected_groups hint = expected_groups { 0 })
+        {
+            auto groups = group_items<TKey, vector<TElement>>(key_of, hint, [](vector<TElement>& group, const TElement& x)
+            {
+                group.push_back(x);
+            }, [](vector<TElement>& into, vector<TElement>&& from)
+            {
+                into.insert(into.end(), make_move_iterator(from.begin()), make_move_iterator(from.end()));
+            });
+
+            enumerable<vector<grouping<TKey, TElement>>> result;
+            result.data.reserve(groups.size());
+            for (auto& group : groups) result.data.push_back(grouping<TKey, TElement> { std::move(group.first), std::move(group.second) });
+            result.is_data_copied = true;
+            result.thread_count = thread_count;
+            return result;
+        }
+
+        /**
+         * @brief Groups the elements of a sequence by a key and aggregates each group as it
+         * goes, without storing the groups' elements. Groups come in the order their keys
+         * first appear. A parallel query aggregates each chunk of the sequence into a table
+         * of its own and merges the tables at the end.
+         *
+         * @param key_of function giving the key of an element
+         * @param hint cinq::expected_groups { n } to size the hash table for about n groups
+         * @param reducers cinq::min(), cinq::max(), cinq::sum(), cinq::avg() or cinq::count(),
+         * as for aggregate()
+         * @return a sequence of tuples holding a key followed by the aggregates of its group
+         */
+        template <typename TKeyOf, typename TReducer, typename ... TReducers,
+                  typename TKey = typename decay<typename result_of<TKeyOf(const TElement&)>::type>::type>
+        requires Invokable<TKeyOf, TElement>()
+        auto group_by(TKeyOf key_of, expected_groups hint, TReducer first, TReducers... rest)
+        {
+            auto reducers = make_tuple(first, rest...);
+            using accumulators = tuple<decltype(first.template accumulator<TElement>()), decltype(rest.template accumulator<TElement>())...>;
+            auto groups = group_items<TKey, accumulators>(key_of, hint, [&](accumulators& totals, const TElement& x)
+            {
+                aggregation::add_all(reducers, totals, x);
+            }, [](accumulators& into, accumulators&& from)
+            {
+                aggregation::merge_all(into, from);
+            });
+
+            using TRow = decltype(tuple_cat(make_tuple(declval<TKey>()), make_tuple(first.template accumulator<TElement>().result(), rest.template accumulator<TElement>().result()...)));
+            enumerable<vector<TRow>> result;
+            result.data.reserve(groups.size());
+            for (auto& group : groups)
+            {
+                result.data.push_back(tuple_cat(make_tuple(std::move(group.first)),
+                                                apply([](const auto& ... total) { return make_tuple(total.result()...); }, group.second)));
+            }
+            result.is_data_copied = true;
+            result.thread_count = thread_count;
+            return result;
+        }
+
+        template <typename TKeyOf, typename TReducer, typename ... TReducers>
+        requires Invokable<TKeyOf, TElement>()
+        auto group_by(TKeyOf key_of, TReducer first, TReducers... rest)
+        {
+            return group_by(key_of, expected_groups { 0 }, first, rest...);
+        }
+
+    private:
+
+        /**
+         * @brief (key, value) pairs of the groups of the sequence, in the order their keys
+         * first appear. add(value, element) folds an element into its group's value, and
+         * merge(into, from) folds together the values two chunks made for the same key.
+         */
+        template <typename TKey, typename TValue, typename TKeyOf, typename TAdd, typename TMerge>
+        vector<pair<TKey, TValue>> group_items(TKeyOf key_of, expected_groups hint, TAdd add, TMerge merge)
+        {
+            ensure_ordered();
+            if (is_data_copied) return group_items<TKey, TValue>(data.cbegin(), data.cend(), key_of, hint, add, merge);
+            else return group_items<TKey, TValue>(begin, end, key_of, hint, add, merge);
+        }
+
+        template <typename TKey, typename TValue, typename TIterator, typename TKeyOf, typename TAdd, typename TMerge>
+        vector<pair<TKey, TValue>> group_items(TIterator seq_begin, TIterator seq_end, TKeyOf key_of, expected_groups hint, TAdd add, TMerge)
+        {
+            flat_hash_map<TKey, TValue> groups(hint.count);
+            group_into(groups, seq_begin, seq_end, key_of, add);
+            return std::move(groups.items());
+        }
+
+        template <typename TKey, typename TValue, typename TIterator, typename TKeyOf, typename TAdd, typename TMerge>
+        requires Random_access_iterator<TIterator>()
+        vector<pair<TKey, TValue>> group_items(TIterator seq_begin, TIterator seq_end, TKeyOf key_of, expected_groups hint, TAdd add, TMerge merge)
+        {
+            size_t length = seq_end - seq_begin;
+            size_t chunks = chunk_count(length);
+            vector<flat_hash_map<TKey, TValue>> tables;
+            tables.reserve(chunks);
+            for (size_t i = 0; i < chunks; i++) tables.emplace_back(hint.count);
+            if (chunks == 1)
+            {
+                group_into(tables[0], seq_begin, seq_end, key_of, add);
+                return std::move(tables[0].items());
+            }
+
+            parallel_chunks(length, chunks, [&](size_t first, size_t last, size_t index)
+            {
+                group_into(tables[index], seq_begin + first, seq_begin + last, key_of, add);
+            });
+            return merge_tables(tables, merge);
+        }
+
+        template <typename TGroups, typename TIterator, typename TKeyOf, typename TAdd>
+        void group_into(TGroups& groups, TIterator seq_begin, TIterator seq_end, TKeyOf key_of, TAdd add)
+        {
+            for (auto iter = seq_begin; iter != seq_end; ++iter)
+            {
+                // Bound once, so that a lazy select() maps each element a single time.
+                const TElement& x = *iter;
+                add(groups[key_of(x)], x);
+            }
+        }
+        
+    public:
+
+        /**
+         * @brief Correlates the elements of two sequences by matching keys, like an inner
+         * join. One sequence is built into a hash table and the other is streamed through
+         * it: other by default, or this one when both sizes are known up front and this one
+         * is smaller. Either way results come in the order of this sequence, and for each of
+         * its elements in the order of the matching elements of other.
+         *
+         * @param other the sequence to join with
+         * @param outer_key function giving the key of an element of this sequence
+         * @param inner_key function giving the key of an element of other
+         * @param result_selector function making a result from an element of each sequence
+         * @return the results for every pair of elements with equal keys
+         */
+        template <typename TOtherSource, typename TOtherElement, typename TOtherIter,
+                  typename TOuterKey, typename TInnerKey, typename TSelector,
+                  typename TKey = typename decay<typename result_of<TOuterKey(const TElement&)>::type>::type,
+                  typename TResult = typename decay<typename result_of<TSelector(const TElement&, const TOtherElement&)>::type>::type>
+        requires Invokable<TOuterKey, TElement>() && Invokable<TInnerKey, TOtherElement>()
+        enumerable<vector<TResult>> join(enumerable<TOtherSource, TOtherElement, TOtherIter> other,
+                                         TOuterKey outer_key, TInnerKey inner_key, TSelector result_selector)
+        {
+            ensure_ordered();
+            other.ensure_ordered();
+
+            enumerable<vector<TResult>> result;
+            result.is_data_copied = true;
+            result.thread_count = thread_count;
+
+            if (has_cheap_count() && other.has_cheap_count() && count() < other.count())
+            {
+                ensure_data();
+                flat_hash_index<TKey> table(data.cbegin(), data.cend(), outer_key);
+
+                // Streaming other finds the results in its order. Each is tagged with the
+                // position of its element of this sequence, then sorted back by it.
+                vector<pair<size_t, TResult>> matches;
+                auto probe = [&](auto seq_begin, auto seq_end)
+                {
+                    for (auto iter = seq_begin; iter != seq_end; ++iter)
+                    {
+                        const TOtherElement& y = *iter;
+                        auto found = table.find(inner_key(y));
+                        for (auto i = found.first; i != found.second; ++i) matches.emplace_back(*i, result_selector(data[*i], y));
+                    }
+                };
+                if (other.is_data_copied) probe(other.data.cbegin(), other.data.cend());
+                else probe(other.begin, other.end);
+
+                // A counting sort by position keeps the matches of each position in order.
+                vector<size_t> starts(data.size() + 1, 0);
+                for (auto& match : matches) starts[match.first + 1]++;
+                for (size_t i = 0; i < data.size(); i++) starts[i + 1] += starts[i];
+                vector<size_t> order(matches.size());
+                for (size_t m = 0; m < matches.size(); m++) order[starts[matches[m].first]++] = m;
+
+                result.data.reserve(matches.size());
+                for (size_t m : order) result.data.push_back(std::move(matches[m].second));
+            }
+            else
+            {
+                other.ensure_data();
+                flat_hash_index<TKey> table(other.data.cbegin(), other.data.cend(), inner_key);
+                auto probe = [&](auto seq_begin, auto seq_end)
+                {
+                    for (auto iter = seq_begin; iter != seq_end; ++iter)
+                    {
+                        const TElement& x = *iter;
+                        auto found = table.find(outer_key(x));
+                        for (auto i = found.first; i != found.second; ++i) result.data.push_back(result_selector(x, other.data[*i]));
+                    }
+                };
+                if (is_data_copied) probe(data.cbegin(), data.cend());
+                else probe(begin, end);
+            }
+            return result;
+        }
+
+        /**
+         * @brief Same as join() with an enumerable, for a container.
+         */
+        template <typename TOther, typename TOuterKey, typename TInnerKey, typename TSelector>
+        requires Range<TOther>()
+        auto join(TOther& other, TOuterKey outer_key, TInnerKey inner_key, TSelector result_selector)
+        {
+            return join(enumerable<TOther>(other), outer_key, inner_key, result_selector);
+        }
+
+    private:
+
+        /**
+         * @brief true if count() takes constant time: the data is copied, or the source
+         * iterators are random access.
+         */
+        bool has_cheap_count() const
+        {
+            return is_data_copied || Random_access_iterator<TIter>();
+        }
+
+    public:
+
+        /**
+         * @brief Same as join(), for two sequences already sorted in ascending order of their
+         * keys, such as after order_by(). Both are walked once, side by side, without
+         * building a hash table. Results come in the same order as from join().
+         *
+         * @param other the sequence to join with, sorted by inner_key
+         * @param outer_key function giving the key of an element of this sequence, by which
+         * it is sorted
+         * @param inner_key function giving the key of an element of other
+         * @param result_selector function making a result from an element of each sequence
+         * @return the results for every pair of elements with equal keys
+         */
+        template <typename TOtherSource, typename TOtherElement, typename TOtherIter,
+                  typename TOuterKey, typename TInnerKey, typename TSelector,
+                  typename TKey = typename decay<typename result_of<TOuterKey(const TElement&)>::type>::type,
+                  typename TResult = typename decay<typename result_of<TSelector(const TElement&, const TOtherElement&)>::type>::type>
+        requires Invokable<TOuterKey, TElement>() && Invokable<TInnerKey, TOtherElement>() && Totally_ordered<TKey>()
+        enumerable<vector<TResult>> merge_join(enumerable<TOtherSource, TOtherElement, TOtherIter> other,
+                                               TOuterKey outer_key, TInnerKey inner_key, TSelector result_selector)
+        {
+            ensure_ordered();
+            other.ensure_ordered();
+
+            enumerable<vector<TResult>> result;
+            result.is_data_copied = true;
+            result.thread_count = thread_count;
+
+            auto merge = [&](auto outer, auto outer_end, auto inner, auto inner_end)
+            {
+                while (outer != outer_end && inner != inner_end)
+                {
+                    TKey key = outer_key(*outer);
+                    if (key < inner_key(*inner)) ++outer;
+                    else if (inner_key(*inner) < key) ++inner;
+                    else
+                    {
+                        // Every outer element with this key pairs with the same run of inner ones.
+                        auto run = inner;
+                        auto run_end = inner;
+                        while (run_end != inner_end && !(key < inner_key(*run_end))) ++run_end;
+                        for (; outer != outer_end && !(key < outer_key(*outer)); ++outer)
+                        {
+                            const TElement& x = *outer;
+                            for (auto iter = run; iter != run_end; ++iter) result.data.push_back(result_selector(x, *iter));
+                        }
+                        inner = run_end;
+                    }
+                }
+            };
+
+            if (is_data_copied && other.is_data_copied) merge(data.cbegin(), data.cend(), other.data.cbegin(), other.data.cend());
+            else if (is_data_copied) merge(data.cbegin(), data.cend(), other.begin, other.end);
+            else if (other.is_data_copied) merge(begin, end, other.data.cbegin(), other.data.cend());
+            else merge(begin, end, other.begin, other.end);
+            return result;
+        }
+
+        /**
+         * @brief Same as merge_join() with an enumerable, for a container.
+         */
+        template <typename TOther, typename TOuterKey, typename TInnerKey, typename TSelector>
+        requires Range<TOther>()
+        auto merge_join(TOther& other, TOuterKey outer_key, TInnerKey inner_key, TSelector result_selector)
+        {
+            return merge_join(enumerable<TOther>(other), outer_key, inner_key, result_selector);
+        }
+
+        /**
+         * @brief The distinct elements found in both this sequence and other, which must both
+         * be sorted in ascending order, such as after order_by(). Both are walked once, side
+         * by side, and the result is sorted too.
+         *
+         * @param other an enumerable or container with the same element type
+         * @return the elements common to both sequences, each once
+         */
+        template <typename TOther>
+        enumerable<TSource> merge_intersect(TOther&& other) &
+        {
+            merge_set_in_place(as_enumerable(other), false, true, false);
+            return *this;
+        }
+
+        template <typename TOther>
+        enumerable<TSource> merge_intersect(TOther&& other) &&
+        {
+            merge_set_in_place(as_enumerable(other), false, true, false);
+            return std::move(*this);
+        }
+
+        /**
+         * @brief The distinct elements of this sequence which are not in other, both sorted
+         * in ascending order. Both are walked once, side by side, and the result is sorted too.
+         *
+         * @param other an enumerable or container with the same element type
+         * @return the elements only found in this sequence, each once
+         */
+        template <typename TOther>
+        enumerable<TSource> merge_except(TOther&& other) &
+        {
+            merge_set_in_place(as_enumerable(other), true, false, false);
+            return *this;
+        }
+
+        template <typename TOther>
+        enumerable<TSource> merge_except(TOther&& other) &&
+        {
+            merge_set_in_place(as_enumerable(other), true, false, false);
+            return std::move(*this);
+        }
+
+        /**
+         * @brief The distinct elements of this sequence and other, both sorted in ascending
+         * order. Both are walked once, side by side, and the result is sorted too.
+         *
+         * @param other an enumerable or container with the same element type
+         * @return the elements found in either sequence, each once
+         */
+        template <typename TOther>
+        enumerable<TSource> merge_union(TOther&& other) &
+        {
+            merge_set_in_place(as_enumerable(other), true, true, true);
+            return *this;
+        }
+
+        template <typename TOther>
+        enumerable<TSource> merge_union(TOther&& other) &&
+        {
+            merge_set_in_place(as_enumerable(other), true, true, true);
+            return std::move(*this);
+        }
+
+        /**
+         * @brief Removes repeated elements from a sequence, keeping the first of each in
+         * its place. Elements are tracked in a hash set, or for integers in a small range in
+         * a bitmap with one bit per possible value.
+         *
+         * @return the distinct elements, in their original order
+         */
+        enumerable<TSource> distinct() &
+        {
+            distinct_in_place(aggregation::identity());
+            return *this;
+        }
+
+        enumerable<TSource> distinct() &&
+        {
+            distinct_in_place(aggregation::identity());
+            return std::move(*this);
+        }
+
+        /**
+         * @brief Removes the elements whose key was already seen earlier in the sequence.
+         *
+         * @param key_of function giving the key elements are compared by
+         * @return the first element with each key, in their original order
+         */
+        template <typename TFunc>
+        requires Invokable<TFunc, TElement>()
+        enumerable<TSource> distinct(TFunc key_of) &
+        {
+            distinct_in_place(key_of);
+            return *this;
+        }
+
+        template <typename TFunc>
+        requires Invokable<TFunc, TElement>()
+        enumerable<TSource> distinct(TFunc key_of) &&
+        {
+            distinct_in_place(key_of);
+            return std::move(*this);
+        }
+
+        /**
+         * @brief The distinct elements of this sequence followed by those of other which are
+         * not in this one, each in its original order.
+         *
+         * @param other an enumerable or container with the same element type
+         * @return the elements found in either sequence, each once
+         */
+        template <typename TOther>
+        enumerable<TSource> union_with(TOther&& other) &
+        {
+            union_in_place(as_enumerable(other));
+            return *this;
+        }
+
+        template <typename TOther>
+        enumerable<TSource> union_with(TOther&& other) &&
+        {
+            union_in_place(as_enumerable(other));
+            return std::move(*this);
+        }
+
+        /**
+         * @brief The distinct elements of this sequence which are also in other, in their
+         * original order.
+         *
+         * @param other an enumerable or container with the same element type
+         * @return the elements common to both sequences, each once
+         */
+        template <typename TOther>
+        enumerable<TSource> intersect(TOther&& other) &
+        {
+            filter_by_set(as_enumerable(other), true);
+            return *this;
+        }
+
+        template <typename TOther>
+        enumerable<TSource> intersect(TOther&& other) &&
+        {
+            filter_by_set(as_enumerable(other), true);
+            return std::move(*this);
+        }
+
+        /**
+         * @brief The distinct elements of this sequence which are not in other, in their
+         * original order.
+         *
+         * @param other an enumerable or container with the same element type
+         * @return the elements only found in this sequence, each once
+         */
+        template <typename TOther>
+        enumerable<TSource> except(TOther&& other) &
+        {
+            filter_by_set(as_enumerable(other), false);
+            return *this;
+        }
+
+        template <typename TOther>
+        enumerable<TSource> except(TOther&& other) &&
+        {
+            filter_by_set(as_enumerable(other), false);
+            return std::move(*this);
+        }
+
+    private:
+
+        /**
+         * @brief Keeps the elements for whose index keep returns true, in order. keep(i) is
+         * called before the element at i is moved.
+         */
+        template <typename TKeep>
+        void keep_in_place(TKeep keep)
+        {
+            size_t kept = 0;
+            for (size_t i = 0; i < data.size(); i++)
+            {
+                if (!keep(i)) continue;
+                if (kept != i) data[kept] = std::move(data[i]);
+                kept++;
+            }
+            data.erase(data.begin() + kept, data.end());
+        }
+
+        template <typename TKeyOf, typename TKey = typename decay<typename result_of<TKeyOf(const TElement&)>::type>::type>
+        void distinct_in_place(TKeyOf key_of)
+        {
+            ensure_data();
+            ensure_ordered();
+            flat_hash_set<TKey> seen;
+            keep_in_place([&](size_t i) { return seen.insert(key_of(data[i])); });
+        }
+
+        // The keys are computed once up front to find their range. If the range is no more
+        // than 64 times the length, a bitmap over it takes no more memory than the keys.
+        template <typename TKeyOf, typename TKey = typename decay<typename result_of<TKeyOf(const TElement&)>::type>::type>
+        requires is_integral<TKey>::value && !is_same<TKey, bool>::value
+        void distinct_in_place(TKeyOf key_of)
+        {
+            ensure_data();
+            ensure_ordered();
+            size_t length = data.size();
+            if (length == 0) return;
+
+            vector<TKey> keys(length);
+            for (size_t i = 0; i < length; i++) keys[i] = key_of(data[i]);
+
+            using TUnsigned = typename make_unsigned<TKey>::type;
+            auto bounds = minmax_element(keys.begin(), keys.end());
+            TUnsigned low = (TUnsigned)*bounds.first;
+            uint64_t range = (TUnsigned)((TUnsigned)*bounds.second - low);
+            if (range / 64 >= std::max<size_t>(length, 1024))
+            {
+                flat_hash_set<TKey> seen;
+                keep_in_place([&](size_t i) { return seen.insert(keys[i]); });
+                return;
+            }
+
+            vector<uint64_t> seen(range / 64 + 1, 0);
+            keep_in_place([&](size_t i)
+            {
+                uint64_t offset = (TUnsigned)((TUnsigned)keys[i] - low);
+                uint64_t bit = (uint64_t)1 << (offset % 64);
+                if (seen[offset / 64] & bit) return false;
+                seen[offset / 64] |= bit;
+                return true;
+            });
+        }
+
+        template <typename TOtherSource, typename TOtherIter>
+        void union_in_place(enumerable<TOtherSource, TElement, TOtherIter> other)
+        {
+            ensure_data();
+            ensure_ordered();
+            other.ensure_ordered();
+            if (other.is_data_copied) data.insert(data.end(), make_move_iterator(other.data.begin()), make_move_iterator(other.data.end()));
+            else data.insert(data.end(), other.begin, other.end);
+            distinct_in_place(aggregation::identity());
+        }
+
+        /**
+         * @brief Keeps the first copy of each element which other contains, or does not
+         * contain, as selected.
+         */
+        template <typename TOtherSource, typename TOtherIter>
+        void filter_by_set(enumerable<TOtherSource, TElement, TOtherIter> other, bool contained)
+        {
+            ensure_data();
+            ensure_ordered();
+            other.ensure_ordered();
+
+            // Each element of other maps to whether a copy of it was kept already.
+            flat_hash_map<TElement, bool> others;
+            auto add = [&](auto seq_begin, auto seq_end)
+            {
+                for (auto iter = seq_begin; iter != seq_end; ++iter) others[*iter];
+            };
+            if (other.is_data_copied) add(other.data.cbegin(), other.data.cend());
+            else add(other.begin, other.end);
+
+            if (contained)
+            {
+                keep_in_place([&](size_t i)
+                {
+                    bool* kept = others.find(data[i]);
+                    if (!kept || *kept) return false;
+                    *kept = true;
+                    return true;
+                });
+            }
+            else
+            {
+                // Kept elements join the set so their later copies are dropped.
+                keep_in_place([&](size_t i)
+                {
+                    size_t hash = others.hash_of(data[i]);
+                    if (others.find(hash, data[i])) return false;
+                    others.add(hash, data[i], true);
+                    return true;
+                });
+            }
+        }
+
+    private:
+
+        template <typename TOtherSource, typename TOtherIter>
+        static enumerable<TOtherSource, TElement, TOtherIter> as_enumerable(const enumerable<TOtherSource, TElement, TOtherIter>& other)
+        {
+            return other;
+        }
+
+        template <typename TOther>
+        requires Range<TOther>()
+        static enumerable<TOther> as_enumerable(TOther& other)
+        {
+            return enumerable<TOther>(other);
+        }
+
+        /**
+         * @brief Replaces the sequence with the distinct elements found only in it, in both
+         * it and other, or only in other, as selected.
+         */
+        template <typename TOtherSource, typename TOtherIter>
+        requires Mergeable<typename vector<TElement>::const_iterator, TOtherIter, typename vector<TElement>::iterator>()
+        void merge_set_in_place(enumerable<TOtherSource, TElement, TOtherIter> other, bool keep_this_only, bool keep_both, bool keep_other_only)
+        {
+            ensure_ordered();
+            other.ensure_ordered();
+
+            vector<TElement> merged;
+            auto merge = [&](auto a, auto a_end, auto b, auto b_end)
+            {
+                while (a != a_end || b != b_end)
+                {
+                    // Each step takes the smallest value left and skips all its copies.
+                    auto a_run = a;
+                    auto b_run = b;
+                    bool in_a = a != a_end && (b == b_end || !(*b < *a));
+                    bool in_b = b != b_end && (a == a_end || !(*a < *b));
+                    if (in_a) while (a != a_end && !(*a_run < *a)) ++a;
+                    if (in_b) while (b != b_end && !(*b_run < *b)) ++b;
+
+                    if (in_a && in_b) { if (keep_both) merged.push_back(*a_run); }
+                    else if (in_a) { if (keep_this_only) merged.push_back(*a_run); }
+                    else if (keep_other_only) merged.push_back(*b_run);
+                }
+            };
+
+            if (is_data_copied && other.is_data_copied) merge(data.cbegin(), data.cend(), other.data.cbegin(), other.data.cend());
+            else if (is_data_copied) merge(data.cbegin(), data.cend(), other.begin, other.end);
+            else if (other.is_data_copied) merge(begin, end, other.data.cbegin(), other.data.cend());
+            else merge(begin, end, other.begin, other.end);
+
+            data = std::move(merged);
+            is_data_copied = true;
+        }
+
+    public:
+
+        /**
+         * @brief Tests whether the enumerable contains no elements.
+         *
+         * @return true if the enumerable contains no elements. false otherwise.
          */
         inline bool empty()
         {
@@ -524,42 +1617,51 @@ namespace cinq
         requires Predicate<TFunc,TElement>()
         bool all(TFunc predicate)
         {
-            ensure_data();
-            for(TElement i : data){
-                if(!predicate(i)) return false;
-            }
-
-            return true;
+            if (is_data_copied) return all(predicate, data.cbegin(), data.cend());
+            else return all(predicate, begin, end);
         }
 
-        /**
-         * @brief Returns a specified number of contiguous elements from the start of a sequence.
-         *
-         * @param count number of elements
-         * @return specified number of contiguous elements
-         */
-        enumerable<TSource> take(size_t count)
+    private:
+
+        template <typename TFunc, typename TIterator>
+        bool all(TFunc predicate, TIterator seq_begin, TIterator seq_end)
         {
-            if (is_data_copied)
+            // Lets the other threads of a parallel query stop once one of them has an answer.
+            atomic<bool> failed(false);
+            return reduce_chunks(seq_begin, seq_end, [&](TIterator chunk_begin, TIterator chunk_end)
             {
-                // TODO: resize() is O(N) operation. See if there is a better way.
-                if (data.size() > count) data.resize(count);
-            }
-            else
-            {
-                auto iter = begin;
-                // This loop looks wrong, but the ending iterator should be 1 beyond the last element.
-                while (count > 0 && end != iter)
+                for (auto iter = chunk_begin; iter != chunk_end && !failed.load(memory_order_relaxed); ++iter)
                 {
-                    ++iter;
-                    count--;
+                    if (!predicate(*iter))
+                    {
+                        failed.store(true, memory_order_relaxed);
+                        return false;
+                    }
                 }
-                end = iter;
-            }
+                return true;
+            }, logical_and<bool>());
+        }
 
+    public:
+
+        /**
+         * @brief Returns a specified number of contiguous elements from the start of a sequence.
+         *
+         * @param count number of elements
+         * @return specified number of contiguous elements
+         */
+        enumerable<TSource> take(size_t count) &
+        {
+            take_in_place(count);
             return *this;
         }
 
+        enumerable<TSource> take(size_t count) &&
+        {
+            take_in_place(count);
+            return std::move(*this);
+        }
+
         // Try to catch a negative count before it gets casted into a huge size_t.
         /**
          * @brief Returns a specified number of contiguous elements from the start of a sequence.
@@ -567,18 +1669,30 @@ namespace cinq
          * @param count number of elements
          * @return specified number of contiguous elements
          */
-        enumerable<TSource> take(int count)
+        enumerable<TSource> take(int count) &
         {
             if (count >= 0) return take((size_t)count);
             else throw invalid_argument("cinq: take() was called with negative count");
         }
 
-        enumerable<TSource> skip(int count)
+        enumerable<TSource> take(int count) &&
+        {
+            if (count >= 0) return std::move(*this).take((size_t)count);
+            else throw invalid_argument("cinq: take() was called with negative count");
+        }
+
+        enumerable<TSource> skip(int count) &
         {
             if (count >= 0) return skip((size_t)count);
             else throw invalid_argument("cinq: skip() was called with negative count");
         }
 
+        enumerable<TSource> skip(int count) &&
+        {
+            if (count >= 0) return std::move(*this).skip((size_t)count);
+            else throw invalid_argument("cinq: skip() was called with negative count");
+        }
+
         /**
          * @brief Bypasses a specified number of elements in a sequence
          * and then returns the remaining elements.
@@ -586,8 +1700,51 @@ namespace cinq
          * @param count number of elements to bypass
          * @return the sequence of the remaining elements
          */
-        enumerable<TSource> skip(size_t count)
+        enumerable<TSource> skip(size_t count) &
+        {
+            skip_in_place(count);
+            return *this;
+        }
+
+        enumerable<TSource> skip(size_t count) &&
+        {
+            skip_in_place(count);
+            return std::move(*this);
+        }
+
+    private:
+
+        void take_in_place(size_t count)
+        {
+            if (pending_order && count < data.size())
+            {
+                // Only the first count elements of the pending order are kept, so only they are sorted.
+                if (count > ordered_prefix) pending_order(data, count, false);
+                pending_order = nullptr;
+            }
+            ensure_ordered();
+
+            if (is_data_copied)
+            {
+                // erase() rather than resize(), which would require TElement to be default constructible.
+                if (data.size() > count) data.erase(data.begin() + count, data.end());
+            }
+            else
+            {
+                auto iter = begin;
+                // This loop looks wrong, but the ending iterator should be 1 beyond the last element.
+                while (count > 0 && end != iter)
+                {
+                    ++iter;
+                    count--;
+                }
+                end = iter;
+            }
+        }
+
+        void skip_in_place(size_t count)
         {
+            ensure_ordered();
 
                 //the could be a much better way to this
                // ensure_data();
@@ -611,9 +1768,10 @@ namespace cinq
                 begin = iter; //there will probably be a memory leak, still reachable
 
             }
-            return *this;
         }
 
+    public:
+
         /**
          * @brief Determines whether a sequence contains a specified element by using the default equality comparer.
          *
@@ -644,6 +1802,7 @@ namespace cinq
         {
             if(is_data_copied)
             {
+                if (index < data.size()) ensure_ordered(index + 1);
                 return data.at(index);
             }
             else
@@ -652,10 +1811,11 @@ namespace cinq
                 // This loop looks wrong, but the ending iterator should be 1 beyond the last element.
                 while (index > 0)
                 {
-                    if (end != iter) throw out_of_range("index out of range");
+                    if (end == iter) throw out_of_range("cinq: element_at() index out of range");
                     ++iter;
                     index--;
                 }
+                if (end == iter) throw out_of_range("cinq: element_at() index out of range");
                 return *iter;
             }
         }
@@ -692,6 +1852,7 @@ namespace cinq
         requires Predicate<TFunc, TElement>()
         TElement first(TFunc predicate)
         {
+            ensure_ordered();
             if (is_data_copied)
             {
                 for (TElement& i : data)
@@ -717,6 +1878,7 @@ namespace cinq
         TElement last()
         {
             if (empty()) throw out_of_range("cinq: cannot get last element of empty enumerable");
+            ensure_ordered();
 
             if (is_data_copied) return data[data.size() - 1];
             else
@@ -738,6 +1900,7 @@ namespace cinq
         TElement last(TFunc predicate)
         {
             if (empty()) throw out_of_range("cinq: cannot get last element of empty enumerable");
+            ensure_ordered();
 
             if(is_data_copied)
             {
@@ -771,6 +1934,7 @@ namespace cinq
         TElement single()
         {
             if (empty()) throw out_of_range("cinq: structure has no elements");
+            ensure_ordered();
 
             if (is_data_copied)
             {
@@ -796,6 +1960,7 @@ namespace cinq
         requires Predicate<TFunc, TElement>()
         TElement single(TFunc predicate)
         {
+            ensure_ordered();
             bool found = false;
 
             if (is_data_copied)
@@ -835,59 +2000,384 @@ namespace cinq
          *
          * @return data
          */
-        vector<TElement> to_vector()
+        vector<TElement> to_vector() &
+        {
+            ensure_ordered();
+            if (is_data_copied) return data;
+            else return vector<TElement>(begin, end);
+        }
+
+        /**
+         * @brief returns vector of data contained in enumerable. Called on a temporary,
+         * the data is moved out instead of copied.
+         *
+         * @return data
+         */
+        vector<TElement> to_vector() &&
         {
             ensure_data();
-            return data;
+            ensure_ordered();
+            return std::move(data);
+        }
+
+        /**
+         * @brief Sorts the elements of a sequence in ascending order of the given keys, keeping
+         * the original order of equal elements. The sort is deferred until the sequence is
+         * read, so that a following take(k), first() or element_at(k) only orders the
+         * elements it returns, in O(n log k). On a parallel query long sequences are sorted
+         * in runs on several threads which are then merged.
+         *
+         * @param rest mappers giving the primary key, then the keys used to break ties
+         * @return the ordered sequence
+         */
+        template<typename ... TFunc>
+        enumerable<TSource> order_by(TFunc... rest) &
+        {
+            order_by_keys(sort_keys(rest...), true);
+            return *this;
         }
 
         template<typename ... TFunc>
-        enumerable<TSource> order_by(TFunc... rest)
+        enumerable<TSource> order_by(TFunc... rest) &&
         {
-            ensure_data();
-            std::stable_sort(data.begin(), data.end(), multicmp(rest...));
+            order_by_keys(sort_keys(rest...), true);
+            return std::move(*this);
+        }
 
+        enumerable<TSource> order_by() &
+        {
+            order_by_elements(true);
             return *this;
         }
 
-        enumerable<TSource> order_by()
+        enumerable<TSource> order_by() &&
         {
-            ensure_data();
-            std::stable_sort(data.begin(), data.end());
+            order_by_elements(true);
+            return std::move(*this);
+        }
+
+        /**
+         * @brief Same as order_by(), but elements with equal keys may come out in any order,
+         * which lets the sort skip the work of keeping them in place.
+         *
+         * @param rest mappers giving the primary key, then the keys used to break ties
+         * @return the ordered sequence
+         */
+        template<typename ... TFunc>
+        enumerable<TSource> order_by_unstable(TFunc... rest) &
+        {
+            order_by_keys(sort_keys(rest...), false);
+            return *this;
+        }
+
+        template<typename ... TFunc>
+        enumerable<TSource> order_by_unstable(TFunc... rest) &&
+        {
+            order_by_keys(sort_keys(rest...), false);
+            return std::move(*this);
+        }
 
+        enumerable<TSource> order_by_unstable() &
+        {
+            order_by_elements(false);
             return *this;
         }
 
+        enumerable<TSource> order_by_unstable() &&
+        {
+            order_by_elements(false);
+            return std::move(*this);
+        }
+
     private:
 
+        template <typename TOrder>
+        void order_by_deferred(TOrder order)
+        {
+            ensure_data();
+            // An earlier order_by() decides the order of elements this one considers equal.
+            ensure_ordered();
+
+            ordered_prefix = 0;
+            pending_order = order;
+        }
+
+        template <typename TKeyOf>
+        void order_by_keys(TKeyOf key_of, bool stable)
+        {
+            size_t threads = thread_count;
+            order_by_deferred([key_of, threads, stable](vector<TElement>& elements, size_t limit, bool keep_rest)
+            {
+                order_prefix_by_keys(elements, limit, keep_rest, key_of, threads, stable);
+            });
+        }
+
+        // Numbers are ordered through their radix encoding.
+        void order_by_elements(bool stable) requires radix::encodable<TElement>
+        {
+            order_by_keys([](const TElement& x) { return x; }, stable);
+        }
+
+        void order_by_elements(bool stable)
+        {
+            size_t threads = thread_count;
+            order_by_deferred([threads, stable](vector<TElement>& elements, size_t limit, bool keep_rest)
+            {
+                order_prefix(elements, limit, keep_rest, [](const TElement& a, const TElement& b) { return a < b; }, threads, stable);
+            });
+        }
+
+        /**
+         * @brief Sorts the limit smallest elements to the front, stably if asked to. The others
+         * are dropped, or if keep_rest is set they follow in their original relative order, so
+         * that a later full stable sort still gives the same result as sorting the original.
+         * The elements are picked with a bounded heap, in O(n log limit).
+         */
+        template <typename TCompare>
+        static void order_prefix(vector<TElement>& elements, size_t limit, bool keep_rest, TCompare compare, size_t threads, bool stable)
+        {
+            size_t length = elements.size();
+            if (limit == 0)
+            {
+                if (!keep_rest) elements.clear();
+                return;
+            }
+
+            // Ties are broken by position, which keeps the selection stable.
+            auto before = [&](size_t a, size_t b)
+            {
+                if (compare(elements[a], elements[b])) return true;
+                if (compare(elements[b], elements[a])) return false;
+                return a < b;
+            };
+
+            // Once the prefix is a sizeable part of the sequence a full sort is cheaper.
+            if (limit >= length / 8)
+            {
+                size_t runs = sort_run_count(length, threads);
+                if constexpr (small_element && is_default_constructible<TElement>::value)
+                {
+                    if (runs > 1)
+                    {
+                        parallel_sort(elements, runs, compare, [&](auto first, auto last)
+                        {
+                            if (stable) std::stable_sort(first, last, compare);
+                            else std::sort(first, last, compare);
+                        });
+                        if (!keep_rest && limit < length) elements.erase(elements.begin() + limit, elements.end());
+                        return;
+                    }
+                }
+                else if (runs > 1)
+                {
+                    // Elements are not necessarily default constructible, and may be costly to
+                    // move, so their positions are sorted and merged instead.
+                    vector<size_t> order(length);
+                    for (size_t i = 0; i < length; i++) order[i] = i;
+                    parallel_sort(order, runs, before, [&](auto first, auto last) { std::sort(first, last, before); });
+                    if (!keep_rest) order.resize(std::min(limit, length));
+                    permute(elements, order, keep_rest);
+                    return;
+                }
+
+                if (stable) std::stable_sort(elements.begin(), elements.end(), compare);
+                else std::sort(elements.begin(), elements.end(), compare);
+                if (!keep_rest && limit < length) elements.erase(elements.begin() + limit, elements.end());
+                return;
+            }
+
+            if (!stable && !keep_rest)
+            {
+                std::partial_sort(elements.begin(), elements.begin() + limit, elements.end(), compare);
+                elements.erase(elements.begin() + limit, elements.end());
+                return;
+            }
+
+            vector<size_t> heap;
+            heap.reserve(limit);
+            for (size_t i = 0; i < length; i++)
+            {
+                if (heap.size() < limit)
+                {
+                    heap.push_back(i);
+                    std::push_heap(heap.begin(), heap.end(), before);
+                }
+                else if (before(i, heap.front()))
+                {
+                    std::pop_heap(heap.begin(), heap.end(), before);
+                    heap.back() = i;
+                    std::push_heap(heap.begin(), heap.end(), before);
+                }
+            }
+            std::sort_heap(heap.begin(), heap.end(), before);
+            permute(elements, heap, keep_rest);
+        }
+
+        /**
+         * @brief Moves the elements at the given indices to the front, in that order. The
+         * others are dropped, or if keep_rest is set they follow in their original order.
+         */
+        static void permute(vector<TElement>& elements, const vector<size_t>& order, bool keep_rest)
+        {
+            size_t length = elements.size();
+            vector<TElement> ordered;
+            ordered.reserve(keep_rest ? length : order.size());
+            for (size_t i : order) ordered.push_back(std::move(elements[i]));
+            if (keep_rest && order.size() < length)
+            {
+                vector<bool> taken(length);
+                for (size_t i : order) taken[i] = true;
+                for (size_t i = 0; i < length; i++)
+                {
+                    if (!taken[i]) ordered.push_back(std::move(elements[i]));
+                }
+            }
+            elements = std::move(ordered);
+        }
+
+        /**
+         * @brief Elements that own no memory and are no bigger than a (key, index) pair, which
+         * are moved as cheaply as the pair would be. They are sorted directly rather than
+         * through their positions.
+         */
+        static constexpr bool small_element = is_trivially_destructible<TElement>::value && sizeof(TElement) <= 2 * sizeof(size_t);
+
+        /**
+         * @brief Same as order_prefix(), but each element's keys are computed once up front and
+         * (keys, index) pairs are sorted in place of the elements. Mappers run n times rather
+         * than twice per comparison, and each element is moved exactly once.
+         *
+         * Small elements with keys that own no memory, such as numbers or members of plain
+         * structs, are cheaper to sort directly on their keys, so they go to order_prefix().
+         */
+        template <typename TKeyOf, typename TKey = typename result_of<TKeyOf(const TElement&)>::type>
+        static void order_prefix_by_keys(vector<TElement>& elements, size_t limit, bool keep_rest, TKeyOf key_of, size_t threads, bool stable)
+        {
+            if constexpr (small_element && is_trivially_destructible<TKey>::value)
+            {
+                auto compare = [&key_of](const TElement& a, const TElement& b) { return key_of(a) < key_of(b); };
+                return order_prefix(elements, limit, keep_rest, compare, threads, stable);
+            }
+
+            size_t length = elements.size();
+            if (limit == 0 || length == 0)
+            {
+                if (!keep_rest) elements.clear();
+                return;
+            }
+            limit = std::min(limit, length);
+
+            permute(elements, sorted_prefix(elements, limit, key_of, threads, stable), keep_rest);
+        }
+
+        /**
+         * @brief Indices of the limit smallest elements by key, in order.
+         */
+        template <typename TKeyOf, typename TKey = typename result_of<TKeyOf(const TElement&)>::type>
+        static vector<size_t> sorted_prefix(const vector<TElement>& elements, size_t limit, TKeyOf key_of, size_t threads, bool stable)
+        {
+            return compare_sorted_prefix(elements, limit, key_of, threads, stable);
+        }
+
+        /**
+         * @brief Indices of the limit smallest elements by key, in order, found by sorting
+         * (keys, index) pairs. An unstable sort compares the keys alone.
+         */
+        template <typename TKeyOf>
+        static vector<size_t> compare_sorted_prefix(const vector<TElement>& elements, size_t limit, TKeyOf key_of, size_t threads, bool stable)
+        {
+            size_t length = elements.size();
+            using decorated_key = pair<decltype(key_of(elements[0])), size_t>;
+            vector<decorated_key> decorated;
+            decorated.reserve(length);
+            for (size_t i = 0; i < length; i++) decorated.emplace_back(key_of(elements[i]), i);
+
+            auto by_key = [](const decorated_key& a, const decorated_key& b) { return a.first < b.first; };
+
+            // Pairs compare by index after the keys, which makes both sorts stable. partial_sort
+            // is heap based, so it only pays off while the prefix stays small.
+            if (limit < length / 8)
+            {
+                if (stable) std::partial_sort(decorated.begin(), decorated.begin() + limit, decorated.end());
+                else std::partial_sort(decorated.begin(), decorated.begin() + limit, decorated.end(), by_key);
+            }
+            else if (stable)
+            {
+                parallel_sort(decorated, sort_run_count(length, threads), std::less<decorated_key>(), [](auto first, auto last) { std::sort(first, last); });
+            }
+            else
+            {
+                parallel_sort(decorated, sort_run_count(length, threads), by_key, [&](auto first, auto last) { std::sort(first, last, by_key); });
+            }
+
+            vector<size_t> order(limit);
+            for (size_t i = 0; i < limit; i++) order[i] = decorated[i].second;
+            return order;
+        }
+
+        /**
+         * @brief Keys made of integers and floating point numbers are radix sorted when the
+         * whole sequence, or most of it, has to be ordered. Radix sort is stable at no extra
+         * cost, so it serves unstable sorts as well.
+         */
+        template <typename TKeyOf, typename TKey = typename result_of<TKeyOf(const TElement&)>::type>
+        requires radix::sortable<TKey>
+        static vector<size_t> sorted_prefix(const vector<TElement>& elements, size_t limit, TKeyOf key_of, size_t threads, bool stable)
+        {
+            size_t length = elements.size();
+            if (limit < length / 8 || length < radix::threshold) return compare_sorted_prefix(elements, limit, key_of, threads, stable);
+
+            using encoded_key = pair<array<uint8_t, radix::width<TKey>>, size_t>;
+            vector<encoded_key> encoded(length);
+            size_t runs = sort_run_count(length, threads);
+            auto encode = [&](size_t chunk_begin, size_t chunk_end, size_t)
+            {
+                for (size_t i = chunk_begin; i < chunk_end; i++)
+                {
+                    radix::encode(key_of(elements[i]), encoded[i].first.data());
+                    encoded[i].second = i;
+                }
+            };
+            if (runs > 1) parallel_chunks(length, runs, encode);
+            else encode(0, length, 0);
+
+            // Indices are unique, so comparing whole pairs merges the runs stably.
+            parallel_sort(encoded, runs, std::less<encoded_key>(), [](auto first, auto last)
+            {
+                radix::sort(std::addressof(*first), std::addressof(*first) + (last - first));
+            });
+
+            vector<size_t> order(limit);
+            for (size_t i = 0; i < limit; i++) order[i] = encoded[i].second;
+            return order;
+        }
+
         /**
-         * @brief Constructs a comparison function suitable for std::sort from the given mappers
-         * @param first The first mapper to use for comparison
-         * @param rest The other mappers
-         * @return Lambda that compares first by the return value of the first mapper, then the rest.
+         * @brief Constructs a function returning the keys order_by() sorts on, as a tuple
+         * whose lexicographic order is the sort order.
+         * @param first The mapper giving the primary key
+         * @param rest The mappers giving the keys that break ties, in order
+         * @return Lambda that maps an element to the tuple of its keys.
          */
-        template<typename ... TFunc,
-                 typename TFirst = typename std::tuple_element<0, std::tuple<TFunc...>>::type,
+        template<typename TFirst, typename TSecond, typename ... TFunc,
                  typename TReturn = typename result_of<TFirst(TElement)>::type>
         requires Invokable<TFirst, TElement>() && Totally_ordered<TReturn>()
-        auto multicmp(TFirst first, TFunc... rest)
+        auto sort_keys(TFirst first, TSecond second, TFunc... rest)
         {
-            return [=](const TElement& a, const TElement& b) -> bool
+            auto rest_keys = sort_keys(second, rest...);
+            return [=](const TElement& x)
             {
-                auto a_map = first(a);
-                auto b_map = first(b);
-                if (a_map == b_map) return multicmp(rest...)(a, b);
-                else return a_map < b_map;
+                return tuple_cat(make_tuple(first(x)), rest_keys(x));
             };
         }
 
         template<typename TFirst, typename TReturn = typename result_of<TFirst(TElement)>::type>
         requires Invokable<TFirst, TElement>() && Totally_ordered<TReturn>()
-        auto multicmp(TFirst first)
+        auto sort_keys(TFirst first)
         {
-            return [=](const TElement& a, const TElement& b) -> bool
+            return [=](const TElement& x)
             {
-                return first(a) < first(b);
+                return make_tuple(first(x));
             };
         }
 
@@ -930,11 +2420,131 @@ namespace cinq
             is_data_copied = true;
         }
 
+        /**
+         * @brief Applies the order from a pending order_by() to the whole sequence.
+         */
+        void ensure_ordered()
+        {
+            if (!pending_order) return;
+            pending_order(data, data.size(), true);
+            pending_order = nullptr;
+        }
+
+        /**
+         * @brief Makes sure at least the first limit elements are in the order of a pending
+         * order_by(), leaving the rest of the sort pending.
+         */
+        void ensure_ordered(size_t limit)
+        {
+            if (!pending_order || limit <= ordered_prefix) return;
+            if (limit >= data.size()) return ensure_ordered();
+
+            pending_order(data, limit, true);
+            ordered_prefix = limit;
+        }
+
+        /**
+         * @brief sorts data when called with a prefix length, and whether to keep the
+         * elements after it. Set by order_by() and cleared once the sort is applied.
+         */
+        function<void(vector<TElement>&, size_t, bool)> pending_order;
+
+        /**
+         * @brief number of leading elements pending_order has already sorted.
+         */
+        size_t ordered_prefix = 0;
+
         inline void ensure_nonempty()
         {
             if (empty()) throw length_error("cinq: sequence is empty");
         }
 
+        /**
+         * @brief number of threads parallel methods may use. 1 unless
+         * the query was made parallel.
+         */
+        size_t thread_count;
+
+        /**
+         * @brief number of chunks a sequence of the given length
+         * should be split into, at most one per thread.
+         */
+        size_t chunk_count(size_t length) const
+        {
+            if (thread_count <= 1) return 1;
+            return std::max<size_t>(1, std::min(thread_count, length / parallel_grain));
+        }
+
+        /**
+         * @brief Calls chunk(chunk_begin, chunk_end) on each chunk of the sequence and folds the
+         * partial results, in order, with combine. Sequences that cannot be split are
+         * handed to chunk whole.
+         */
+        template <typename TIterator, typename TChunk, typename TCombine>
+        auto reduce_chunks(TIterator seq_begin, TIterator seq_end, TChunk chunk, TCombine combine)
+        {
+            return chunk(seq_begin, seq_end);
+        }
+
+        template <typename TIterator, typename TChunk, typename TCombine>
+        requires Random_access_iterator<TIterator>()
+        auto reduce_chunks(TIterator seq_begin, TIterator seq_end, TChunk chunk, TCombine combine)
+        {
+            size_t length = seq_end - seq_begin;
+            size_t chunks = chunk_count(length);
+            if (chunks == 1) return chunk(seq_begin, seq_end);
+
+            vector<optional<decltype(chunk(seq_begin, seq_end))>> partial(chunks);
+            parallel_chunks(length, chunks, [&](size_t first, size_t last, size_t index)
+            {
+                partial[index] = chunk(seq_begin + first, seq_begin + last);
+            });
+
+            auto result = *partial[0];
+            for (size_t i = 1; i < chunks; i++) result = combine(result, *partial[i]);
+            return result;
+        }
+
+        /**
+         * @brief Calls fill(chunk_begin, chunk_end, offset, out) on each chunk of the sequence,
+         * where offset is the index of the chunk's first element, and concatenates what
+         * each call appended to out in the original order.
+         */
+        template <typename TOut, typename TIterator, typename TFill>
+        vector<TOut> fill_chunks(TIterator seq_begin, TIterator seq_end, TFill fill)
+        {
+            vector<TOut> result;
+            fill(seq_begin, seq_end, 0, result);
+            return result;
+        }
+
+        template <typename TOut, typename TIterator, typename TFill>
+        requires Random_access_iterator<TIterator>()
+        vector<TOut> fill_chunks(TIterator seq_begin, TIterator seq_end, TFill fill)
+        {
+            size_t length = seq_end - seq_begin;
+            size_t chunks = chunk_count(length);
+
+            vector<TOut> result;
+            if (chunks == 1)
+            {
+                fill(seq_begin, seq_end, 0, result);
+                return result;
+            }
+
+            vector<vector<TOut>> parts(chunks);
+            parallel_chunks(length, chunks, [&](size_t first, size_t last, size_t index)
+            {
+                fill(seq_begin + first, seq_begin + last, first, parts[index]);
+            });
+
+            size_t total = 0;
+            for (auto& part : parts) total += part.size();
+            result.reserve(total);
+            for (auto& part : parts) result.insert(result.end(), make_move_iterator(part.begin()), make_move_iterator(part.end()));
+            return result;
+        }
+
     // Allow automated tests to access private stuff.
     friend class test;
 
@@ -955,6 +2565,29 @@ namespace cinq
         return e;
     }
 
+    /**
+     * @brief Convenience method for constructing enumerable objects whose queries run in parallel.
+     *
+     * @param source the container passed in by the user for processing
+     * @param policy cinq::par, or cinq::par(n) to limit the query to n threads
+     * @return constructs a type enumerable from the container
+     */
+    template <typename T>
+    requires Range<T>()
+    auto from(T& source, parallel_policy policy)
+    {
+        enumerable<T> e(source, policy);
+        return e;
+    }
+
 }
 
+#include "cinq_lazy.hpp"
+#include "cinq_late.hpp"
+#include "cinq_batch.hpp"
+#include "cinq_plan.hpp"
+#include "cinq_csv.hpp"
+#include "cinq_columns.hpp"
+#include "cinq_snapshot.hpp"
+
 #endif
@@ -0,0 +1,358 @@
+#ifndef __cinq_expression_hpp__
+#define __cinq_expression_hpp__
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "cinq_simd.hpp"
+
+// Expressions: predicates and mappers written with cinq::field() or cinq::element instead
+// of a lambda,
+//
+//     auto hot_and_rainy = cinq::field(&weather_point::temp_max) > 90 && cinq::field(&weather_point::rain);
+//     size_t days = cinq::from(weather).where(hot_and_rainy).count();
+//
+// An expression is a tree of small objects. It can be called on an element like the lambda
+// it replaces, so every method that takes a predicate or a mapper takes it too. The tree
+// also stays open to the library: each node tells which members it reads, which numbers
+// it holds and which operation it applies. Over columns, for instance, a comparison of a
+// member with a number runs the vectorized filter kernels on that member's array, and
+// other expressions read only the arrays of the members they name. cinq::element stands
+// for the element itself, so that where(cinq::element > 50.0) runs the same kernels over
+// a sequence of numbers.
+
+namespace cinq
+{
+    namespace expressions
+    {
+        using namespace std;
+
+        template <typename T>
+        struct is_expression : false_type {};
+
+        /**
+         * @brief The nodes of an expression tree: element, field, constant, unary and binary.
+         */
+        template <typename T>
+        concept bool Expression()
+        {
+            return is_expression<typename decay<T>::type>::value;
+        }
+
+        /**
+         * @brief true for the operations which compare two values, the ones the filter
+         * kernels run.
+         */
+        template <typename TOp>
+        constexpr bool is_comparison = is_same<TOp, less<>>::value || is_same<TOp, less_equal<>>::value
+                                    || is_same<TOp, greater<>>::value || is_same<TOp, greater_equal<>>::value
+                                    || is_same<TOp, equal_to<>>::value || is_same<TOp, not_equal_to<>>::value;
+
+        /**
+         * @brief The comparison which holds for b op' a whenever a op b holds, so that a
+         * number on the left can be moved to the right.
+         */
+        template <typename TOp> struct flipped { using type = TOp; };
+        template <> struct flipped<less<>> { using type = greater<>; };
+        template <> struct flipped<less_equal<>> { using type = greater_equal<>; };
+        template <> struct flipped<greater<>> { using type = less<>; };
+        template <> struct flipped<greater_equal<>> { using type = less_equal<>; };
+
+        /**
+         * @brief The element itself.
+         */
+        struct element
+        {
+            template <typename TElement>
+            const TElement& operator()(const TElement& value) const
+            {
+                return value;
+            }
+
+            template <typename TFunc>
+            void for_each_field(TFunc) const
+            {
+            }
+        };
+
+        /**
+         * @brief Reads a data member of the element.
+         */
+        template <typename TRecord, typename TField>
+        struct field
+        {
+            using record_type = TRecord;
+            using value_type = TField;
+
+            TField TRecord::* member;
+
+            TField operator()(const TRecord& record) const
+            {
+                return record.*member;
+            }
+
+            template <typename TFunc>
+            void for_each_field(TFunc func) const
+            {
+                func(member);
+            }
+
+            /**
+             * @brief The same expression evaluated on a row of a column_table, reading the
+             * member's array only.
+             */
+            template <typename TTable>
+            auto bind(const TTable& table) const
+            {
+                const TField* values = table.column(member).begin();
+                return [values](size_t row) { return values[row]; };
+            }
+        };
+
+        /**
+         * @brief A number written in the expression.
+         */
+        template <typename T>
+        struct constant
+        {
+            using value_type = T;
+
+            T value;
+
+            template <typename TElement>
+            T operator()(const TElement&) const
+            {
+                return value;
+            }
+
+            template <typename TFunc>
+            void for_each_field(TFunc) const
+            {
+            }
+
+            template <typename TTable>
+            auto bind(const TTable&) const
+            {
+                T held = value;
+                return [held](size_t) { return held; };
+            }
+
+            /**
+             * @brief Converts the number to the element type of a filter kernel, if the
+             * kernel then compares every element as the expression would. This holds when
+             * the types are the same, or when the elements are floating point and the
+             * number converts exactly.
+             */
+            template <typename TElement>
+            bool bound_as(TElement& converted) const
+            {
+                if (is_same<TElement, T>::value)
+                {
+                    converted = (TElement)value;
+                    return true;
+                }
+                if (!is_floating_point<TElement>::value || !simd::vectorizable_type<T>) return false;
+
+                // A double holds every int, float and double exactly, so it tells if converting lost anything.
+                converted = (TElement)value;
+                return (double)converted == (double)value;
+            }
+        };
+
+        /**
+         * @brief An operation on one expression, such as !field(&weather_point::rain).
+         */
+        template <typename TOp, typename TOperand>
+        struct unary
+        {
+            using operation = TOp;
+
+            TOperand operand;
+
+            template <typename TElement>
+            auto operator()(const TElement& element) const
+            {
+                return TOp()(operand(element));
+            }
+
+            template <typename TFunc>
+            void for_each_field(TFunc func) const
+            {
+                operand.for_each_field(func);
+            }
+
+            template <typename TTable>
+            auto bind(const TTable& table) const
+            {
+                return [operand = operand.bind(table)](size_t row) { return TOp()(operand(row)); };
+            }
+        };
+
+        /**
+         * @brief An operation on two expressions: a comparison, arithmetic, && or ||. The
+         * last two skip the right side when the left one decides the result, as in C++.
+         */
+        template <typename TOp, typename TLeft, typename TRight>
+        struct binary
+        {
+            using operation = TOp;
+
+            TLeft left;
+            TRight right;
+
+            template <typename TElement>
+            auto operator()(const TElement& element) const
+            {
+                return apply(left, right, element);
+            }
+
+            template <typename TFunc>
+            void for_each_field(TFunc func) const
+            {
+                left.for_each_field(func);
+                right.for_each_field(func);
+            }
+
+            template <typename TTable>
+            auto bind(const TTable& table) const
+            {
+                return [left = left.bind(table), right = right.bind(table)](size_t row) { return apply(left, right, row); };
+            }
+
+        private:
+            template <typename TL, typename TR, typename TArg>
+            static auto apply(const TL& left, const TR& right, const TArg& arg)
+            {
+                if constexpr (is_same<TOp, logical_and<>>::value) return left(arg) && right(arg);
+                else if constexpr (is_same<TOp, logical_or<>>::value) return left(arg) || right(arg);
+                else return TOp()(left(arg), right(arg));
+            }
+        };
+
+        template <>
+        struct is_expression<element> : true_type {};
+
+        template <typename TRecord, typename TField>
+        struct is_expression<field<TRecord, TField>> : true_type {};
+
+        template <typename T>
+        struct is_expression<constant<T>> : true_type {};
+
+        template <typename TOp, typename TOperand>
+        struct is_expression<unary<TOp, TOperand>> : true_type {};
+
+        template <typename TOp, typename TLeft, typename TRight>
+        struct is_expression<binary<TOp, TLeft, TRight>> : true_type {};
+
+        // Numbers written next to an expression become constants.
+        template <typename T>
+        requires Expression<T>()
+        const T& node(const T& expression)
+        {
+            return expression;
+        }
+
+        template <typename T>
+        requires is_arithmetic<T>::value
+        constant<T> node(const T& value)
+        {
+            return constant<T> { value };
+        }
+
+        // Operators apply when one side is an expression and the other an expression or a number.
+        template <typename TLeft, typename TRight>
+        concept bool Operands()
+        {
+            return (Expression<TLeft>() && (Expression<TRight>() || is_arithmetic<TRight>::value))
+                || (is_arithmetic<TLeft>::value && Expression<TRight>());
+        }
+
+        /**
+         * @brief A comparison of the element with a number, such as element > 90, which
+         * where() runs with the vectorized filter kernels over int, float or double elements.
+         */
+        template <typename TOp, typename T>
+        using element_comparison = binary<TOp, element, constant<T>>;
+
+        // A number compared with the element moves to the right, so that 50 < element is
+        // the element_comparison element > 50.
+        template <typename TOp, typename TLeft, typename TRight>
+        auto make_binary(const TLeft& left, const TRight& right)
+        {
+            if constexpr (is_comparison<TOp> && is_arithmetic<TLeft>::value && is_same<TRight, element>::value)
+            {
+                return make_binary<typename flipped<TOp>::type>(right, left);
+            }
+            else
+            {
+                using TL = decltype(node(left));
+                using TR = decltype(node(right));
+                return binary<TOp, typename decay<TL>::type, typename decay<TR>::type> { node(left), node(right) };
+            }
+        }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator<(const TLeft& left, const TRight& right) { return make_binary<less<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator<=(const TLeft& left, const TRight& right) { return make_binary<less_equal<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator>(const TLeft& left, const TRight& right) { return make_binary<greater<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator>=(const TLeft& left, const TRight& right) { return make_binary<greater_equal<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator==(const TLeft& left, const TRight& right) { return make_binary<equal_to<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator!=(const TLeft& left, const TRight& right) { return make_binary<not_equal_to<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator+(const TLeft& left, const TRight& right) { return make_binary<plus<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator-(const TLeft& left, const TRight& right) { return make_binary<minus<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator*(const TLeft& left, const TRight& right) { return make_binary<multiplies<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator/(const TLeft& left, const TRight& right) { return make_binary<divides<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator&&(const TLeft& left, const TRight& right) { return make_binary<logical_and<>>(left, right); }
+
+        template <typename TLeft, typename TRight> requires Operands<TLeft, TRight>()
+        auto operator||(const TLeft& left, const TRight& right) { return make_binary<logical_or<>>(left, right); }
+
+        template <typename TOperand> requires Expression<TOperand>()
+        unary<logical_not<>, TOperand> operator!(const TOperand& operand) { return { operand }; }
+
+        template <typename TOperand> requires Expression<TOperand>()
+        unary<negate<>, TOperand> operator-(const TOperand& operand) { return { operand }; }
+    }
+
+    /**
+     * @brief An expression reading a data member of the element, to be compared and combined
+     * with numbers and other expressions into a predicate or a mapper.
+     *
+     * @param member pointer to the data member
+     */
+    template <typename TRecord, typename TField>
+    expressions::field<TRecord, TField> field(TField TRecord::* member)
+    {
+        return expressions::field<TRecord, TField> { member };
+    }
+
+    /**
+     * @brief Stands for the element a predicate or a mapper is given: cinq::element < 10 is
+     * a predicate which holds for elements below 10, and cinq::element * 2 a mapper.
+     */
+    constexpr expressions::element element {};
+}
+
+#endif
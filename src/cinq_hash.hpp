@@ -0,0 +1,341 @@
+#ifndef __cinq_hash_hpp__
+#define __cinq_hash_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "cinq_parallel.hpp"
+
+// Open-addressing hash table used by group_by(), join(), distinct() and the set operators.
+// Entries are stored next to each other in the order their keys were first inserted, and a
+// separate array of slots maps hashes to entries with linear probing. A slot keeps the full
+// hash of its key, so probing compares keys only when the hashes match and growing the table
+// never hashes a key again.
+//
+// Parallel queries build one table per chunk of the sequence and merge them with
+// merge_tables(). join() indexes one of its sides with a flat_hash_index.
+
+namespace cinq
+{
+    using namespace std;
+
+    /**
+     * @brief Pass to group_by() to size its table for about this many groups up front.
+     */
+    struct expected_groups
+    {
+        size_t count;
+    };
+
+    template <typename TKey, typename TValue, typename THash = hash<TKey>, typename TEqual = equal_to<TKey>>
+    class flat_hash_map
+    {
+    public:
+        /**
+         * @brief Creates an empty table with room for the given number of keys.
+         *
+         * @param expected number of keys expected, 0 if unknown
+         */
+        explicit flat_hash_map(size_t expected = 0, THash hasher = THash(), TEqual equal = TEqual())
+            : hasher(hasher), equal(equal)
+        {
+            reserve(expected);
+        }
+
+        /**
+         * @brief Makes room for count keys without the table growing again.
+         */
+        void reserve(size_t count)
+        {
+            entries.reserve(count);
+            size_t capacity = 16;
+            while (capacity / 2 < count) capacity *= 2;
+            if (capacity > slots.size()) rehash(capacity);
+        }
+
+        /**
+         * @brief The value stored for key, default constructed on first use.
+         */
+        TValue& operator[](const TKey& key)
+        {
+            size_t hash = hash_of(key);
+            if (TValue* value = find(hash, key)) return *value;
+            return add(hash, key, TValue());
+        }
+
+        /**
+         * @brief The value stored for key, or nullptr if there is none.
+         */
+        TValue* find(const TKey& key)
+        {
+            return find(hash_of(key), key);
+        }
+
+        /**
+         * @brief Same as find(key), for a key whose hash_of() is already known.
+         */
+        TValue* find(size_t hash, const TKey& key)
+        {
+            for (size_t index = slot_of(hash); slots[index].entry != empty; index = (index + 1) & mask)
+            {
+                const slot& current = slots[index];
+                if (current.hash == hash && equal(entries[current.entry].first, key)) return &entries[current.entry].second;
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Stores a value for a key which is not in the table yet.
+         *
+         * @param hash hash_of(key)
+         */
+        template <typename K, typename V>
+        TValue& add(size_t hash, K&& key, V&& value)
+        {
+            if ((entries.size() + 1) * 2 > slots.size()) rehash(slots.size() * 2);
+
+            size_t index = slot_of(hash);
+            while (slots[index].entry != empty) index = (index + 1) & mask;
+            slots[index] = slot { hash, entries.size() };
+            entries.emplace_back(std::forward<K>(key), std::forward<V>(value));
+            return entries.back().second;
+        }
+
+        /**
+         * @brief The hash the table files a key under.
+         */
+        size_t hash_of(const TKey& key) const
+        {
+            return mix(hasher(key));
+        }
+
+        size_t size() const
+        {
+            return entries.size();
+        }
+
+        /**
+         * @brief The (key, value) pairs, in the order the keys were first inserted.
+         */
+        vector<pair<TKey, TValue>>& items()
+        {
+            return entries;
+        }
+
+    private:
+        static constexpr size_t empty = SIZE_MAX;
+
+        struct slot
+        {
+            size_t hash;
+            size_t entry;
+        };
+
+        // Standard hashes of integers are the integers themselves, which would pile keys
+        // with the same low bits into one run of slots. Fibonacci hashing spreads them, and
+        // the slot is then taken from the high bits.
+        static size_t mix(size_t hash)
+        {
+            return hash * (size_t)0x9E3779B97F4A7C15ull;
+        }
+
+        size_t slot_of(size_t hash) const
+        {
+            return hash >> shift;
+        }
+
+        void rehash(size_t capacity)
+        {
+            vector<slot> old(capacity, slot { 0, empty });
+            old.swap(slots);
+            mask = capacity - 1;
+            shift = sizeof(size_t) * 8;
+            for (size_t c = capacity; c > 1; c /= 2) shift--;
+
+            for (const slot& moved : old)
+            {
+                if (moved.entry == empty) continue;
+                size_t index = slot_of(moved.hash);
+                while (slots[index].entry != empty) index = (index + 1) & mask;
+                slots[index] = moved;
+            }
+        }
+
+        vector<slot> slots;
+        vector<pair<TKey, TValue>> entries;
+        size_t mask = 0;
+        size_t shift = sizeof(size_t) * 8;
+        THash hasher;
+        TEqual equal;
+    };
+
+    /**
+     * @brief A set of keys on the same table as flat_hash_map. Used by distinct() and the
+     * set operators.
+     */
+    template <typename TKey, typename THash = hash<TKey>, typename TEqual = equal_to<TKey>>
+    class flat_hash_set
+    {
+    public:
+        explicit flat_hash_set(size_t expected = 0) : keys(expected)
+        {
+        }
+
+        /**
+         * @brief Adds a key, and returns true if it was not in the set yet.
+         */
+        bool insert(const TKey& key)
+        {
+            size_t hash = keys.hash_of(key);
+            if (keys.find(hash, key)) return false;
+            keys.add(hash, key, true);
+            return true;
+        }
+
+        bool contains(const TKey& key)
+        {
+            return keys.find(key) != nullptr;
+        }
+
+    private:
+        flat_hash_map<TKey, bool, THash, TEqual> keys;
+    };
+
+    /**
+     * @brief Maps each key to the positions of the elements of a sequence which have it, in
+     * increasing order. Used by join() on the side built into a table. The positions of
+     * all keys share one array, with each key's positions next to each other.
+     */
+    template <typename TKey, typename THash = hash<TKey>, typename TEqual = equal_to<TKey>>
+    class flat_hash_index
+    {
+    public:
+        /**
+         * @brief Indexes the elements of a random access sequence by key_of(element).
+         */
+        template <typename TIterator, typename TKeyOf>
+        flat_hash_index(TIterator first, TIterator last, TKeyOf key_of)
+        {
+            size_t length = last - first;
+            vector<size_t> group_of(length);
+            for (size_t i = 0; i < length; i++)
+            {
+                // Groups are numbered in the order their keys are first seen.
+                size_t known = groups.size();
+                size_t& group = groups[key_of(first[i])];
+                if (groups.size() != known) group = known;
+                group_of[i] = group;
+            }
+
+            starts.assign(groups.size() + 1, 0);
+            for (size_t group : group_of) starts[group + 1]++;
+            for (size_t g = 0; g < groups.size(); g++) starts[g + 1] += starts[g];
+
+            positions.resize(length);
+            vector<size_t> next(starts.begin(), starts.end() - 1);
+            for (size_t i = 0; i < length; i++) positions[next[group_of[i]]++] = i;
+        }
+
+        /**
+         * @brief The positions of the elements with the given key, as a [first, last) range
+         * which is empty if there are none.
+         */
+        pair<const size_t*, const size_t*> find(const TKey& key)
+        {
+            const size_t* group = groups.find(key);
+            if (!group) return make_pair(nullptr, nullptr);
+            return make_pair(positions.data() + starts[*group], positions.data() + starts[*group + 1]);
+        }
+
+    private:
+        flat_hash_map<TKey, size_t, THash, TEqual> groups;
+        vector<size_t> starts;
+        vector<size_t> positions;
+    };
+
+    /**
+     * @brief Merges tables built from consecutive chunks of a sequence into the (key, value)
+     * pairs of them all, with keys in the order they first appear. merge(into, from) folds
+     * a later chunk's value for a key into an earlier one's. The tables are left in a
+     * moved-from state.
+     *
+     * Keys are split into as many partitions as there are tables by their hash, and each
+     * partition is merged on its own thread.
+     */
+    template <typename TKey, typename TValue, typename THash, typename TEqual, typename TMerge>
+    vector<pair<TKey, TValue>> merge_tables(vector<flat_hash_map<TKey, TValue, THash, TEqual>>& tables, TMerge merge)
+    {
+        size_t chunks = tables.size();
+        size_t parts = chunks;
+
+        // Entries are numbered in the order of the sequence: the entries of the first
+        // chunk's table, then those of the second...
+        vector<size_t> offsets(chunks + 1, 0);
+        for (size_t c = 0; c < chunks; c++) offsets[c + 1] = offsets[c] + tables[c].size();
+
+        // routed[c][p] lists the (entry, hash) pairs of table c in partition p. The middle bits
+        // of the hash pick the partition, as the high bits pick the slot inside a table.
+        vector<vector<vector<pair<size_t, size_t>>>> routed(chunks, vector<vector<pair<size_t, size_t>>>(parts));
+        parallel_chunks(chunks, chunks, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t c = first; c < last; c++)
+            {
+                auto& items = tables[c].items();
+                for (size_t i = 0; i < items.size(); i++)
+                {
+                    size_t hash = tables[c].hash_of(items[i].first);
+                    routed[c][(hash >> (sizeof(size_t) * 4)) % parts].emplace_back(i, hash);
+                }
+            }
+        });
+
+        vector<flat_hash_map<TKey, TValue, THash, TEqual>> merged(parts);
+        vector<vector<size_t>> first_seen(parts);
+        parallel_chunks(parts, parts, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t p = first; p < last; p++)
+            {
+                for (size_t c = 0; c < chunks; c++)
+                {
+                    auto& items = tables[c].items();
+                    for (auto& entry : routed[c][p])
+                    {
+                        auto& item = items[entry.first];
+                        if (TValue* value = merged[p].find(entry.second, item.first))
+                        {
+                            merge(*value, std::move(item.second));
+                        }
+                        else
+                        {
+                            merged[p].add(entry.second, std::move(item.first), std::move(item.second));
+                            first_seen[p].push_back(offsets[c] + entry.first);
+                        }
+                    }
+                }
+            }
+        });
+
+        // Walking the sequence numbers in order puts every key where it first appeared.
+        constexpr size_t none = SIZE_MAX;
+        vector<pair<size_t, size_t>> at(offsets[chunks], make_pair(none, (size_t)0));
+        size_t groups = 0;
+        for (size_t p = 0; p < parts; p++)
+        {
+            for (size_t j = 0; j < first_seen[p].size(); j++) at[first_seen[p][j]] = make_pair(p, j);
+            groups += first_seen[p].size();
+        }
+
+        vector<pair<TKey, TValue>> result;
+        result.reserve(groups);
+        for (auto& position : at)
+        {
+            if (position.first != none) result.push_back(std::move(merged[position.first].items()[position.second]));
+        }
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef __cinq_late_hpp__
+#define __cinq_late_hpp__
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "cinq_enumerable.hpp"
+#include "cinq_lazy.hpp"
+
+// Late materialization: after late(), where() keeps the positions of the matching elements
+// in the source instead of copies of them, and the rest of the query reads the elements
+// through those positions. Each element a query keeps is read where it lies, once per
+// method, and copied only by to_vector() and the methods that have to reorder the sequence.
+//
+//     auto snowy_lows = cinq::from(weather).late()
+//                                          .where([](const weather_point& w) { return w.snow; })
+//                                          .select(&weather_point::temp_min)
+//                                          .to_vector();
+
+namespace cinq
+{
+    using namespace std;
+    using namespace origin;
+
+    /**
+     * @brief Random access iterator over the elements of a sequence at the positions listed
+     * in a selection, or over all of them if there is none. Dereferencing gives the source's
+     * own reference, so elements are not copied. The iterators share the selection, so it
+     * lives as long as any copy of the enumerable reading it.
+     */
+    template <typename TIter>
+    class selection_iterator
+    {
+    public:
+        using iterator_category = random_access_iterator_tag;
+        using value_type = typename iterator_traits<TIter>::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = typename iterator_traits<TIter>::pointer;
+        using reference = typename iterator_traits<TIter>::reference;
+
+        selection_iterator() = default;
+
+        selection_iterator(TIter first, shared_ptr<const vector<size_t>> rows, size_t position)
+            : first(first), rows(std::move(rows)), position(position)
+        {
+        }
+
+        /**
+         * @brief The position in the source of the element the iterator is on.
+         */
+        size_t row() const
+        {
+            return rows ? (*rows)[position] : position;
+        }
+
+        reference operator*() const { return first[row()]; }
+        reference operator[](difference_type n) const { return *(*this + n); }
+
+        selection_iterator& operator++() { position++; return *this; }
+        selection_iterator& operator--() { position--; return *this; }
+        selection_iterator operator++(int) { selection_iterator old = *this; position++; return old; }
+        selection_iterator operator--(int) { selection_iterator old = *this; position--; return old; }
+        selection_iterator& operator+=(difference_type n) { position += n; return *this; }
+        selection_iterator& operator-=(difference_type n) { position -= n; return *this; }
+        selection_iterator operator+(difference_type n) const { return selection_iterator(first, rows, position + n); }
+        selection_iterator operator-(difference_type n) const { return selection_iterator(first, rows, position - n); }
+        friend selection_iterator operator+(difference_type n, const selection_iterator& i) { return i + n; }
+        difference_type operator-(const selection_iterator& other) const { return (difference_type)position - (difference_type)other.position; }
+
+        bool operator==(const selection_iterator& other) const { return position == other.position; }
+        bool operator!=(const selection_iterator& other) const { return position != other.position; }
+        bool operator<(const selection_iterator& other) const { return position < other.position; }
+        bool operator>(const selection_iterator& other) const { return position > other.position; }
+        bool operator<=(const selection_iterator& other) const { return position <= other.position; }
+        bool operator>=(const selection_iterator& other) const { return position >= other.position; }
+
+    private:
+        TIter first;
+        shared_ptr<const vector<size_t>> rows;
+        size_t position = 0;
+    };
+
+    /**
+     * @brief An enumerable whose where() narrows a selection of positions in the source
+     * instead of copying the elements which satisfy the predicate. Made by enumerable::late().
+     *
+     * select(), min(), max(), sum() and average() also take a pointer to a data member, and
+     * every method reads the selected elements in place. Methods that have to reorder the
+     * sequence, such as order_by() and reverse(), copy the selected elements and return an
+     * ordinary enumerable. The source must outlive the query.
+     */
+    template <typename TIter>
+    class late_enumerable : public enumerable<iterator_range<selection_iterator<TIter>>>
+    {
+        using base = enumerable<iterator_range<selection_iterator<TIter>>>;
+        using TElement = typename iterator_traits<TIter>::value_type;
+
+    public:
+        late_enumerable(TIter begin, TIter end, size_t thread_count)
+            : base(selection_iterator<TIter>(begin, nullptr, 0), selection_iterator<TIter>(begin, nullptr, end - begin)), first(begin)
+        {
+            this->thread_count = thread_count;
+        }
+
+        using base::select;
+        using base::min;
+        using base::max;
+        using base::sum;
+        using base::average;
+
+        /**
+         * @brief Filters a sequence of values based on a predicate, keeping the positions of
+         * the elements which satisfy it.
+         *
+         * @param predicate A function to test each element for a condition.
+         * @return A late_enumerable over the elements which satisfy the condition.
+         */
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        late_enumerable<TIter> where(TFunc predicate)
+        {
+            using TSelected = selection_iterator<TIter>;
+            vector<size_t> rows = this->template fill_chunks<size_t>(this->begin, this->end,
+                [&](TSelected chunk_begin, TSelected chunk_end, size_t, vector<size_t>& kept)
+                {
+                    for (auto iter = chunk_begin; iter != chunk_end; ++iter)
+                    {
+                        if (predicate(*iter)) kept.push_back(iter.row());
+                    }
+                });
+            return late_enumerable<TIter>(first, make_shared<const vector<size_t>>(std::move(rows)), this->thread_count);
+        }
+
+        // The member overloads deduce the record type, so that they drop out of overload
+        // resolution instead of failing to compile when the elements are not records.
+
+        /**
+         * @brief The values of one data member of each element.
+         *
+         * @param member pointer to the member to read
+         * @return an enumerable owning the values
+         */
+        template <typename TRecord, typename TField>
+        requires is_same<TRecord, TElement>::value
+        enumerable<vector<TField>> select(TField TRecord::* member)
+        {
+            return base::select([member](const TElement& element) { return element.*member; });
+        }
+
+        /**
+         * @brief The smallest value of a data member.
+         */
+        template <typename TRecord, typename TField>
+        requires is_same<TRecord, TElement>::value && Number<TField>()
+        TField min(TField TRecord::* member)
+        {
+            return base::min([member](const TElement& element) { return element.*member; });
+        }
+
+        /**
+         * @brief The largest value of a data member.
+         */
+        template <typename TRecord, typename TField>
+        requires is_same<TRecord, TElement>::value && Number<TField>()
+        TField max(TField TRecord::* member)
+        {
+            return base::max([member](const TElement& element) { return element.*member; });
+        }
+
+        /**
+         * @brief The sum of the values of a data member.
+         */
+        template <typename TRecord, typename TField>
+        requires is_same<TRecord, TElement>::value && Number<TField>()
+        TField sum(TField TRecord::* member)
+        {
+            return base::sum([member](const TElement& element) { return element.*member; });
+        }
+
+        /**
+         * @brief The average of the values of a data member, a double for integers.
+         */
+        template <typename TRecord, typename TField>
+        requires is_same<TRecord, TElement>::value && Number<TField>()
+        auto average(TField TRecord::* member)
+        {
+            return base::average([member](const TElement& element) { return element.*member; });
+        }
+
+        /**
+         * @brief Returns a specified number of contiguous elements from the start of a sequence.
+         *
+         * @param count number of elements
+         * @return specified number of contiguous elements
+         */
+        late_enumerable<TIter> take(size_t count)
+        {
+            base::take(count);
+            return *this;
+        }
+
+        late_enumerable<TIter> take(int count)
+        {
+            if (count >= 0) return take((size_t)count);
+            else throw invalid_argument("cinq: take() was called with negative count");
+        }
+
+        /**
+         * @brief Bypasses a specified number of elements in a sequence
+         * and then returns the remaining elements.
+         *
+         * @param count number of elements to bypass
+         * @return the sequence of the remaining elements
+         */
+        late_enumerable<TIter> skip(size_t count)
+        {
+            base::skip(count);
+            return *this;
+        }
+
+        late_enumerable<TIter> skip(int count)
+        {
+            if (count >= 0) return skip((size_t)count);
+            else throw invalid_argument("cinq: skip() was called with negative count");
+        }
+
+        /**
+         * @brief The positions in the source of the selected elements, in order.
+         */
+        vector<size_t> rows() const
+        {
+            vector<size_t> result;
+            result.reserve(this->end - this->begin);
+            for (auto iter = this->begin; iter != this->end; ++iter) result.push_back(iter.row());
+            return result;
+        }
+
+    private:
+        late_enumerable(TIter first, shared_ptr<const vector<size_t>> selection, size_t thread_count)
+            : base(selection_iterator<TIter>(first, selection, 0), selection_iterator<TIter>(first, selection, selection->size())),
+              first(first)
+        {
+            this->thread_count = thread_count;
+        }
+
+        TIter first;
+    };
+}
+
+#endif
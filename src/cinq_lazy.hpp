@@ -0,0 +1,398 @@
+#ifndef __cinq_lazy_hpp__
+#define __cinq_lazy_hpp__
+
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "cinq_enumerable.hpp"
+
+namespace cinq
+{
+    using namespace std;
+    using namespace origin;
+
+    /**
+     * @brief Holds a function object so that iterators carrying it stay default constructible
+     * and copy assignable. Lambda closure types have neither, but enumerable needs both to
+     * store and move its begin and end iterators.
+     */
+    template <typename TFunc>
+    class function_box
+    {
+    public:
+        function_box() = default;
+
+        function_box(TFunc func) : func(func)
+        {
+        }
+
+        function_box(const function_box& other) : func(other.func)
+        {
+        }
+
+        function_box& operator=(const function_box& other)
+        {
+            if (this != &other)
+            {
+                if (other.func) func.emplace(*other.func);
+                else func.reset();
+            }
+            return *this;
+        }
+
+        template <typename ... TArgs>
+        decltype(auto) operator()(TArgs&& ... args) const
+        {
+            return (*func)(std::forward<TArgs>(args)...);
+        }
+
+    private:
+        optional<TFunc> func;
+    };
+
+    /**
+     * @brief Forward iterator that skips the elements of an underlying sequence which do not
+     * satisfy a predicate. The predicate is evaluated as the iterator is advanced. When the
+     * underlying iterator yields values rather than references, as a select_iterator does,
+     * the value tested is kept and returned on dereference, so each element is computed once.
+     */
+    template <typename TIter, typename TFunc>
+    class where_iterator
+    {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = typename iterator_traits<TIter>::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = typename iterator_traits<TIter>::pointer;
+        using reference = typename iterator_traits<TIter>::reference;
+
+        where_iterator() = default;
+
+        where_iterator(TIter current, TIter end, TFunc predicate) : current(current), end(end), predicate(predicate)
+        {
+            satisfy();
+        }
+
+        reference operator*() const
+        {
+            if constexpr (!caches_value) return *current;
+            else if constexpr (is_default_constructible<value_type>::value) return value;
+            else return *value;
+        }
+
+        where_iterator& operator++()
+        {
+            ++current;
+            satisfy();
+            return *this;
+        }
+
+        where_iterator operator++(int)
+        {
+            where_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const where_iterator& other) const
+        {
+            return current == other.current;
+        }
+
+        bool operator!=(const where_iterator& other) const
+        {
+            return current != other.current;
+        }
+
+    private:
+        // Moves forward to the next element that satisfies the predicate, or to the end.
+        void satisfy()
+        {
+            if constexpr (!caches_value)
+            {
+                while (current != end && !predicate(*current)) ++current;
+            }
+            else if constexpr (is_default_constructible<value_type>::value)
+            {
+                for (; current != end; ++current)
+                {
+                    value = *current;
+                    if (predicate(value)) return;
+                }
+            }
+            else
+            {
+                for (value.reset(); current != end; ++current)
+                {
+                    value.emplace(*current);
+                    if (predicate(*value)) return;
+                }
+                value.reset();
+            }
+        }
+
+        static constexpr bool caches_value = !is_reference<reference>::value;
+
+        // The value tested last, held in an optional only when it has no default constructor.
+        using cache = conditional_t<is_default_constructible<value_type>::value, value_type, optional<value_type>>;
+
+        TIter current;
+        TIter end;
+        function_box<TFunc> predicate;
+        conditional_t<caches_value, cache, bool> value {};
+    };
+
+    /**
+     * @brief Forward iterator that maps each element of an underlying sequence when it is
+     * dereferenced. Elements which are skipped over are never mapped.
+     */
+    template <typename TIter, typename TFunc>
+    class select_iterator
+    {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = typename decay<typename result_of<TFunc(typename iterator_traits<TIter>::reference)>::type>::type;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        select_iterator() = default;
+
+        select_iterator(TIter current, TFunc mapper) : current(current), mapper(mapper)
+        {
+        }
+
+        reference operator*() const
+        {
+            return mapper(*current);
+        }
+
+        select_iterator& operator++()
+        {
+            ++current;
+            return *this;
+        }
+
+        select_iterator operator++(int)
+        {
+            select_iterator old = *this;
+            ++current;
+            return old;
+        }
+
+        bool operator==(const select_iterator& other) const
+        {
+            return current == other.current;
+        }
+
+        bool operator!=(const select_iterator& other) const
+        {
+            return current != other.current;
+        }
+
+    private:
+        TIter current;
+        function_box<TFunc> mapper;
+    };
+
+    /**
+     * @brief A pair of iterators dressed up as a container, so that enumerable can be
+     * instantiated over iterator adaptors.
+     */
+    template <typename TIter>
+    class iterator_range
+    {
+    public:
+        using value_type = typename iterator_traits<TIter>::value_type;
+        using const_iterator = TIter;
+
+        iterator_range(TIter first, TIter last) : first(first), last(last)
+        {
+        }
+
+        TIter begin() const { return first; }
+        TIter end() const { return last; }
+        TIter cbegin() const { return first; }
+        TIter cend() const { return last; }
+
+    private:
+        TIter first;
+        TIter last;
+    };
+
+    /**
+     * @brief An enumerable whose where(), select(), take() and skip() compose iterator
+     * adaptors instead of copying the sequence into a new vector. Nothing is evaluated until
+     * a method that produces a value is called: to_vector(), sum(), count(), first()...
+     *
+     * The accessors first(), last() and element_at() return elements by value, since a
+     * select() adaptor yields values it does not store anywhere. Other methods are inherited;
+     * those that have to reorder the sequence, such as order_by() and reverse(), materialize
+     * it and return an ordinary enumerable.
+     */
+    template <typename TIter>
+    class lazy_enumerable : public enumerable<iterator_range<TIter>>
+    {
+        using base = enumerable<iterator_range<TIter>>;
+        using TElement = typename iterator_traits<TIter>::value_type;
+
+    public:
+        lazy_enumerable(TIter begin, TIter end, size_t thread_count = 1) : base(begin, end)
+        {
+            this->thread_count = thread_count;
+        }
+
+        /**
+         * @brief Filters a sequence of values based on a predicate. The predicate is not
+         * called until the result is enumerated.
+         *
+         * @param predicate A function to test each element for a condition.
+         * @return A lazy_enumerable that yields the elements which satisfy the condition.
+         */
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        lazy_enumerable<where_iterator<TIter, TFunc>> where(TFunc predicate)
+        {
+            using TResult = where_iterator<TIter, TFunc>;
+            return lazy_enumerable<TResult>(TResult(this->begin, this->end, predicate),
+                                            TResult(this->end, this->end, predicate), this->thread_count);
+        }
+
+        /**
+         * @brief Projects each element of a sequence into a new form. The mapper is not
+         * called until the result is enumerated.
+         *
+         * @param mapper A transform function to apply to each element.
+         * @return A lazy_enumerable that yields the mapped elements.
+         */
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        lazy_enumerable<select_iterator<TIter, TFunc>> select(TFunc mapper)
+        {
+            using TResult = select_iterator<TIter, TFunc>;
+            return lazy_enumerable<TResult>(TResult(this->begin, mapper), TResult(this->end, mapper), this->thread_count);
+        }
+
+        /**
+         * @brief Returns a specified number of contiguous elements from the start of a sequence.
+         *
+         * @param count number of elements
+         * @return specified number of contiguous elements
+         */
+        lazy_enumerable<TIter> take(size_t count)
+        {
+            base::take(count);
+            return *this;
+        }
+
+        lazy_enumerable<TIter> take(int count)
+        {
+            if (count >= 0) return take((size_t)count);
+            else throw invalid_argument("cinq: take() was called with negative count");
+        }
+
+        /**
+         * @brief Bypasses a specified number of elements in a sequence
+         * and then returns the remaining elements.
+         *
+         * @param count number of elements to bypass
+         * @return the sequence of the remaining elements
+         */
+        lazy_enumerable<TIter> skip(size_t count)
+        {
+            base::skip(count);
+            return *this;
+        }
+
+        lazy_enumerable<TIter> skip(int count)
+        {
+            if (count >= 0) return skip((size_t)count);
+            else throw invalid_argument("cinq: skip() was called with negative count");
+        }
+
+        /**
+         * @brief Returns the first element of a sequence. The element is returned by value
+         * because a select() adaptor has nowhere to store the mapped value.
+         *
+         * @return first element
+         */
+        TElement first()
+        {
+            if (this->begin == this->end) throw out_of_range("cinq: cannot get first element of empty enumerable");
+            return *this->begin;
+        }
+
+        /**
+         * @brief Returns the element at a specified index in a sequence, with range checking.
+         * The element is returned by value, like first().
+         *
+         * @param index returns the element at this number
+         * @return The element at the specified position in the source sequence.
+         */
+        TElement element_at(size_t index)
+        {
+            auto iter = this->begin;
+            for (; index > 0 && iter != this->end; index--) ++iter;
+            if (iter == this->end) throw out_of_range("cinq: element_at() index out of range");
+            return *iter;
+        }
+
+        TElement element_at(int index)
+        {
+            if (index >= 0) return element_at((size_t)index);
+            else throw out_of_range("cinq: element_at() was called with negative index");
+        }
+
+        /**
+         * @brief Returns the last element of a sequence, found in one forward pass.
+         *
+         * @return last element of a sequence
+         */
+        TElement last()
+        {
+            if (this->begin == this->end) throw out_of_range("cinq: cannot get last element of empty enumerable");
+            auto last = this->begin;
+            for (auto iter = this->begin; iter != this->end; ++iter) last = iter;
+            return *last;
+        }
+
+        /**
+         * @brief Returns the last element of a sequence that satisfies a specified condition,
+         * found in one forward pass.
+         *
+         * @param predicate A function to test each element for a condition.
+         * @return last element that satisfies a specified condition
+         */
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        TElement last(TFunc predicate)
+        {
+            if (this->begin == this->end) throw out_of_range("cinq: cannot get last element of empty enumerable");
+            auto found = this->end;
+            for (auto iter = this->begin; iter != this->end; ++iter)
+            {
+                if (predicate(*iter)) found = iter;
+            }
+            if (found == this->end) throw invalid_argument("cinq: no element satisfies the condition in predicate ");
+            return *found;
+        }
+
+        /**
+         * @brief Evaluates the query and returns the results in a vector, in a single pass
+         * over the source.
+         *
+         * @return the elements of the sequence
+         */
+        vector<TElement> to_vector()
+        {
+            vector<TElement> result;
+            for (auto iter = this->begin; iter != this->end; ++iter) result.push_back(*iter);
+            return result;
+        }
+    };
+
+}
+
+#endif
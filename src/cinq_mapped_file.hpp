@@ -0,0 +1,82 @@
+#ifndef __cinq_mapped_file_hpp__
+#define __cinq_mapped_file_hpp__
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file, used by from_csv() and by snapshots.
+
+namespace cinq
+{
+    using namespace std;
+
+    /**
+     * @brief A file mapped read-only into memory for as long as the object lives.
+     */
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const string& path)
+        {
+            int descriptor = open(path.c_str(), O_RDONLY);
+            if (descriptor < 0) throw runtime_error("cinq: cannot open " + path);
+
+            struct stat info;
+            if (fstat(descriptor, &info) != 0)
+            {
+                close(descriptor);
+                throw runtime_error("cinq: cannot read " + path);
+            }
+
+            // An empty file cannot be mapped, and has nothing to map anyway.
+            length = info.st_size;
+            if (length > 0)
+            {
+                void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (mapped == MAP_FAILED)
+                {
+                    close(descriptor);
+                    throw runtime_error("cinq: cannot map " + path);
+                }
+                madvise(mapped, length, MADV_SEQUENTIAL);
+                bytes = (const char*)mapped;
+            }
+            close(descriptor);
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file()
+        {
+            if (bytes) munmap((void*)bytes, length);
+        }
+
+        const char* begin() const
+        {
+            return bytes;
+        }
+
+        const char* end() const
+        {
+            return bytes + length;
+        }
+
+        size_t size() const
+        {
+            return length;
+        }
+
+    private:
+        const char* bytes = nullptr;
+        size_t length = 0;
+    };
+}
+
+#endif
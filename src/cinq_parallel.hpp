@@ -0,0 +1,430 @@
+#ifndef __cinq_parallel_hpp__
+#define __cinq_parallel_hpp__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cinq
+{
+    using namespace std;
+
+    /**
+     * @brief Runs the tasks of parallel queries. Implement this to run cinq queries on an
+     * existing scheduler, and install it with set_executor().
+     */
+    class executor
+    {
+    public:
+        virtual ~executor() = default;
+
+        /**
+         * @brief Schedules a task to run on some thread. Must not block waiting for the task.
+         *
+         * @param task the task to run
+         */
+        virtual void submit(function<void()> task) = 0;
+
+        /**
+         * @brief number of threads tasks can run on at once, counting the thread which waits
+         * for them.
+         */
+        virtual size_t concurrency() const = 0;
+
+        /**
+         * @brief Runs one pending task on the calling thread, if there is one. Threads waiting
+         * for their tasks call this so that queries nested inside tasks cannot deadlock.
+         *
+         * @return true if a task was run
+         */
+        virtual bool try_run_one()
+        {
+            return false;
+        }
+    };
+
+    /**
+     * @brief Fixed set of worker threads which each own a deque of tasks. A worker pushes and
+     * pops tasks at the back of its own deque and, once that is empty, steals from the front
+     * of the others. Tasks submitted from outside the pool are spread over the deques in turn.
+     */
+    class thread_pool : public executor
+    {
+    public:
+        /**
+         * @brief Starts the worker threads.
+         *
+         * @param workers number of worker threads, or 0 for one less than the number of
+         * hardware threads, since the thread waiting for a query works on it too
+         */
+        explicit thread_pool(size_t workers = 0)
+        {
+            if (workers == 0)
+            {
+                size_t hardware = thread::hardware_concurrency();
+                workers = hardware > 1 ? hardware - 1 : 1;
+            }
+
+            for (size_t i = 0; i < workers; i++) queues.push_back(make_unique<task_queue>());
+            for (size_t i = 0; i < workers; i++) threads.emplace_back([this, i] { work(i); });
+        }
+
+        ~thread_pool()
+        {
+            {
+                lock_guard<mutex> lock(sleep_mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : threads) worker.join();
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        void submit(function<void()> task) override
+        {
+            size_t queue = current_pool() == this ? current_worker() : next_queue++ % queues.size();
+            // Counted before it is published, so that a worker which steals it at once
+            // never takes the count below zero.
+            {
+                lock_guard<mutex> lock(sleep_mutex);
+                queued++;
+            }
+            {
+                lock_guard<mutex> lock(queues[queue]->guard);
+                queues[queue]->tasks.push_back(std::move(task));
+            }
+            wake.notify_one();
+        }
+
+        size_t concurrency() const override
+        {
+            return threads.size() + 1;
+        }
+
+        bool try_run_one() override
+        {
+            function<void()> task;
+            size_t first = current_pool() == this ? current_worker() : next_queue % queues.size();
+            if (!pop(first, task)) return false;
+            task();
+            return true;
+        }
+
+    private:
+        struct task_queue
+        {
+            mutex guard;
+            deque<function<void()>> tasks;
+        };
+
+        // Takes a task from the back of the given queue, or failing that steals one from the
+        // front of another queue.
+        bool pop(size_t own, function<void()>& task)
+        {
+            for (size_t i = 0; i < queues.size(); i++)
+            {
+                task_queue& queue = *queues[(own + i) % queues.size()];
+                lock_guard<mutex> lock(queue.guard);
+                if (queue.tasks.empty()) continue;
+
+                if (i == 0)
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                lock_guard<mutex> count_lock(sleep_mutex);
+                queued--;
+                return true;
+            }
+            return false;
+        }
+
+        void work(size_t index)
+        {
+            current_pool() = this;
+            current_worker() = index;
+
+            function<void()> task;
+            while (true)
+            {
+                if (pop(index, task))
+                {
+                    task();
+                    task = nullptr;
+                    continue;
+                }
+
+                unique_lock<mutex> lock(sleep_mutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+                if (stopping && queued == 0) return;
+            }
+        }
+
+        static thread_pool*& current_pool()
+        {
+            static thread_local thread_pool* pool = nullptr;
+            return pool;
+        }
+
+        static size_t& current_worker()
+        {
+            static thread_local size_t worker = 0;
+            return worker;
+        }
+
+        vector<unique_ptr<task_queue>> queues;
+        vector<thread> threads;
+        atomic<size_t> next_queue { 0 };
+        atomic<size_t> queued { 0 };
+        mutex sleep_mutex;
+        condition_variable wake;
+        bool stopping = false;
+    };
+
+    /**
+     * @brief The pool used when no other executor has been installed. Its threads are started
+     * the first time a query runs in parallel.
+     */
+    inline thread_pool& default_pool()
+    {
+        static thread_pool pool;
+        return pool;
+    }
+
+    inline executor*& installed_executor()
+    {
+        static executor* installed = nullptr;
+        return installed;
+    }
+
+    /**
+     * @brief Makes every parallel query submit its tasks to the given executor, which must
+     * outlive them. Pass nullptr to go back to default_pool().
+     *
+     * @param exec the executor to use
+     */
+    inline void set_executor(executor* exec)
+    {
+        installed_executor() = exec;
+    }
+
+    /**
+     * @brief The executor parallel queries currently submit their tasks to.
+     */
+    inline executor& current_executor()
+    {
+        executor* installed = installed_executor();
+        return installed ? *installed : default_pool();
+    }
+
+    /**
+     * @brief Execution policy for queries that may run on several threads.
+     * A thread_count of 0 means one thread per hardware thread.
+     */
+    struct parallel_policy
+    {
+        size_t thread_count;
+
+        /**
+         * @brief Returns the same policy limited to the given number of threads.
+         *
+         * @param threads number of threads to use, or 0 for all hardware threads
+         */
+        constexpr parallel_policy operator()(size_t threads) const
+        {
+            return parallel_policy { threads };
+        }
+    };
+
+    /**
+     * @brief Pass to from() to run the query on all hardware threads, or par(n) for n threads.
+     */
+    constexpr parallel_policy par { 0 };
+
+    /**
+     * @brief Smallest number of elements worth handing to another thread. Shorter sequences
+     * are processed on the calling thread even when a parallel policy is set.
+     */
+    constexpr size_t parallel_grain = 4096;
+
+    /**
+     * @brief Resolves a requested thread count, where 0 means all hardware threads.
+     */
+    inline size_t resolve_thread_count(size_t thread_count)
+    {
+        if (thread_count != 0) return thread_count;
+        size_t hardware = thread::hardware_concurrency();
+        return hardware == 0 ? 1 : hardware;
+    }
+
+    /**
+     * @brief Splits [0, count) into the given number of contiguous chunks of nearly equal size
+     * and calls body(chunk_begin, chunk_end, chunk_index) for each of them on the current
+     * executor. Returns once every chunk is done. If any call throws, the exception from the
+     * lowest-numbered chunk is rethrown.
+     *
+     * The calling thread runs the first chunk and then other pending tasks until its own are
+     * finished, so a body may itself run a parallel query without deadlocking the pool or
+     * starting more threads.
+     */
+    template <typename TFunc>
+    void parallel_chunks(size_t count, size_t chunks, TFunc body)
+    {
+        vector<exception_ptr> errors(chunks);
+        atomic<size_t> remaining(chunks);
+        auto run = [&](size_t chunk)
+        {
+            try
+            {
+                body(count * chunk / chunks, count * (chunk + 1) / chunks, chunk);
+            }
+            catch (...)
+            {
+                errors[chunk] = current_exception();
+            }
+            remaining.fetch_sub(1, memory_order_release);
+        };
+
+        executor& exec = current_executor();
+        for (size_t chunk = 1; chunk < chunks; chunk++) exec.submit([&run, chunk] { run(chunk); });
+        run(0);
+        while (remaining.load(memory_order_acquire) != 0)
+        {
+            if (!exec.try_run_one()) this_thread::yield();
+        }
+
+        for (auto& error : errors)
+        {
+            if (error) rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Shortest sequence order_by() sorts on several threads. Below it splitting the
+     * sort and merging the runs costs more than it saves.
+     */
+    constexpr size_t parallel_sort_threshold = 65536;
+
+    /**
+     * @brief Number of runs parallel_sort() should split a sequence of the given length into
+     * when the query may use the given number of threads.
+     */
+    inline size_t sort_run_count(size_t length, size_t thread_count)
+    {
+        if (thread_count <= 1 || length < parallel_sort_threshold) return 1;
+        return std::max<size_t>(1, std::min(thread_count, length / parallel_grain));
+    }
+
+    /**
+     * @brief Sorts items by less, a strict weak ordering. The items are cut into the given
+     * number of runs and sort_run(first, last) sorts each of them on the current executor.
+     * Splitters sampled from the sorted runs then cut every run into the same number of key
+     * ranges, and each range is merged from all runs at once, in parallel, straight into its
+     * final place.
+     *
+     * Equal items are merged in run order, so the sort is stable when sort_run is.
+     */
+    template <typename T, typename TCompare, typename TRunSort>
+    void parallel_sort(vector<T>& items, size_t runs, TCompare less, TRunSort sort_run)
+    {
+        size_t length = items.size();
+        if (runs <= 1 || length < runs)
+        {
+            sort_run(items.begin(), items.end());
+            return;
+        }
+
+        parallel_chunks(length, runs, [&](size_t run_begin, size_t run_end, size_t)
+        {
+            sort_run(items.begin() + run_begin, items.begin() + run_end);
+        });
+
+        vector<size_t> bounds(runs + 1);
+        for (size_t run = 0; run <= runs; run++) bounds[run] = length * run / runs;
+
+        // runs evenly spaced samples per run give runs - 1 splitters which cut the items into
+        // ranges of similar size.
+        vector<T> samples;
+        samples.reserve(runs * runs);
+        for (size_t run = 0; run < runs; run++)
+        {
+            size_t run_length = bounds[run + 1] - bounds[run];
+            for (size_t i = 0; i < runs; i++) samples.push_back(items[bounds[run] + run_length * i / runs]);
+        }
+        std::sort(samples.begin(), samples.end(), less);
+
+        // cuts[run * (runs + 1) + part] is where range part starts in the run. Every run is cut
+        // at the same splitters, so equal items all land in one range.
+        vector<size_t> cuts(runs * (runs + 1));
+        for (size_t run = 0; run < runs; run++)
+        {
+            size_t* run_cuts = &cuts[run * (runs + 1)];
+            run_cuts[0] = bounds[run];
+            run_cuts[runs] = bounds[run + 1];
+            for (size_t part = 1; part < runs; part++)
+            {
+                const T& splitter = samples[part * runs];
+                run_cuts[part] = std::upper_bound(items.begin() + run_cuts[part - 1], items.begin() + bounds[run + 1], splitter, less) - items.begin();
+            }
+        }
+
+        vector<T> merged(length);
+        parallel_chunks(runs, runs, [&](size_t part_begin, size_t part_end, size_t)
+        {
+            vector<size_t> next(runs);
+            vector<size_t> heap;
+            heap.reserve(runs);
+
+            // The heap keeps the run with the smallest next item on top, the lowest run first
+            // among equal items.
+            auto after = [&](size_t a, size_t b)
+            {
+                if (less(items[next[b]], items[next[a]])) return true;
+                if (less(items[next[a]], items[next[b]])) return false;
+                return a > b;
+            };
+
+            for (size_t part = part_begin; part < part_end; part++)
+            {
+                size_t out = 0;
+                heap.clear();
+                for (size_t run = 0; run < runs; run++)
+                {
+                    size_t* run_cuts = &cuts[run * (runs + 1)];
+                    out += run_cuts[part] - bounds[run];
+                    next[run] = run_cuts[part];
+                    if (run_cuts[part] != run_cuts[part + 1]) heap.push_back(run);
+                }
+                std::make_heap(heap.begin(), heap.end(), after);
+
+                while (!heap.empty())
+                {
+                    std::pop_heap(heap.begin(), heap.end(), after);
+                    size_t run = heap.back();
+                    merged[out++] = std::move(items[next[run]++]);
+                    if (next[run] == cuts[run * (runs + 1) + part + 1]) heap.pop_back();
+                    else std::push_heap(heap.begin(), heap.end(), after);
+                }
+            }
+        });
+
+        items.swap(merged);
+    }
+
+}
+
+#endif
@@ -0,0 +1,605 @@
+#ifndef __cinq_plan_hpp__
+#define __cinq_plan_hpp__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cinq_enumerable.hpp"
+#include "cinq_expression.hpp"
+
+// Planned queries: after planned(), where(), select(), take(), skip() and order_by() do not
+// run. Each adds an operator to a small plan of the query, and the plan is rewritten as it
+// grows, before anything reads the source:
+//
+//  - two where() in a row become one, so the elements pass a single test;
+//  - where() after order_by() moves below it, so only the elements it keeps are sorted;
+//  - take() and skip() move below select(), so the mapper only sees the elements kept;
+//  - take() after order_by() tells the sort how many elements are read, which sorts only
+//    those; first() and element_at() are a take() of one element;
+//  - count(), sum(), min(), max(), average(), any() and all() do not depend on the order,
+//    so they drop an order_by() which no take() or skip() follows.
+//
+// A method that produces a value then runs the rewritten plan in a single pass over the
+// source, with no copy of the sequence except the elements an order_by() sorts.
+//
+//     auto coldest = cinq::from(weather).planned()
+//                                       .order_by([](const weather_point& w) { return w.temp_min; })
+//                                       .where([](const weather_point& w) { return w.rain; })
+//                                       .first();
+//
+// explain() shows the plan a query runs, such as "source | where | order_by (first 1)".
+
+namespace cinq
+{
+    using namespace std;
+    using namespace origin;
+
+    namespace plans
+    {
+        /**
+         * @brief Reads the elements of a sequence in place.
+         */
+        template <typename TIter>
+        class source
+        {
+        public:
+            using value_type = typename iterator_traits<TIter>::value_type;
+
+            source(TIter begin, TIter end) : begin(begin), end(end)
+            {
+            }
+
+            // Passes each element to sink, until sink returns false. Returns false if it did.
+            template <typename TSink>
+            bool operator()(TSink&& sink) const
+            {
+                for (auto iter = begin; iter != end; ++iter)
+                {
+                    if (!sink(*iter)) return false;
+                }
+                return true;
+            }
+
+            string describe() const
+            {
+                return "source";
+            }
+
+        private:
+            TIter begin;
+            TIter end;
+        };
+
+        /**
+         * @brief Passes on the elements which satisfy a predicate.
+         */
+        template <typename TInput, typename TFunc>
+        class filter
+        {
+        public:
+            using value_type = typename TInput::value_type;
+
+            filter(TInput input, TFunc predicate) : input(input), predicate(predicate)
+            {
+            }
+
+            template <typename TSink>
+            bool operator()(TSink&& sink) const
+            {
+                return input([&](const value_type& element) { return !predicate(element) || sink(element); });
+            }
+
+            string describe() const
+            {
+                return input.describe() + " | where";
+            }
+
+            TInput input;
+            TFunc predicate;
+        };
+
+        /**
+         * @brief Passes on each element mapped by a function.
+         */
+        template <typename TInput, typename TFunc>
+        class map
+        {
+            using TSource = typename TInput::value_type;
+
+        public:
+            using value_type = typename decay<typename result_of<TFunc(const TSource&)>::type>::type;
+
+            map(TInput input, TFunc mapper) : input(input), mapper(mapper)
+            {
+            }
+
+            template <typename TSink>
+            bool operator()(TSink&& sink) const
+            {
+                return input([&](const TSource& element) { return sink(mapper(element)); });
+            }
+
+            string describe() const
+            {
+                return input.describe() + " | select";
+            }
+
+            TInput input;
+            TFunc mapper;
+        };
+
+        /**
+         * @brief Skips the first skipped elements, then passes on at most taken more.
+         */
+        template <typename TInput>
+        class slice
+        {
+        public:
+            using value_type = typename TInput::value_type;
+
+            slice(TInput input, size_t skipped, size_t taken) : input(input), skipped(skipped), taken(taken)
+            {
+            }
+
+            template <typename TSink>
+            bool operator()(TSink&& sink) const
+            {
+                if (taken == 0) return true;
+
+                size_t to_skip = skipped;
+                size_t to_take = taken;
+                bool stopped = false;
+                input([&](const value_type& element)
+                {
+                    if (to_skip > 0)
+                    {
+                        to_skip--;
+                        return true;
+                    }
+                    stopped = !sink(element);
+                    return !stopped && --to_take > 0;
+                });
+                return !stopped;
+            }
+
+            string describe() const
+            {
+                string text = input.describe();
+                if (skipped > 0) text += " | skip " + to_string(skipped);
+                if (taken != SIZE_MAX) text += " | take " + to_string(taken);
+                return text;
+            }
+
+            TInput input;
+            size_t skipped;
+            size_t taken;
+        };
+
+        /**
+         * @brief Sorts the elements on a key, keeping the order of equal ones, and passes
+         * on the first limit of them. Only those are put in order, in O(n log limit).
+         */
+        template <typename TInput, typename TKeyOf>
+        class sort
+        {
+        public:
+            using value_type = typename TInput::value_type;
+
+            sort(TInput input, TKeyOf key_of, size_t limit = SIZE_MAX) : input(input), key_of(key_of), limit(limit)
+            {
+            }
+
+            template <typename TSink>
+            bool operator()(TSink&& sink) const
+            {
+                using TKey = typename decay<typename result_of<TKeyOf(const value_type&)>::type>::type;
+
+                vector<value_type> elements;
+                vector<TKey> keys;
+                input([&](const value_type& element)
+                {
+                    elements.push_back(element);
+                    keys.push_back(key_of(element));
+                    return true;
+                });
+
+                vector<size_t> order(elements.size());
+                for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+                // Ties go to the earlier element, which makes the partial sort stable too.
+                auto before = [&](size_t a, size_t b) { return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b); };
+                size_t sorted = std::min(limit, order.size());
+                if (sorted == 1) iter_swap(order.begin(), min_element(order.begin(), order.end(), before));
+                else if (sorted < order.size()) partial_sort(order.begin(), order.begin() + sorted, order.end(), before);
+                else std::sort(order.begin(), order.end(), before);
+
+                for (size_t i = 0; i < sorted; i++)
+                {
+                    if (!sink(elements[order[i]])) return false;
+                }
+                return true;
+            }
+
+            string describe() const
+            {
+                return input.describe() + " | order_by" + (limit == SIZE_MAX ? "" : " (first " + to_string(limit) + ")");
+            }
+
+            TInput input;
+            TKeyOf key_of;
+            size_t limit;
+        };
+
+        // Two predicates tested as one. Expressions stay expressions, so the library can
+        // still read them.
+        template <typename TFirst, typename TSecond>
+        auto both(TFirst first, TSecond second)
+        {
+            return [first, second](const auto& element) -> bool { return first(element) && second(element); };
+        }
+
+        template <typename TFirst, typename TSecond>
+        requires expressions::Expression<TFirst>() && expressions::Expression<TSecond>()
+        auto both(TFirst first, TSecond second)
+        {
+            return first && second;
+        }
+
+        // The rewrites: each adds an operator on top of a plan, moving or merging it with
+        // the operator it lands on where that gives the same elements for less work.
+
+        template <typename TInput, typename TFunc>
+        filter<TInput, TFunc> with_filter(const TInput& input, TFunc predicate)
+        {
+            return filter<TInput, TFunc>(input, predicate);
+        }
+
+        template <typename TInput, typename TFirst, typename TFunc>
+        auto with_filter(const filter<TInput, TFirst>& top, TFunc predicate)
+        {
+            return with_filter(top.input, both(top.predicate, predicate));
+        }
+
+        // A sort on top of a plan has no limit yet: a limit only comes with a take() above it.
+        template <typename TInput, typename TKeyOf, typename TFunc>
+        auto with_filter(const sort<TInput, TKeyOf>& top, TFunc predicate)
+        {
+            auto below = with_filter(top.input, predicate);
+            return sort<decltype(below), TKeyOf>(below, top.key_of);
+        }
+
+        template <typename TInput>
+        slice<TInput> with_slice(const TInput& input, size_t skipped, size_t taken)
+        {
+            return slice<TInput>(input, skipped, taken);
+        }
+
+        template <typename TInput, typename TFunc>
+        auto with_slice(const map<TInput, TFunc>& top, size_t skipped, size_t taken)
+        {
+            auto below = with_slice(top.input, skipped, taken);
+            return map<decltype(below), TFunc>(below, top.mapper);
+        }
+
+        template <typename TInput>
+        auto with_slice(const slice<TInput>& top, size_t skipped, size_t taken)
+        {
+            size_t start = top.skipped > SIZE_MAX - skipped ? SIZE_MAX : top.skipped + skipped;
+            // A slice with no take() keeps no bound after more elements are skipped.
+            size_t left = top.taken == SIZE_MAX ? SIZE_MAX : top.taken > skipped ? top.taken - skipped : 0;
+            return with_slice(top.input, start, std::min(taken, left));
+        }
+
+        template <typename TInput, typename TKeyOf>
+        auto with_slice(const sort<TInput, TKeyOf>& top, size_t skipped, size_t taken)
+        {
+            size_t read = taken > SIZE_MAX - skipped ? SIZE_MAX : skipped + taken;
+            using TSort = sort<TInput, TKeyOf>;
+            return slice<TSort>(TSort(top.input, top.key_of, std::min(top.limit, read)), skipped, taken);
+        }
+
+        // The same plan without the sorts whose order nothing reads: those under where()
+        // and select() only, with no take() or skip() above them.
+
+        template <typename TInput>
+        TInput unordered(const TInput& input)
+        {
+            return input;
+        }
+
+        template <typename TInput, typename TKeyOf>
+        auto unordered(const sort<TInput, TKeyOf>& top)
+        {
+            return unordered(top.input);
+        }
+
+        template <typename TInput, typename TFunc>
+        auto unordered(const filter<TInput, TFunc>& top)
+        {
+            auto below = unordered(top.input);
+            return filter<decltype(below), TFunc>(below, top.predicate);
+        }
+
+        template <typename TInput, typename TFunc>
+        auto unordered(const map<TInput, TFunc>& top)
+        {
+            auto below = unordered(top.input);
+            return map<decltype(below), TFunc>(below, top.mapper);
+        }
+    }
+
+    /**
+     * @brief A query kept as a plan of operators, which is rewritten as methods are added
+     * and only run by the methods that produce a value. Made by enumerable::planned(); it
+     * has the same names for the methods it supports. Each method that produces a value
+     * runs the plan again over the source, which must outlive the query.
+     */
+    template <typename TPlan>
+    class plan_enumerable
+    {
+        using TElement = typename TPlan::value_type;
+
+    public:
+        explicit plan_enumerable(TPlan plan) : plan(plan)
+        {
+        }
+
+        /**
+         * @brief Filters a sequence of values based on a predicate. Merged with a where()
+         * just before it, and moved below an order_by() just before it.
+         *
+         * @param predicate A function to test each element for a condition.
+         * @return A plan_enumerable over the elements which satisfy the condition.
+         */
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        auto where(TFunc predicate) const
+        {
+            return make(plans::with_filter(plan, predicate));
+        }
+
+        /**
+         * @brief Projects each element of a sequence into a new form.
+         *
+         * @param mapper A transform function to apply to each element.
+         * @return A plan_enumerable over the mapped elements.
+         */
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto select(TFunc mapper) const
+        {
+            return make(plans::map<TPlan, TFunc>(plan, mapper));
+        }
+
+        /**
+         * @brief Returns a specified number of contiguous elements from the start of a
+         * sequence. Moved below select() and merged with take() and skip(); after
+         * order_by(), only the elements taken are sorted.
+         */
+        auto take(size_t count) const
+        {
+            return make(plans::with_slice(plan, 0, count));
+        }
+
+        /**
+         * @brief Bypasses a specified number of elements in a sequence and then returns the
+         * remaining elements.
+         */
+        auto skip(size_t count) const
+        {
+            return make(plans::with_slice(plan, count, SIZE_MAX));
+        }
+
+        /**
+         * @brief Sorts the elements in ascending order of the given keys, keeping the order
+         * of equal elements.
+         *
+         * @param first mapper giving the primary key
+         * @param rest mappers giving the keys used to break ties
+         */
+        template <typename TFunc, typename ... TRest>
+        auto order_by(TFunc first, TRest... rest) const
+        {
+            auto key_of = [first, rest...](const TElement& element) { return make_tuple(first(element), rest(element)...); };
+            return make(plans::sort<TPlan, decltype(key_of)>(plan, key_of));
+        }
+
+        size_t count() const
+        {
+            size_t count = 0;
+            plans::unordered(plan)([&](const TElement&)
+            {
+                count++;
+                return true;
+            });
+            return count;
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        size_t count(TFunc predicate) const
+        {
+            return where(predicate).count();
+        }
+
+        bool any() const
+        {
+            return !plans::unordered(plan)([](const TElement&) { return false; });
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        bool any(TFunc predicate) const
+        {
+            return where(predicate).any();
+        }
+
+        template <typename TFunc>
+        requires Predicate<TFunc, TElement>()
+        bool all(TFunc predicate) const
+        {
+            return !where([predicate](const TElement& element) { return !predicate(element); }).any();
+        }
+
+        /**
+         * @brief The sum of the elements, added in the order of the source even after an
+         * order_by().
+         */
+        TElement sum() const requires Number<TElement>()
+        {
+            TElement total = 0;
+            plans::unordered(plan)([&](const TElement& element)
+            {
+                total += element;
+                return true;
+            });
+            return total;
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto sum(TFunc mapper) const
+        {
+            return select(mapper).sum();
+        }
+
+        TElement min() const requires Number<TElement>()
+        {
+            return extreme([](const TElement& a, const TElement& b) { return b < a; });
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto min(TFunc mapper) const
+        {
+            return select(mapper).min();
+        }
+
+        TElement max() const requires Number<TElement>()
+        {
+            return extreme([](const TElement& a, const TElement& b) { return a < b; });
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto max(TFunc mapper) const
+        {
+            return select(mapper).max();
+        }
+
+        /**
+         * @brief The average of the elements: a double for integers, and the element type for
+         * floating point numbers.
+         */
+        auto average() const requires Number<TElement>()
+        {
+            using TTotal = typename conditional<is_integral<TElement>::value, long long, TElement>::type;
+            using TResult = typename conditional<is_integral<TElement>::value, double, TElement>::type;
+
+            TTotal total = 0;
+            size_t count = 0;
+            plans::unordered(plan)([&](const TElement& element)
+            {
+                total += element;
+                count++;
+                return true;
+            });
+            if (count == 0) throw length_error("cinq: sequence is empty");
+            return (TResult)total / (TResult)count;
+        }
+
+        template <typename TFunc>
+        requires Function<TFunc, TElement>()
+        auto average(TFunc mapper) const
+        {
+            return select(mapper).average();
+        }
+
+        /**
+         * @brief Returns the first element of a sequence. After an order_by(), the sort only
+         * looks for the smallest element.
+         */
+        TElement first() const
+        {
+            optional<TElement> found;
+            take(1).plan([&](const TElement& element)
+            {
+                found = element;
+                return false;
+            });
+            if (!found) throw out_of_range("cinq: cannot get first element of empty enumerable");
+            return *found;
+        }
+
+        /**
+         * @brief Returns the element at a specified index in a sequence.
+         */
+        TElement element_at(size_t index) const
+        {
+            optional<TElement> found;
+            skip(index).take(1).plan([&](const TElement& element)
+            {
+                found = element;
+                return false;
+            });
+            if (!found) throw out_of_range("cinq: element_at() index out of range");
+            return *found;
+        }
+
+        vector<TElement> to_vector() const
+        {
+            vector<TElement> result;
+            plan([&](const TElement& element)
+            {
+                result.push_back(element);
+                return true;
+            });
+            return result;
+        }
+
+        /**
+         * @brief The operators of the rewritten plan, from the source up, such as
+         * "source | take 10 | select".
+         */
+        string explain() const
+        {
+            return plan.describe();
+        }
+
+    private:
+        template <typename TOther>
+        friend class plan_enumerable;
+
+        template <typename TOtherPlan>
+        static plan_enumerable<TOtherPlan> make(TOtherPlan other)
+        {
+            return plan_enumerable<TOtherPlan>(other);
+        }
+
+        template <typename TBetter>
+        TElement extreme(TBetter better) const
+        {
+            optional<TElement> best;
+            plans::unordered(plan)([&](const TElement& element)
+            {
+                if (!best || better(*best, element)) best = element;
+                return true;
+            });
+            if (!best) throw length_error("cinq: sequence is empty");
+            return *best;
+        }
+
+        TPlan plan;
+    };
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __cinq_radix_hpp__
+#define __cinq_radix_hpp__
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Stable least-significant-digit radix sort for order_by() keys made of integers and
+// floating point numbers. Each key is encoded into a big-endian byte string whose unsigned
+// lexicographic order is the order of the key, so a tuple of keys becomes the
+// concatenation of its members' encodings.
+
+namespace cinq
+{
+    namespace radix
+    {
+        using namespace std;
+
+        /**
+         * @brief Shortest sequence worth radix sorting. Below it the fixed cost of the
+         * histograms outweighs the comparisons saved.
+         */
+        constexpr size_t threshold = 1024;
+
+        /**
+         * @brief true for the key types that can be encoded: integers, bool, float and double.
+         */
+        template <typename T>
+        constexpr bool encodable = is_integral<T>::value || is_same<T, float>::value || is_same<T, double>::value;
+
+        template <typename TKey>
+        struct key_traits
+        {
+            static constexpr bool sortable = encodable<TKey>;
+            static constexpr size_t width = sizeof(TKey);
+        };
+
+        template <typename ... TKeys>
+        struct key_traits<tuple<TKeys...>>
+        {
+            static constexpr bool sortable = (encodable<TKeys> && ...);
+            static constexpr size_t width = (sizeof(TKeys) + ... + 0);
+        };
+
+        /**
+         * @brief true for keys radix sort can order: an encodable type, or a tuple of them.
+         */
+        template <typename TKey>
+        constexpr bool sortable = key_traits<TKey>::sortable;
+
+        /**
+         * @brief number of bytes a key encodes to.
+         */
+        template <typename TKey>
+        constexpr size_t width = key_traits<TKey>::width;
+
+        template <typename TUnsigned>
+        void write_big_endian(TUnsigned bits, uint8_t* out)
+        {
+            for (size_t i = sizeof(TUnsigned); i > 0; i--)
+            {
+                out[i - 1] = (uint8_t)bits;
+                bits = (TUnsigned)(bits >> 8);
+            }
+        }
+
+        inline void encode(bool value, uint8_t* out)
+        {
+            out[0] = value ? 1 : 0;
+        }
+
+        // Flipping the sign bit of a two's complement integer puts negative numbers first.
+        template <typename T>
+        requires is_integral<T>::value
+        void encode(T value, uint8_t* out)
+        {
+            using TUnsigned = typename make_unsigned<T>::type;
+            TUnsigned bits = (TUnsigned)value;
+            if (is_signed<T>::value) bits ^= (TUnsigned)((TUnsigned)1 << (sizeof(T) * 8 - 1));
+            write_big_endian(bits, out);
+        }
+
+        // Positive floats already order like their bit patterns once the sign bit is set.
+        // Negative floats order backwards, so all their bits are flipped.
+        template <typename T>
+        requires is_floating_point<T>::value
+        void encode(T value, uint8_t* out)
+        {
+            using TUnsigned = typename conditional<sizeof(T) == 4, uint32_t, uint64_t>::type;
+            constexpr TUnsigned sign = (TUnsigned)1 << (sizeof(T) * 8 - 1);
+
+            // -0.0 compares equal to 0.0, so it must encode the same.
+            if (value == 0) value = 0;
+
+            TUnsigned bits;
+            memcpy(&bits, &value, sizeof(T));
+            bits = (bits & sign) ? ~bits : bits | sign;
+            write_big_endian(bits, out);
+        }
+
+        template <typename ... TKeys, size_t ... I>
+        void encode_members(const tuple<TKeys...>& keys, uint8_t* out, index_sequence<I...>)
+        {
+            size_t offsets[] = { 0, sizeof(TKeys)... };
+            for (size_t i = 1; i < sizeof...(TKeys); i++) offsets[i] += offsets[i - 1];
+            (encode(get<I>(keys), out + offsets[I]), ...);
+        }
+
+        template <typename ... TKeys>
+        void encode(const tuple<TKeys...>& keys, uint8_t* out)
+        {
+            encode_members(keys, out, index_sequence_for<TKeys...>());
+        }
+
+        /**
+         * @brief Sorts (encoded key, index) pairs by key, one byte per pass starting from the
+         * least significant. Each pass is a stable counting sort, so equal keys keep the order
+         * they came in. Bytes that are the same in every key are skipped.
+         */
+        template <size_t Width>
+        void sort(pair<array<uint8_t, Width>, size_t>* first, pair<array<uint8_t, Width>, size_t>* last)
+        {
+            size_t length = last - first;
+            if (length == 0) return;
+
+            // One histogram per byte position, all filled in a single pass.
+            vector<array<size_t, 256>> counts(Width);
+            for (auto& count : counts) count.fill(0);
+            for (auto item = first; item != last; ++item)
+            {
+                for (size_t b = 0; b < Width; b++) counts[b][item->first[b]]++;
+            }
+
+            // Passes go back and forth between the items and the scratch buffer.
+            vector<pair<array<uint8_t, Width>, size_t>> scratch(length);
+            auto from = first;
+            auto to = scratch.data();
+            for (size_t b = Width; b > 0; b--)
+            {
+                auto& count = counts[b - 1];
+                if (count[from[0].first[b - 1]] == length) continue;
+
+                size_t offset = 0;
+                for (auto& bucket : count)
+                {
+                    size_t size = bucket;
+                    bucket = offset;
+                    offset += size;
+                }
+                for (size_t i = 0; i < length; i++) to[count[from[i].first[b - 1]]++] = from[i];
+                swap(from, to);
+            }
+            if (from != first) copy(from, from + length, first);
+        }
+
+        template <size_t Width>
+        void sort(vector<pair<array<uint8_t, Width>, size_t>>& items)
+        {
+            sort(items.data(), items.data() + items.size());
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,627 @@
+#ifndef __cinq_simd_hpp__
+#define __cinq_simd_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CINQ_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Vectorized reductions over contiguous arrays of int, float and double. On x86 the
+// kernels come in SSE2 and AVX2 flavours and the AVX2 one is picked at run time when the
+// CPU has it. Elsewhere a portable loop with the same accumulator layout is used.
+//
+// Every kernel keeps four independent accumulators so consecutive additions or
+// comparisons do not wait on each other. Floating point sums are therefore added in a
+// different order than a plain loop would, which can change the last bits of the result.
+//
+// The filter kernels compare a whole vector of elements with a bound at once and pack the
+// ones that pass to the front of the output, with no branch per element: AVX-512 stores
+// them with a compressing store, AVX2 reorders the vector with a lookup table before a
+// full store, and the portable loop writes every element and advances the output by the
+// result of its comparison.
+
+namespace cinq
+{
+    namespace simd
+    {
+        using namespace std;
+
+        /**
+         * @brief true for the element types the kernels handle.
+         */
+        template <typename T>
+        constexpr bool vectorizable_type = is_same<T, int>::value || is_same<T, float>::value || is_same<T, double>::value;
+
+        /**
+         * @brief true for iterators over elements stored next to each other in memory:
+         * pointers and the iterators of vector and string.
+         */
+        template <typename TIter>
+        struct is_contiguous_iterator : false_type {};
+
+        template <typename T>
+        struct is_contiguous_iterator<T*> : true_type {};
+
+        template <typename T, typename TContainer>
+        struct is_contiguous_iterator<__gnu_cxx::__normal_iterator<T*, TContainer>> : true_type {};
+
+        /**
+         * @brief Iterators whose elements the kernels can read directly from memory.
+         */
+        template <typename TIter>
+        concept bool Vectorizable_iterator()
+        {
+            return is_contiguous_iterator<TIter>::value
+                && vectorizable_type<typename remove_cv<typename iterator_traits<TIter>::value_type>::type>;
+        }
+
+        /**
+         * @brief Address of the element an iterator of a non-empty contiguous range points to.
+         */
+        template <typename TIter>
+        auto address(TIter iter)
+        {
+            return std::addressof(*iter);
+        }
+
+        struct sum_op
+        {
+            template <typename T> T operator()(T a, T b) const { return a + b; }
+        };
+
+        struct min_op
+        {
+            template <typename T> T operator()(T a, T b) const { return b < a ? b : a; }
+        };
+
+        struct max_op
+        {
+            template <typename T> T operator()(T a, T b) const { return a < b ? b : a; }
+        };
+
+        namespace portable
+        {
+            template <typename T, typename TOp>
+            T reduce(const T* p, size_t n, T init, TOp op)
+            {
+                size_t i = 0;
+                if (n >= 4)
+                {
+                    T a0 = p[0], a1 = p[1], a2 = p[2], a3 = p[3];
+                    for (i = 4; i + 4 <= n; i += 4)
+                    {
+                        a0 = op(a0, p[i]);
+                        a1 = op(a1, p[i + 1]);
+                        a2 = op(a2, p[i + 2]);
+                        a3 = op(a3, p[i + 3]);
+                    }
+                    init = op(init, op(op(a0, a1), op(a2, a3)));
+                }
+                for (; i < n; i++) init = op(init, p[i]);
+                return init;
+            }
+
+            template <typename T, typename TCompare>
+            size_t filter(const T* p, size_t n, TCompare compare, T bound, T* out)
+            {
+                size_t kept = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    T element = p[i];
+                    out[kept] = element;
+                    kept += compare(element, bound);
+                }
+                return kept;
+            }
+
+            template <typename T, typename TCompare>
+            size_t filter_rows(const T* p, size_t n, TCompare compare, T bound, size_t first, size_t* rows)
+            {
+                size_t kept = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    rows[kept] = first + i;
+                    kept += compare(p[i], bound);
+                }
+                return kept;
+            }
+        }
+
+#ifdef CINQ_SIMD_X86
+
+        // The _CMP_ predicate of each comparison for floating point vectors. All are ordered,
+        // false when either side is NaN, except not_equal_to, which is true then as in C++.
+        template <typename TCompare> constexpr int float_predicate = 0;
+        template <> constexpr int float_predicate<less<>> = _CMP_LT_OQ;
+        template <> constexpr int float_predicate<less_equal<>> = _CMP_LE_OQ;
+        template <> constexpr int float_predicate<greater<>> = _CMP_GT_OQ;
+        template <> constexpr int float_predicate<greater_equal<>> = _CMP_GE_OQ;
+        template <> constexpr int float_predicate<equal_to<>> = _CMP_EQ_OQ;
+        template <> constexpr int float_predicate<not_equal_to<>> = _CMP_NEQ_UQ;
+
+        template <typename TCompare> constexpr int int_predicate = 0;
+        template <> constexpr int int_predicate<less<>> = _MM_CMPINT_LT;
+        template <> constexpr int int_predicate<less_equal<>> = _MM_CMPINT_LE;
+        template <> constexpr int int_predicate<greater<>> = _MM_CMPINT_NLE;
+        template <> constexpr int int_predicate<greater_equal<>> = _MM_CMPINT_NLT;
+        template <> constexpr int int_predicate<equal_to<>> = _MM_CMPINT_EQ;
+        template <> constexpr int int_predicate<not_equal_to<>> = _MM_CMPINT_NE;
+
+        /**
+         * @brief Entry m lists the lanes whose bit is set in m, one byte each and in order,
+         * as the permutation which packs those lanes of an eight lane vector to its front.
+         */
+        struct compress_table
+        {
+            uint64_t lanes[256];
+
+            constexpr compress_table() : lanes()
+            {
+                for (unsigned mask = 0; mask < 256; mask++)
+                {
+                    unsigned kept = 0;
+                    for (uint64_t lane = 0; lane < 8; lane++)
+                    {
+                        if (mask & (1u << lane)) lanes[mask] |= lane << (8 * kept++);
+                    }
+                }
+            }
+        };
+
+        constexpr compress_table compress_lanes;
+
+        // The same kernel is written once per instruction set because the target
+        // attribute of a function cannot be a template parameter.
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+        namespace sse2
+        {
+            inline __m128i load(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+            inline __m128 load(const float* p) { return _mm_loadu_ps(p); }
+            inline __m128d load(const double* p) { return _mm_loadu_pd(p); }
+
+            inline void store(int* p, __m128i v) { _mm_storeu_si128((__m128i*)p, v); }
+            inline void store(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+            inline void store(double* p, __m128d v) { _mm_storeu_pd(p, v); }
+
+            inline __m128i combine(sum_op, __m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+            inline __m128 combine(sum_op, __m128 a, __m128 b) { return _mm_add_ps(a, b); }
+            inline __m128d combine(sum_op, __m128d a, __m128d b) { return _mm_add_pd(a, b); }
+
+            // SSE2 has no packed 32-bit integer min and max, so select with a comparison mask.
+            inline __m128i combine(min_op, __m128i a, __m128i b)
+            {
+                __m128i greater = _mm_cmpgt_epi32(a, b);
+                return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+            }
+            inline __m128 combine(min_op, __m128 a, __m128 b) { return _mm_min_ps(a, b); }
+            inline __m128d combine(min_op, __m128d a, __m128d b) { return _mm_min_pd(a, b); }
+
+            inline __m128i combine(max_op, __m128i a, __m128i b)
+            {
+                __m128i greater = _mm_cmpgt_epi32(a, b);
+                return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+            }
+            inline __m128 combine(max_op, __m128 a, __m128 b) { return _mm_max_ps(a, b); }
+            inline __m128d combine(max_op, __m128d a, __m128d b) { return _mm_max_pd(a, b); }
+
+            template <typename T, typename TOp>
+            T reduce(const T* p, size_t n, T init, TOp op)
+            {
+                constexpr size_t lanes = 16 / sizeof(T);
+                size_t i = 0;
+                if (n >= 4 * lanes)
+                {
+                    auto a0 = load(p), a1 = load(p + lanes), a2 = load(p + 2 * lanes), a3 = load(p + 3 * lanes);
+                    for (i = 4 * lanes; i + 4 * lanes <= n; i += 4 * lanes)
+                    {
+                        a0 = combine(op, a0, load(p + i));
+                        a1 = combine(op, a1, load(p + i + lanes));
+                        a2 = combine(op, a2, load(p + i + 2 * lanes));
+                        a3 = combine(op, a3, load(p + i + 3 * lanes));
+                    }
+
+                    T folded[lanes];
+                    store(folded, combine(op, combine(op, a0, a1), combine(op, a2, a3)));
+                    for (size_t lane = 0; lane < lanes; lane++) init = op(init, folded[lane]);
+                }
+                for (; i < n; i++) init = op(init, p[i]);
+                return init;
+            }
+
+            inline uint64_t pack_bits(const unsigned char* bytes)
+            {
+                uint64_t bits = 0;
+                for (int part = 0; part < 4; part++)
+                {
+                    __m128i set = _mm_sub_epi8(_mm_setzero_si128(), _mm_loadu_si128((const __m128i*)(bytes + part * 16)));
+                    bits |= (uint64_t)(uint32_t)_mm_movemask_epi8(set) << (part * 16);
+                }
+                return bits;
+            }
+        }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+        namespace avx2
+        {
+            inline __m256i load(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+            inline __m256 load(const float* p) { return _mm256_loadu_ps(p); }
+            inline __m256d load(const double* p) { return _mm256_loadu_pd(p); }
+
+            inline void store(int* p, __m256i v) { _mm256_storeu_si256((__m256i*)p, v); }
+            inline void store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+            inline void store(double* p, __m256d v) { _mm256_storeu_pd(p, v); }
+
+            inline __m256i combine(sum_op, __m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+            inline __m256 combine(sum_op, __m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+            inline __m256d combine(sum_op, __m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+
+            inline __m256i combine(min_op, __m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+            inline __m256 combine(min_op, __m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+            inline __m256d combine(min_op, __m256d a, __m256d b) { return _mm256_min_pd(a, b); }
+
+            inline __m256i combine(max_op, __m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+            inline __m256 combine(max_op, __m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+            inline __m256d combine(max_op, __m256d a, __m256d b) { return _mm256_max_pd(a, b); }
+
+            template <typename T, typename TOp>
+            T reduce(const T* p, size_t n, T init, TOp op)
+            {
+                constexpr size_t lanes = 32 / sizeof(T);
+                size_t i = 0;
+                if (n >= 4 * lanes)
+                {
+                    auto a0 = load(p), a1 = load(p + lanes), a2 = load(p + 2 * lanes), a3 = load(p + 3 * lanes);
+                    for (i = 4 * lanes; i + 4 * lanes <= n; i += 4 * lanes)
+                    {
+                        a0 = combine(op, a0, load(p + i));
+                        a1 = combine(op, a1, load(p + i + lanes));
+                        a2 = combine(op, a2, load(p + i + 2 * lanes));
+                        a3 = combine(op, a3, load(p + i + 3 * lanes));
+                    }
+
+                    T folded[lanes];
+                    store(folded, combine(op, combine(op, a0, a1), combine(op, a2, a3)));
+                    for (size_t lane = 0; lane < lanes; lane++) init = op(init, folded[lane]);
+                }
+                for (; i < n; i++) init = op(init, p[i]);
+                return init;
+            }
+
+            inline __m256i broadcast(int value) { return _mm256_set1_epi32(value); }
+            inline __m256 broadcast(float value) { return _mm256_set1_ps(value); }
+            inline __m256d broadcast(double value) { return _mm256_set1_pd(value); }
+
+            // One bit per lane, set where the comparison holds.
+            template <typename TCompare>
+            unsigned compare_mask(TCompare, __m256 v, __m256 bound) { return _mm256_movemask_ps(_mm256_cmp_ps(v, bound, float_predicate<TCompare>)); }
+
+            template <typename TCompare>
+            unsigned compare_mask(TCompare, __m256d v, __m256d bound) { return _mm256_movemask_pd(_mm256_cmp_pd(v, bound, float_predicate<TCompare>)); }
+
+            inline unsigned lane_bits(__m256i v) { return _mm256_movemask_ps(_mm256_castsi256_ps(v)); }
+            inline unsigned compare_mask(less<>, __m256i v, __m256i bound) { return lane_bits(_mm256_cmpgt_epi32(bound, v)); }
+            inline unsigned compare_mask(greater<>, __m256i v, __m256i bound) { return lane_bits(_mm256_cmpgt_epi32(v, bound)); }
+            inline unsigned compare_mask(equal_to<>, __m256i v, __m256i bound) { return lane_bits(_mm256_cmpeq_epi32(v, bound)); }
+            inline unsigned compare_mask(less_equal<>, __m256i v, __m256i bound) { return ~compare_mask(greater<>(), v, bound) & 0xff; }
+            inline unsigned compare_mask(greater_equal<>, __m256i v, __m256i bound) { return ~compare_mask(less<>(), v, bound) & 0xff; }
+            inline unsigned compare_mask(not_equal_to<>, __m256i v, __m256i bound) { return ~compare_mask(equal_to<>(), v, bound) & 0xff; }
+
+            inline __m256i permute(__m256i v, __m256i order) { return _mm256_permutevar8x32_epi32(v, order); }
+            inline __m256 permute(__m256 v, __m256i order) { return _mm256_permutevar8x32_ps(v, order); }
+            inline __m256d permute(__m256d v, __m256i order) { return _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(v), order)); }
+
+            // The permutation which packs the lanes set in mask to the front. A double takes two
+            // of the eight 32 bit lanes the table is written for, so its bits are doubled first.
+            template <typename T>
+            __m256i compress_order(unsigned mask)
+            {
+                if (sizeof(T) == 8) mask = ((mask & 1) | (mask & 2) << 1 | (mask & 4) << 2 | (mask & 8) << 3) * 3;
+                return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&compress_lanes.lanes[mask]));
+            }
+
+            template <typename T, typename TCompare>
+            size_t filter(const T* p, size_t n, TCompare compare, T bound, T* out)
+            {
+                constexpr size_t lanes = 32 / sizeof(T);
+                auto bounds = broadcast(bound);
+                size_t kept = 0, i = 0;
+                for (; i + lanes <= n; i += lanes)
+                {
+                    // The full store stays inside out, since kept never passes i.
+                    auto v = load(p + i);
+                    unsigned mask = compare_mask(compare, v, bounds);
+                    store(out + kept, permute(v, compress_order<T>(mask)));
+                    kept += __builtin_popcount(mask);
+                }
+                return kept + portable::filter(p + i, n - i, compare, bound, out + kept);
+            }
+
+            template <typename T, typename TCompare>
+            size_t filter_rows(const T* p, size_t n, TCompare compare, T bound, size_t first, size_t* rows)
+            {
+                constexpr size_t lanes = 32 / sizeof(T);
+                auto bounds = broadcast(bound);
+                size_t kept = 0, i = 0;
+                for (; i + lanes <= n; i += lanes)
+                {
+                    unsigned mask = compare_mask(compare, load(p + i), bounds);
+                    for (size_t lane = 0; lane < lanes; lane++)
+                    {
+                        rows[kept] = first + i + lane;
+                        kept += (mask >> lane) & 1;
+                    }
+                }
+                return kept + portable::filter_rows(p + i, n - i, compare, bound, first + i, rows + kept);
+            }
+        }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+        namespace avx512
+        {
+            inline __m512i load(const int* p) { return _mm512_loadu_si512(p); }
+            inline __m512 load(const float* p) { return _mm512_loadu_ps(p); }
+            inline __m512d load(const double* p) { return _mm512_loadu_pd(p); }
+
+            inline __m512i broadcast(int value) { return _mm512_set1_epi32(value); }
+            inline __m512 broadcast(float value) { return _mm512_set1_ps(value); }
+            inline __m512d broadcast(double value) { return _mm512_set1_pd(value); }
+
+            template <typename TCompare>
+            unsigned compare_mask(TCompare, __m512i v, __m512i bound) { return _mm512_cmp_epi32_mask(v, bound, int_predicate<TCompare>); }
+
+            template <typename TCompare>
+            unsigned compare_mask(TCompare, __m512 v, __m512 bound) { return _mm512_cmp_ps_mask(v, bound, float_predicate<TCompare>); }
+
+            template <typename TCompare>
+            unsigned compare_mask(TCompare, __m512d v, __m512d bound) { return _mm512_cmp_pd_mask(v, bound, float_predicate<TCompare>); }
+
+            inline void compress(int* out, unsigned mask, __m512i v) { _mm512_mask_compressstoreu_epi32(out, mask, v); }
+            inline void compress(float* out, unsigned mask, __m512 v) { _mm512_mask_compressstoreu_ps(out, mask, v); }
+            inline void compress(double* out, unsigned mask, __m512d v) { _mm512_mask_compressstoreu_pd(out, mask, v); }
+
+            template <typename T, typename TCompare>
+            size_t filter(const T* p, size_t n, TCompare compare, T bound, T* out)
+            {
+                constexpr size_t lanes = 64 / sizeof(T);
+                auto bounds = broadcast(bound);
+                size_t kept = 0, i = 0;
+                for (; i + lanes <= n; i += lanes)
+                {
+                    auto v = load(p + i);
+                    unsigned mask = compare_mask(compare, v, bounds);
+                    compress(out + kept, mask, v);
+                    kept += __builtin_popcount(mask);
+                }
+                return kept + portable::filter(p + i, n - i, compare, bound, out + kept);
+            }
+
+            template <typename T, typename TCompare>
+            size_t filter_rows(const T* p, size_t n, TCompare compare, T bound, size_t first, size_t* rows)
+            {
+                // Row numbers are 64 bits wide, so each eight lanes of the mask compress one vector of them.
+                constexpr size_t lanes = 64 / sizeof(T);
+                const __m512i steps = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+                auto bounds = broadcast(bound);
+                size_t kept = 0, i = 0;
+                for (; i + lanes <= n; i += lanes)
+                {
+                    unsigned mask = compare_mask(compare, load(p + i), bounds);
+                    for (size_t part = 0; part < lanes; part += 8)
+                    {
+                        unsigned part_mask = (mask >> part) & 0xff;
+                        __m512i numbers = _mm512_add_epi64(_mm512_set1_epi64(first + i + part), steps);
+                        _mm512_mask_compressstoreu_epi64(rows + kept, part_mask, numbers);
+                        kept += __builtin_popcount(part_mask);
+                    }
+                }
+                return kept + portable::filter_rows(p + i, n - i, compare, bound, first + i, rows + kept);
+            }
+        }
+#pragma GCC pop_options
+
+        /**
+         * @brief true if the CPU running the program supports AVX-512F.
+         */
+        inline bool has_avx512()
+        {
+            return __builtin_cpu_supports("avx512f");
+        }
+
+        /**
+         * @brief true if the CPU running the program supports AVX2. This reads a flag the
+         * runtime fills in at startup, so it is cheap enough to ask on every call.
+         */
+        inline bool has_avx2()
+        {
+            return __builtin_cpu_supports("avx2");
+        }
+
+#endif
+
+        /**
+         * @brief Folds n elements into init with op, using the widest kernel the CPU supports.
+         */
+        template <typename T, typename TOp>
+        T reduce(const T* p, size_t n, T init, TOp op)
+        {
+#ifdef CINQ_SIMD_X86
+            if (has_avx2()) return avx2::reduce(p, n, init, op);
+            return sse2::reduce(p, n, init, op);
+#else
+            return portable::reduce(p, n, init, op);
+#endif
+        }
+
+        /**
+         * @brief Copies the elements of p for which compare(element, bound) holds to out, in
+         * order, using the widest kernel the CPU supports.
+         *
+         * @param out room for n elements, which may be p itself to filter in place
+         * @return the number of elements kept
+         */
+        template <typename T, typename TCompare>
+        size_t filter(const T* p, size_t n, TCompare compare, T bound, T* out)
+        {
+#ifdef CINQ_SIMD_X86
+            if (has_avx512()) return avx512::filter(p, n, compare, bound, out);
+            if (has_avx2()) return avx2::filter(p, n, compare, bound, out);
+#endif
+            return portable::filter(p, n, compare, bound, out);
+        }
+
+        /**
+         * @brief Writes first + i for each element p[i] for which compare(p[i], bound) holds.
+         *
+         * @param rows room for n row numbers
+         * @return the number of rows kept
+         */
+        template <typename T, typename TCompare>
+        size_t filter_rows(const T* p, size_t n, TCompare compare, T bound, size_t first, size_t* rows)
+        {
+#ifdef CINQ_SIMD_X86
+            if (has_avx512()) return avx512::filter_rows(p, n, compare, bound, first, rows);
+            if (has_avx2()) return avx2::filter_rows(p, n, compare, bound, first, rows);
+#endif
+            return portable::filter_rows(p, n, compare, bound, first, rows);
+        }
+
+        /**
+         * @brief Appends the elements of p which pass the comparison to out. They are filtered
+         * a block at a time into a buffer on the stack, so out grows by the kept elements only.
+         */
+        template <typename T, typename TCompare, typename TAllocator>
+        void append_filtered(const T* p, size_t n, TCompare compare, T bound, vector<T, TAllocator>& out)
+        {
+            constexpr size_t block = 1024;
+            T kept[block];
+            for (size_t i = 0; i < n; i += block)
+            {
+                size_t count = filter(p + i, n - i < block ? n - i : block, compare, bound, kept);
+                out.insert(out.end(), kept, kept + count);
+            }
+        }
+
+        /**
+         * @brief Appends first + i for each element p[i] which passes the comparison to rows.
+         */
+        template <typename T, typename TCompare>
+        void append_filtered_rows(const T* p, size_t n, TCompare compare, T bound, size_t first, vector<size_t>& rows)
+        {
+            constexpr size_t block = 1024;
+            size_t kept[block];
+            for (size_t i = 0; i < n; i += block)
+            {
+                size_t count = filter_rows(p + i, n - i < block ? n - i : block, compare, bound, first + i, kept);
+                rows.insert(rows.end(), kept, kept + count);
+            }
+        }
+
+        /**
+         * @brief Packs 64 bytes, each 0 or 1, into the bits of a word: byte i into bit i.
+         */
+        inline uint64_t pack_bits(const unsigned char* bytes)
+        {
+#ifdef CINQ_SIMD_X86
+            return sse2::pack_bits(bytes);
+#else
+            uint64_t bits = 0;
+            for (size_t i = 0; i < 64; i++) bits |= (uint64_t)bytes[i] << i;
+            return bits;
+#endif
+        }
+
+        /**
+         * @brief sum of n elements.
+         */
+        template <typename T>
+        T sum(const T* p, size_t n)
+        {
+            return reduce(p, n, T(0), sum_op());
+        }
+
+        /**
+         * @brief smallest of n elements, where n is at least 1.
+         */
+        template <typename T>
+        T min(const T* p, size_t n)
+        {
+            return reduce(p + 1, n - 1, p[0], min_op());
+        }
+
+        /**
+         * @brief largest of n elements, where n is at least 1.
+         */
+        template <typename T>
+        T max(const T* p, size_t n)
+        {
+            return reduce(p + 1, n - 1, p[0], max_op());
+        }
+
+        /**
+         * @brief Allocator returning memory aligned to a given boundary, by default a cache
+         * line, so that vector loads never straddle two lines.
+         */
+        template <typename T, size_t Alignment = 64>
+        struct aligned_allocator
+        {
+            using value_type = T;
+
+            template <typename U>
+            struct rebind
+            {
+                using other = aligned_allocator<U, Alignment>;
+            };
+
+            aligned_allocator() = default;
+
+            template <typename U>
+            aligned_allocator(const aligned_allocator<U, Alignment>&)
+            {
+            }
+
+            T* allocate(size_t count)
+            {
+                size_t bytes = (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+                void* p = aligned_alloc(Alignment, bytes == 0 ? Alignment : bytes);
+                if (!p) throw bad_alloc();
+                return static_cast<T*>(p);
+            }
+
+            void deallocate(T* p, size_t)
+            {
+                free(p);
+            }
+
+            template <typename U>
+            bool operator==(const aligned_allocator<U, Alignment>&) const { return true; }
+
+            template <typename U>
+            bool operator!=(const aligned_allocator<U, Alignment>&) const { return false; }
+        };
+    }
+
+    /**
+     * @brief A vector whose storage starts on a cache line boundary. Pass it to from() to
+     * keep the vectorized sum(), min(), max() and average() kernels on aligned memory.
+     */
+    template <typename T>
+    using aligned_vector = std::vector<T, simd::aligned_allocator<T>>;
+}
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef __cinq_snapshot_hpp__
+#define __cinq_snapshot_hpp__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cinq_columns.hpp"
+#include "cinq_csv.hpp"
+#include "cinq_enumerable.hpp"
+#include "cinq_lazy.hpp"
+#include "cinq_mapped_file.hpp"
+
+// Snapshots store records on disk one column at a time, so that a dataset parsed once can
+// be reopened without parsing it again:
+//
+//     auto days = cinq::schema(cinq::column("temp_max", &weather_point::temp_max),
+//                              cinq::column("cloud_cover", &weather_point::cloud_cover));
+//     days.save("weather.snapshot", weather);
+//     auto reopened = days.open("weather.snapshot");
+//     int hottest = cinq::from(reopened).max(&weather_point::temp_max);
+//
+// Columns are named with cinq::column(), as for from_csv(). Members are stored as numbers:
+// arithmetic types, bools and enums as they are, and other types through a specialization
+// of cinq::column_storage which converts them to a number.
+// A snapshot file starts with a header giving the number of rows and, for each column, its
+// name, element type and position. Each column follows as one contiguous array starting on
+// a page boundary. Numbers are stored little-endian, as they are in memory on the machines
+// cinq runs on, so opening a snapshot maps the file and checks its header without reading
+// or converting the columns: queries read the mapped arrays in place.
+
+namespace cinq
+{
+    namespace snapshots
+    {
+        using namespace std;
+
+        constexpr char magic[8] = { 'C', 'I', 'N', 'Q', 'S', 'N', 'A', 'P' };
+        constexpr uint32_t version = 1;
+        constexpr size_t page_size = 4096;
+
+        /**
+         * @brief What the values of a column are, recorded so that a column is never read
+         * back as a different type of the same width.
+         */
+        enum class kind : uint32_t { signed_integer, unsigned_integer, floating_point, boolean };
+
+        template <typename T, bool = is_enum<T>::value>
+        constexpr kind kind_of = is_same<T, bool>::value ? kind::boolean
+                               : is_floating_point<T>::value ? kind::floating_point
+                               : is_signed<T>::value ? kind::signed_integer
+                               : kind::unsigned_integer;
+
+        // Enums are stored as their underlying integers.
+        template <typename T>
+        constexpr kind kind_of<T, true> = kind_of<typename underlying_type<T>::type>;
+
+        /**
+         * @brief true for the types a column of a snapshot can hold as they are.
+         */
+        template <typename T>
+        constexpr bool storable = is_arithmetic<T>::value || is_enum<T>::value;
+
+        inline size_t align(size_t offset)
+        {
+            return (offset + page_size - 1) / page_size * page_size;
+        }
+
+        template <typename T>
+        void put(string& header, T value)
+        {
+            header.append((const char*)&value, sizeof(T));
+        }
+
+        template <typename T>
+        T take(const char*& at, const char* end, const string& path)
+        {
+            if ((size_t)(end - at) < sizeof(T)) throw invalid_argument("cinq: " + path + " has a truncated snapshot header");
+            T value;
+            memcpy(&value, at, sizeof(T));
+            at += sizeof(T);
+            return value;
+        }
+
+        inline void check_byte_order()
+        {
+            static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "cinq: snapshots are read in place, which needs a little-endian machine");
+        }
+    }
+
+    /**
+     * @brief A data member of a record stored as one column of a snapshot. Made by
+     * cinq::schema() from the columns it is given.
+     */
+    template <typename TRecord, typename TField>
+    struct snapshot_field
+    {
+        using type = TField;
+
+        string name;
+        TField TRecord::* member;
+    };
+
+    /**
+     * @brief The records of a snapshot file, read in place from the mapped columns. Iterating
+     * yields records rebuilt from the columns of their row, when the schema stores every
+     * member of the record; column() gives direct access to the array of one member. Copies
+     * share the same mapping, which stays open until the last of them is gone.
+     */
+    template <typename TRecord, typename ... TFields>
+    class snapshot : public column_table<TRecord, TFields...>
+    {
+    public:
+        /**
+         * @brief Maps a snapshot file and finds the column of each field in it.
+         */
+        snapshot(const string& path, const tuple<snapshot_field<TRecord, TFields>...>& fields)
+            : column_table<TRecord, TFields...>(apply([](const auto& ... field) { return make_tuple(field.member...); }, fields)),
+              file(make_shared<mapped_file>(path)), fields(fields)
+        {
+            snapshots::check_byte_order();
+
+            const char* at = file->begin();
+            const char* end = file->end();
+            if (file->size() < sizeof(snapshots::magic) || memcmp(at, snapshots::magic, sizeof(snapshots::magic)) != 0)
+            {
+                throw invalid_argument("cinq: " + path + " is not a snapshot");
+            }
+            at += sizeof(snapshots::magic);
+
+            uint32_t file_version = snapshots::take<uint32_t>(at, end, path);
+            if (file_version != snapshots::version)
+            {
+                throw invalid_argument("cinq: " + path + " is a version " + to_string(file_version) + " snapshot, expected version "
+                                       + to_string(snapshots::version));
+            }
+
+            uint32_t count = snapshots::take<uint32_t>(at, end, path);
+            this->rows = snapshots::take<uint64_t>(at, end, path);
+
+            vector<entry> entries(count);
+            for (entry& column : entries)
+            {
+                column.offset = snapshots::take<uint64_t>(at, end, path);
+                column.type = (snapshots::kind)snapshots::take<uint32_t>(at, end, path);
+                column.width = snapshots::take<uint32_t>(at, end, path);
+                uint32_t name_length = snapshots::take<uint32_t>(at, end, path);
+                if ((size_t)(end - at) < name_length) throw invalid_argument("cinq: " + path + " has a truncated snapshot header");
+                column.name.assign(at, name_length);
+                at += name_length;
+
+                bool fits = column.width > 0 && column.offset <= file->size() && this->rows <= (file->size() - column.offset) / column.width;
+                if (column.offset % snapshots::page_size != 0 || (this->rows > 0 && !fits))
+                {
+                    throw invalid_argument("cinq: " + path + " column " + column.name + " lies outside the file");
+                }
+            }
+
+            find_columns(path, entries, index_sequence_for<TFields...>());
+        }
+
+    private:
+        struct entry
+        {
+            uint64_t offset;
+            snapshots::kind type;
+            uint32_t width;
+            string name;
+        };
+
+        template <size_t ... I>
+        void find_columns(const string& path, const vector<entry>& entries, index_sequence<I...>)
+        {
+            (find_column<I>(path, entries), ...);
+        }
+
+        template <size_t I>
+        void find_column(const string& path, const vector<entry>& entries)
+        {
+            using TStored = stored_t<typename tuple_element<I, tuple<TFields...>>::type>;
+            const string& name = get<I>(fields).name;
+
+            for (const entry& column : entries)
+            {
+                if (column.name != name) continue;
+                if (column.type != snapshots::kind_of<TStored> || column.width != sizeof(TStored))
+                {
+                    throw invalid_argument("cinq: " + path + " column " + name + " does not hold values of its field's type");
+                }
+                this->template set_column<I>(this->rows > 0 ? (const TStored*)(file->begin() + column.offset) : nullptr);
+                return;
+            }
+            throw invalid_argument("cinq: " + path + " has no column named " + name);
+        }
+
+        shared_ptr<mapped_file> file;
+        tuple<snapshot_field<TRecord, TFields>...> fields;
+    };
+
+    /**
+     * @brief The fields of a record type stored in a snapshot, which saves records to
+     * snapshot files and opens them again. Made by cinq::schema().
+     */
+    template <typename TRecord, typename ... TFields>
+    class snapshot_schema
+    {
+    public:
+        explicit snapshot_schema(snapshot_field<TRecord, TFields> ... fields) : fields(fields...)
+        {
+        }
+
+        /**
+         * @brief Writes the fields of some records to a snapshot file. The file is written
+         * under a temporary name and then renamed, so that a snapshot being replaced is
+         * never seen half written.
+         *
+         * @param path the file to write
+         * @param records a container of records
+         */
+        template <typename TRange>
+        requires Range<TRange>()
+        void save(const string& path, const TRange& records) const
+        {
+            snapshots::check_byte_order();
+            size_t rows = distance(std::begin(records), std::end(records));
+
+            // Every column is in the header, so its size gives where the first column starts.
+            size_t header_size = sizeof(snapshots::magic) + sizeof(uint32_t) * 2 + sizeof(uint64_t);
+            for_each_field([&](const auto& field)
+            {
+                header_size += sizeof(uint64_t) + sizeof(uint32_t) * 3 + field.name.size();
+            });
+
+            string header(snapshots::magic, sizeof(snapshots::magic));
+            snapshots::put<uint32_t>(header, snapshots::version);
+            snapshots::put<uint32_t>(header, sizeof...(TFields));
+            snapshots::put<uint64_t>(header, rows);
+
+            size_t offset = snapshots::align(header_size);
+            for_each_field([&](const auto& field)
+            {
+                using TStored = stored_t<typename decay<decltype(field)>::type::type>;
+                snapshots::put<uint64_t>(header, offset);
+                snapshots::put<uint32_t>(header, (uint32_t)snapshots::kind_of<TStored>);
+                snapshots::put<uint32_t>(header, sizeof(TStored));
+                snapshots::put<uint32_t>(header, field.name.size());
+                header += field.name;
+                offset = snapshots::align(offset + rows * sizeof(TStored));
+            });
+
+            string temporary = path + ".tmp";
+            {
+                ofstream out(temporary, ios::binary | ios::trunc);
+                if (!out) throw runtime_error("cinq: cannot write " + temporary);
+
+                out.write(header.data(), header.size());
+                size_t written = header.size();
+                for_each_field([&](const auto& field)
+                {
+                    // Gathered as bytes, since vector<bool> does not store bools.
+                    using TField = typename decay<decltype(field)>::type::type;
+                    using TStored = stored_t<TField>;
+                    vector<char> values(rows * sizeof(TStored));
+                    char* value = values.data();
+                    for (const auto& record : records)
+                    {
+                        TStored stored = column_storage<TField>::store(record.*(field.member));
+                        memcpy(value, &stored, sizeof(TStored));
+                        value += sizeof(TStored);
+                    }
+
+                    pad(out, written);
+                    out.write(values.data(), values.size());
+                    written += values.size();
+                });
+                pad(out, written);
+                if (!out) throw runtime_error("cinq: cannot write " + temporary);
+            }
+
+            if (rename(temporary.c_str(), path.c_str()) != 0)
+            {
+                remove(temporary.c_str());
+                throw runtime_error("cinq: cannot replace " + path);
+            }
+        }
+
+        /**
+         * @brief Writes the result of a query to a snapshot file.
+         */
+        template <typename TSource, typename TElement, typename TIter>
+        void save(const string& path, enumerable<TSource, TElement, TIter> query) const
+        {
+            vector<TElement> records = std::move(query).to_vector();
+            save(path, records);
+        }
+
+        /**
+         * @brief Opens a snapshot file written with the same fields. Only the header is read:
+         * the columns are mapped and read as queries reach them.
+         */
+        snapshot<TRecord, TFields...> open(const string& path) const
+        {
+            return snapshot<TRecord, TFields...>(path, fields);
+        }
+
+    private:
+        template <typename TFunc>
+        void for_each_field(TFunc func) const
+        {
+            apply([&](const auto& ... field) { (func(field), ...); }, fields);
+        }
+
+        // Zeroes up to the next page boundary, where the next column starts.
+        static void pad(ofstream& out, size_t& written)
+        {
+            string zeros(snapshots::align(written) - written, '\0');
+            out.write(zeros.data(), zeros.size());
+            written += zeros.size();
+        }
+
+        tuple<snapshot_field<TRecord, TFields>...> fields;
+    };
+
+    /**
+     * @brief Describes the fields of a record type to store in snapshot files. Each member
+     * must be a number, a bool or an enum, or have a column_storage specialization which
+     * keeps it as one. Pointers and structs holding them are refused, since they would not
+     * mean anything once read back from the file.
+     *
+     * @param columns the members to store, each bound to a name with cinq::column(name, member)
+     */
+    template <typename TRecord, typename ... TFields>
+    requires (snapshots::storable<stored_t<TFields>> && ...)
+    snapshot_schema<TRecord, TFields...> schema(csv::column_binding<csv::field_parser<TRecord, TFields>> ... columns)
+    {
+        return snapshot_schema<TRecord, TFields...>(snapshot_field<TRecord, TFields> { std::move(columns.name), columns.parse.field }...);
+    }
+}
+
+#endif
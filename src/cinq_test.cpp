@@ -45,6 +45,7 @@ void test_performance()
     for (test_perf t : tests)
     {
         printf("[%4d] %dx %s\n", t.func(), t.runs, t.name.c_str());
+        if (t.report) printf("       %s\n", t.report().c_str());
     }
 }
 
@@ -694,6 +695,15 @@ vector<test> make_tests()
         return (result == nums[2]); // 4.2
     }));
     
+    tests.push_back(test("max() on negative doubles std::list", []
+    {
+        list<double> nums { -1.5, -2.5 };
+        auto identity = [](double x) { return x; };
+        return cinq::from(nums).max() == -1.5
+            && cinq::from(nums).max(identity) == -1.5
+            && cinq::from(nums).min(identity) == -2.5;
+    }));
+    
     tests.push_back(test("max() on strings with mapping function", []
     {
         vector<string> authors { "kevin chen", "jonathan barrios", "jonathan wong" };
@@ -774,5 +784,1336 @@ vector<test> make_tests()
                && (result == (nums[0]*nums[0] + nums[1]*nums[1] + nums[2]*nums[2] + nums[3]*nums[3] + nums[4]*nums[4] + nums[5]*nums[5]) / nums.size());
     }));
     
+    tests.push_back(test("lazy() where().select() std::vector", []
+    {
+        std::vector<int> my_vector { 1, 4, 6, 3, -6, 0, -3, 2 };
+        auto result = cinq::from(my_vector)
+                      .lazy()
+                      .where([](int x) { return x > 0; })
+                      .select([](int x) { return x * 10; })
+                      .to_vector();
+        std::vector<int> answer { 10, 40, 60, 30, 20 };
+        return (result == answer);
+    }));
+
+    tests.push_back(test("lazy() where().where().take() std::list", []
+    {
+        std::list<int> my_list { 1, 4, 6, 3, -6, 0, -3, 2 };
+        auto result = cinq::from(my_list)
+                      .lazy()
+                      .where([](int x) { return x > 0; })
+                      .where([](int x) { return x % 2 == 0; })
+                      .take(2)
+                      .to_vector();
+        std::vector<int> answer { 4, 6 };
+        return (result == answer);
+    }));
+
+    tests.push_back(test("lazy() select() only maps elements that are used", []
+    {
+        std::vector<int> my_vector { 0, 1, 2, 3, 4 };
+        int calls = 0;
+        auto result = cinq::from(my_vector)
+                      .lazy()
+                      .select([&calls](int x) { calls++; return x * x; })
+                      .skip(2)
+                      .first();
+        return (result == 4 && calls == 1);
+    }));
+
+    tests.push_back(test("lazy() select().where() maps each element once", []
+    {
+        std::vector<int> my_vector { 0, 1, 2, 3, 4, 5 };
+        int calls = 0;
+        auto result = cinq::from(my_vector)
+                      .lazy()
+                      .select([&calls](int x) { calls++; return x * x; })
+                      .where([](int x) { return x % 2 == 0; })
+                      .to_vector();
+        std::vector<int> answer { 0, 4, 16 };
+        return (result == answer && calls == 6);
+    }));
+
+    tests.push_back(test("lazy() select() returns mapped elements by value from element_at() and last()", []
+    {
+        std::vector<int> my_vector { 0, 1, 2, 3, 4, 5 };
+        auto squares = cinq::from(my_vector).lazy().select([](int x) { return std::to_string(x * x); });
+        auto odd = cinq::from(my_vector).lazy().where([](int x) { return x % 2 == 1; });
+
+        bool out_of_range = false;
+        try
+        {
+            squares.element_at(6);
+        }
+        catch (const std::out_of_range&)
+        {
+            out_of_range = true;
+        }
+
+        return squares.element_at(3) == "9" && squares.element_at(0) == "0" && squares.last() == "25"
+            && squares.last([](const std::string& s) { return s.size() == 1; }) == "9"
+            && odd.last() == 5 && odd.element_at(1) == 3 && out_of_range;
+    }));
+
+    tests.push_back(test("lazy() where().sum(), count(), any(), all()", []
+    {
+        std::vector<int> my_vector { 1, 4, 6, 3, -6, 0, -3, 2 };
+        auto positive = cinq::from(my_vector).lazy().where([](int x) { return x > 0; });
+        return positive.sum() == 16
+            && positive.count() == 5
+            && positive.count([](int x) { return x > 3; }) == 2
+            && positive.any([](int x) { return x == 6; })
+            && positive.all([](int x) { return x > 0; })
+            && positive.max() == 6;
+    }));
+
+    tests.push_back(test("order_by().where() with index std::vector", []
+    {
+        std::vector<int> my_vector { 5, 3, 9, 1, 7 };
+        auto result = cinq::from(my_vector)
+                      .order_by()
+                      .where([](int x, size_t index) { return index % 2 == 0; })
+                      .to_vector();
+        std::vector<int> answer { 1, 5, 9 };
+        return (result == answer);
+    }));
+
+    tests.push_back(test("to_vector() on lvalue keeps the enumerable usable", []
+    {
+        std::vector<int> my_vector { 5, 3, 9, 1, 7 };
+        auto query = cinq::from(my_vector).where([](int x) { return x > 2; });
+        auto first = query.to_vector();
+        auto second = query.to_vector();
+        std::vector<int> answer { 5, 3, 9, 7 };
+        return (first == answer && second == answer);
+    }));
+
+    tests.push_back(test("from(par) where().select() keeps the original order", []
+    {
+        std::vector<int> my_vector(100000);
+        for (size_t i = 0; i < my_vector.size(); i++) my_vector[i] = (i * 7919) % 1000;
+
+        auto result = cinq::from(my_vector, cinq::par(4))
+                      .where([](int x) { return x % 3 == 0; })
+                      .select([](int x, size_t index) { return x * 2 + (int)index; })
+                      .to_vector();
+
+        std::vector<int> answer;
+        for (int x : my_vector) if (x % 3 == 0) answer.push_back(x * 2 + (int)answer.size());
+        return (result == answer);
+    }));
+
+    tests.push_back(test("parallel() aggregates match sequential ones", []
+    {
+        std::vector<int> my_vector(100000);
+        for (size_t i = 0; i < my_vector.size(); i++) my_vector[i] = (int)((i * 7919) % 2001) - 1000;
+
+        auto sequential = cinq::from(my_vector);
+        auto parallel = cinq::from(my_vector).parallel(4);
+        auto big = [](int x) { return x > 990; };
+        auto small = [](int x) { return x > -1001; };
+        return parallel.sum() == sequential.sum()
+            && parallel.min() == sequential.min()
+            && parallel.max([](int x) { return x * x; }) == sequential.max([](int x) { return x * x; })
+            && parallel.average() == sequential.average()
+            && parallel.count(big) == sequential.count(big)
+            && parallel.any([](int x) { return x == 1000; })
+            && !parallel.any([](int x) { return x > 1000; })
+            && parallel.all(small)
+            && !parallel.all(big);
+    }));
+
+    tests.push_back(test("parallel() where() with index after order_by()", []
+    {
+        std::vector<int> my_vector(50000);
+        for (size_t i = 0; i < my_vector.size(); i++) my_vector[i] = (int)(my_vector.size() - i);
+
+        auto result = cinq::from(my_vector)
+                      .parallel(3)
+                      .order_by()
+                      .where([](int x, size_t index) { return index % 1000 == 0; })
+                      .to_vector();
+
+        std::vector<int> answer;
+        for (int i = 1; i <= 50000; i += 1000) answer.push_back(i);
+        return (result == answer);
+    }));
+
+    tests.push_back(test("parallel() select() running a parallel query in its mapper", []
+    {
+        std::vector<int> outer(20000);
+        for (size_t i = 0; i < outer.size(); i++) outer[i] = (int)(i % 7);
+        std::vector<int> inner(20000);
+        for (size_t i = 0; i < inner.size(); i++) inner[i] = (int)(i % 10);
+
+        auto result = cinq::from(outer, cinq::par(4))
+                      .select([&](int x) { return cinq::from(inner, cinq::par(4)).count([x](int y) { return y == x; }); })
+                      .to_vector();
+
+        return cinq::from(result).all([](size_t n) { return n == 2000; });
+    }));
+
+    tests.push_back(test("set_executor() routes parallel queries to a custom executor", []
+    {
+        struct counting_executor : cinq::executor
+        {
+            cinq::thread_pool pool { 2 };
+            std::atomic<size_t> submitted { 0 };
+
+            void submit(std::function<void()> task) override
+            {
+                submitted++;
+                pool.submit(std::move(task));
+            }
+
+            size_t concurrency() const override { return pool.concurrency(); }
+            bool try_run_one() override { return pool.try_run_one(); }
+        };
+
+        std::vector<int> my_vector(100000, 1);
+        counting_executor exec;
+        cinq::set_executor(&exec);
+        auto sum = cinq::from(my_vector, cinq::par(4)).sum();
+        cinq::set_executor(nullptr);
+
+        return (sum == 100000 && exec.submitted == 3);
+    }));
+
+    tests.push_back(test("parallel() rethrows exceptions from other threads", []
+    {
+        std::vector<int> my_vector(100000);
+        for (size_t i = 0; i < my_vector.size(); i++) my_vector[i] = (int)i;
+
+        try
+        {
+            cinq::from(my_vector, cinq::par(4)).count([](int x) -> bool
+            {
+                if (x == 99999) throw std::out_of_range("last element");
+                return true;
+            });
+        }
+        catch (std::out_of_range&)
+        {
+            return true;
+        }
+        return false;
+    }));
+
+    tests.push_back(test("vectorized sum(), min(), max() and average() match plain loops", []
+    {
+        // Lengths on both sides of every vector width and unroll factor.
+        for (size_t length = 1; length < 100; length++)
+        {
+            std::vector<int> ints(length);
+            std::vector<double> doubles(length);
+            for (size_t i = 0; i < length; i++)
+            {
+                ints[i] = (int)((i * 7919) % 201) - 100;
+                doubles[i] = ints[i] / 4.0;
+            }
+
+            int int_sum = 0, int_min = ints[0], int_max = ints[0];
+            double double_sum = 0, double_min = doubles[0], double_max = doubles[0];
+            for (size_t i = 0; i < length; i++)
+            {
+                int_sum += ints[i];
+                int_min = std::min(int_min, ints[i]);
+                int_max = std::max(int_max, ints[i]);
+                double_sum += doubles[i];
+                double_min = std::min(double_min, doubles[i]);
+                double_max = std::max(double_max, doubles[i]);
+            }
+
+            // Quarters add up exactly in any order, so the double results can be compared exactly.
+            auto i = cinq::from(ints);
+            auto d = cinq::from(doubles);
+            if (i.sum() != int_sum || i.min() != int_min || i.max() != int_max) return false;
+            if (i.average() != int_sum / (double)length) return false;
+            if (d.sum() != double_sum || d.min() != double_min || d.max() != double_max) return false;
+            if (d.average() != double_sum / length) return false;
+        }
+        return true;
+    }));
+
+    tests.push_back(test("vectorized max() on negative floats from an aligned_vector", []
+    {
+        cinq::aligned_vector<float> my_vector(1001);
+        for (size_t i = 0; i < my_vector.size(); i++) my_vector[i] = -1.0f - (float)((i * 31) % 1001);
+
+        bool aligned = (reinterpret_cast<uintptr_t>(my_vector.data()) % 64) == 0;
+        return aligned && cinq::from(my_vector).max() == -1.0f && cinq::from(my_vector).min() == -1001.0f;
+    }));
+
+    tests.push_back(test("order_by().take() matches a full stable sort", []
+    {
+        // Few distinct keys, so stability decides most of the order.
+        std::vector<std::pair<int, int>> my_vector;
+        for (int i = 0; i < 5000; i++) my_vector.push_back(std::make_pair((i * 7919) % 37, i));
+
+        auto key = [](const std::pair<int, int>& p) { return p.first; };
+        auto sorted = my_vector;
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (size_t k : { 0, 1, 5, 100, 624, 625, 5000, 6000 })
+        {
+            auto result = cinq::from(my_vector).order_by(key).take(k).to_vector();
+            std::vector<std::pair<int, int>> answer(sorted.begin(), sorted.begin() + std::min(k, sorted.size()));
+            if (result != answer) return false;
+        }
+        return true;
+    }));
+
+    tests.push_back(test("order_by() then first(), element_at() and to_vector()", []
+    {
+        std::vector<int> my_vector(1000);
+        for (size_t i = 0; i < my_vector.size(); i++) my_vector[i] = (int)((i * 7919) % 1000);
+
+        auto query = cinq::from(my_vector).where([](int x) { return x % 2 == 0; }).order_by();
+        int first = query.first();
+        int third = query.element_at(2);
+        int tenth = query.element_at(9);
+        auto all = query.to_vector();
+
+        std::vector<int> answer;
+        for (int i = 0; i < 1000; i += 2) answer.push_back(i);
+        return (first == 0 && third == 4 && tenth == 18 && all == answer);
+    }));
+
+    tests.push_back(test("element_at() std::list", []
+    {
+        std::list<int> my_list { 4, 8, 15, 16 };
+        auto my_enum = cinq::from(my_list);
+        try
+        {
+            my_enum.element_at(4);
+            return false;
+        }
+        catch (std::out_of_range&)
+        {
+        }
+        return (my_enum.element_at(0) == 4 && my_enum.element_at(3) == 16);
+    }));
+
+    tests.push_back(test("order_by() radix sorts numeric keys like stable_sort", []
+    {
+        std::vector<std::tuple<int, double, unsigned char, long long>> my_vector;
+        for (int i = 0; i < 5000; i++)
+        {
+            int a = (int)((i * 7919) % 41) - 20;
+            double b = ((i * 104729) % 13 - 6) * 0.5;
+            if (b == 0 && i % 2) b = -0.0;
+            my_vector.push_back(std::make_tuple(a, b, (unsigned char)(i % 3 * 100), (long long)(i % 5) * -3000000000LL));
+        }
+
+        auto first = [](const auto& t) { return std::get<0>(t); };
+        auto second = [](const auto& t) { return std::get<1>(t); };
+        auto third = [](const auto& t) { return std::get<2>(t); };
+        auto fourth = [](const auto& t) { return std::get<3>(t); };
+
+        auto by_first_second = my_vector;
+        std::stable_sort(by_first_second.begin(), by_first_second.end(), [&](const auto& x, const auto& y)
+        {
+            return std::make_tuple(first(x), second(x)) < std::make_tuple(first(y), second(y));
+        });
+        auto by_third_fourth = my_vector;
+        std::stable_sort(by_third_fourth.begin(), by_third_fourth.end(), [&](const auto& x, const auto& y)
+        {
+            return std::make_tuple(third(x), fourth(x)) < std::make_tuple(third(y), fourth(y));
+        });
+        auto by_second = my_vector;
+        std::stable_sort(by_second.begin(), by_second.end(), [&](const auto& x, const auto& y) { return second(x) < second(y); });
+
+        std::vector<float> floats;
+        for (int i = 0; i < 3000; i++) floats.push_back((float)((i * 7919) % 2001 - 1000) / 7.0f);
+        auto sorted_floats = floats;
+        std::stable_sort(sorted_floats.begin(), sorted_floats.end());
+
+        return cinq::from(my_vector).order_by(first, second).to_vector() == by_first_second
+            && cinq::from(my_vector).order_by(third, fourth).to_vector() == by_third_fourth
+            && cinq::from(my_vector).order_by(second).to_vector() == by_second
+            && cinq::from(floats).order_by().to_vector() == sorted_floats;
+    }));
+
+    tests.push_back(test("parallel order_by() matches a sequential stable sort", []
+    {
+        std::vector<std::pair<int, std::string>> my_vector;
+        for (int i = 0; i < 200000; i++) my_vector.push_back(std::make_pair((i * 7919) % 1009 - 500, std::to_string(i % 997)));
+
+        auto number = [](const auto& p) { return p.first; };
+        auto text = [](const auto& p) { return p.second; };
+
+        auto by_number = my_vector;
+        std::stable_sort(by_number.begin(), by_number.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+        auto by_text = my_vector;
+        std::stable_sort(by_text.begin(), by_text.end(), [](const auto& x, const auto& y) { return x.second < y.second; });
+        auto by_pair = my_vector;
+        std::stable_sort(by_pair.begin(), by_pair.end());
+
+        // Small elements are sorted and merged directly rather than through their positions.
+        std::vector<std::pair<int, int>> small;
+        for (int i = 0; i < 200000; i++) small.push_back(std::make_pair((i * 7919) % 1009 - 500, i));
+        auto small_by_number = small;
+        std::stable_sort(small_by_number.begin(), small_by_number.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+        bool small_elements_sorted = cinq::from(small, cinq::par(4)).order_by(number).to_vector() == small_by_number
+            && cinq::from(small).order_by(number).to_vector() == small_by_number
+            && cinq::from(small, cinq::par(3)).order_by_unstable(number).select(number).to_vector()
+                == cinq::from(small_by_number).select(number).to_vector();
+
+        return cinq::from(my_vector, cinq::par(4)).order_by(number).to_vector() == by_number
+            && cinq::from(my_vector, cinq::par(4)).order_by(text).to_vector() == by_text
+            && cinq::from(my_vector, cinq::par(3)).order_by().to_vector() == by_pair
+            && cinq::from(my_vector, cinq::par(4)).order_by(text).take(150000).to_vector()
+                == std::vector<std::pair<int, std::string>>(by_text.begin(), by_text.begin() + 150000)
+            && small_elements_sorted;
+    }));
+
+    tests.push_back(test("order_by_unstable() orders by the keys", []
+    {
+        std::vector<std::pair<int, std::string>> my_vector;
+        for (int i = 0; i < 100000; i++) my_vector.push_back(std::make_pair((i * 7919) % 1009, std::to_string(i % 13)));
+
+        auto sorted_keys = [](const std::vector<std::pair<int, std::string>>& v)
+        {
+            std::vector<std::string> keys;
+            for (auto& p : v) keys.push_back(p.second);
+            return std::is_sorted(keys.begin(), keys.end());
+        };
+        auto same_elements = [&](std::vector<std::pair<int, std::string>> v)
+        {
+            auto expected = my_vector;
+            std::sort(v.begin(), v.end());
+            std::sort(expected.begin(), expected.end());
+            return v == expected;
+        };
+
+        auto text = [](const auto& p) { return p.second; };
+        auto sequential = cinq::from(my_vector).order_by_unstable(text).to_vector();
+        auto parallel = cinq::from(my_vector, cinq::par(4)).order_by_unstable(text).to_vector();
+        auto whole = cinq::from(my_vector, cinq::par(4)).order_by_unstable().to_vector();
+        auto prefix = cinq::from(my_vector).order_by_unstable().take(10).to_vector();
+
+        auto expected = my_vector;
+        std::sort(expected.begin(), expected.end());
+
+        return sorted_keys(sequential) && same_elements(sequential)
+            && sorted_keys(parallel) && same_elements(parallel)
+            && whole == expected
+            && prefix == std::vector<std::pair<int, std::string>>(expected.begin(), expected.begin() + 10);
+    }));
+
+    tests.push_back(test("aggregate() matches min(), max(), average() and count()", []
+    {
+        struct reading { int day; double temperature; };
+        std::vector<reading> readings;
+        for (int i = 0; i < 50000; i++) readings.push_back(reading { i % 365, ((i * 7919) % 1001 - 500) / 10.0 });
+
+        auto temperature = [](const reading& r) { return r.temperature; };
+        auto warm = [](const reading& r) { return r.temperature > 20; };
+
+        auto separate = std::make_tuple(cinq::from(readings).min(temperature),
+                                        cinq::from(readings).max(temperature),
+                                        cinq::from(readings).average(temperature),
+                                        cinq::from(readings).count(),
+                                        cinq::from(readings).count(warm),
+                                        cinq::from(readings).sum([](const reading& r) { return r.day; }));
+
+        auto reducers = std::make_tuple(cinq::min(&reading::temperature), cinq::max(temperature), cinq::avg(temperature),
+                                        cinq::count(), cinq::count(warm), cinq::sum(&reading::day));
+        auto once = std::apply([&](auto ... r) { return cinq::from(readings).aggregate(r...); }, reducers);
+        auto parallel = std::apply([&](auto ... r) { return cinq::from(readings, cinq::par(4)).aggregate(r...); }, reducers);
+
+        auto close = [](double a, double b) { return std::abs(a - b) < 1e-9; };
+        auto same = [&](const auto& a, const auto& b)
+        {
+            return std::get<0>(a) == std::get<0>(b) && std::get<1>(a) == std::get<1>(b) && close(std::get<2>(a), std::get<2>(b))
+                && std::get<3>(a) == std::get<3>(b) && std::get<4>(a) == std::get<4>(b) && std::get<5>(a) == std::get<5>(b);
+        };
+        return same(once, separate) && same(parallel, separate);
+    }));
+
+    tests.push_back(test("aggregate() over a lazy query and an empty sequence", []
+    {
+        std::vector<int> my_vector { 1, 4, 6, 3, -6, 0, -3, 2 };
+        int mapped = 0;
+        auto result = cinq::from(my_vector)
+                      .lazy()
+                      .where([](int x) { return x > 0; })
+                      .select([&](int x) { mapped++; return x * 10; })
+                      .aggregate(cinq::min(), cinq::max(), cinq::avg(), cinq::sum(), cinq::count());
+        bool lazy_ok = result == std::make_tuple(10, 60, 32.0, 160, (size_t)5) && mapped == 5;
+
+        std::vector<int> none;
+        bool count_ok = cinq::from(none).aggregate(cinq::count(), cinq::sum()) == std::make_tuple((size_t)0, 0);
+        try
+        {
+            cinq::from(none).aggregate(cinq::count(), cinq::max());
+        }
+        catch (std::length_error&)
+        {
+            return lazy_ok && count_ok;
+        }
+        return false;
+    }));
+
+    tests.push_back(test("group_by() matches an unordered_map of vectors", []
+    {
+        std::vector<std::pair<int, double>> readings;
+        for (int i = 0; i < 20000; i++) readings.push_back(std::make_pair((i * 7919) % 67 - 30, (i * 104729) % 1000 / 10.0));
+
+        std::unordered_map<int, std::vector<std::pair<int, double>>> expected;
+        std::vector<int> first_seen;
+        for (auto& r : readings)
+        {
+            if (expected.find(r.first) == expected.end()) first_seen.push_back(r.first);
+            expected[r.first].push_back(r);
+        }
+
+        auto key = [](const std::pair<int, double>& r) { return r.first; };
+        auto groups = cinq::from(readings).group_by(key).to_vector();
+        auto hinted = cinq::from(readings).group_by(key, cinq::expected_groups { 100 }).to_vector();
+        if (groups.size() != first_seen.size() || hinted.size() != first_seen.size()) return false;
+        for (size_t i = 0; i < groups.size(); i++)
+        {
+            if (groups[i].key != first_seen[i] || groups[i].elements != expected[first_seen[i]]) return false;
+            if (hinted[i].key != first_seen[i] || hinted[i].elements != expected[first_seen[i]]) return false;
+        }
+        return true;
+    }));
+
+    tests.push_back(test("group_by() with reducers aggregates each group", []
+    {
+        std::vector<std::string> words { "apple", "bob", "cat", "avocado", "banana", "cherry", "axe" };
+        auto first_letter = [](const std::string& w) { return w[0]; };
+        auto length = [](const std::string& w) { return w.size(); };
+
+        auto result = cinq::from(words).group_by(first_letter, cinq::count(), cinq::max(length), cinq::avg(length)).to_vector();
+        std::vector<std::tuple<char, size_t, size_t, double>> answer
+        {
+            std::make_tuple('a', 3, 7, 5.0), std::make_tuple('b', 2, 6, 4.5), std::make_tuple('c', 2, 6, 4.5)
+        };
+
+        auto hinted = cinq::from(words).group_by(first_letter, cinq::expected_groups { 3 }, cinq::count()).to_vector();
+        std::vector<std::tuple<char, size_t>> hinted_answer { std::make_tuple('a', 3), std::make_tuple('b', 2), std::make_tuple('c', 2) };
+
+        return result == answer && hinted == hinted_answer;
+    }));
+
+    tests.push_back(test("flat_hash_map grows and finds every key", []
+    {
+        cinq::flat_hash_map<long long, int> table;
+        for (long long i = 0; i < 100000; i++) table[i * 1024] += (int)(i % 7);
+        for (long long i = 0; i < 100000; i++) table[i * 1024] += 1;
+        if (table.size() != 100000 || table.find(5) != nullptr) return false;
+        for (long long i = 0; i < 100000; i++)
+        {
+            int* value = table.find(i * 1024);
+            if (!value || *value != (int)(i % 7) + 1) return false;
+        }
+        return table.items()[3].first == 3 * 1024;
+    }));
+
+    tests.push_back(test("parallel group_by() matches the sequential one", []
+    {
+        std::vector<std::pair<int, int>> my_vector;
+        for (int i = 0; i < 200000; i++) my_vector.push_back(std::make_pair((int)((i * 2654435761u) % 50021), i % 100));
+
+        auto many = [](const std::pair<int, int>& p) { return p.first; };
+        auto few = [](const std::pair<int, int>& p) { return p.second % 7; };
+        auto value = [](const std::pair<int, int>& p) { return p.second; };
+
+        bool same_rows = true;
+        for (auto key : { std::function<int(const std::pair<int, int>&)>(many), std::function<int(const std::pair<int, int>&)>(few) })
+        {
+            auto sequential = cinq::from(my_vector).group_by(key, cinq::sum(value), cinq::min(value), cinq::count()).to_vector();
+            auto parallel = cinq::from(my_vector, cinq::par(4)).group_by(key, cinq::sum(value), cinq::min(value), cinq::count()).to_vector();
+            same_rows = same_rows && sequential == parallel;
+        }
+
+        auto sequential = cinq::from(my_vector).group_by(many).to_vector();
+        auto parallel = cinq::from(my_vector, cinq::par(3)).group_by(many).to_vector();
+        bool same_groups = sequential.size() == parallel.size();
+        for (size_t i = 0; same_groups && i < sequential.size(); i++)
+        {
+            same_groups = sequential[i].key == parallel[i].key && sequential[i].elements == parallel[i].elements;
+        }
+        return same_rows && same_groups;
+    }));
+
+    tests.push_back(test("join() matches nested loops whichever side is built", []
+    {
+        std::vector<std::pair<int, int>> big, small;
+        for (int i = 0; i < 5000; i++) big.push_back(std::make_pair((i * 7919) % 300, i));
+        for (int i = 0; i < 400; i++) small.push_back(std::make_pair((i * 31) % 350, -i));
+
+        auto key = [](const std::pair<int, int>& p) { return p.first; };
+        auto combine = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return std::make_pair(a.second, b.second); };
+        auto nested = [&](const std::vector<std::pair<int, int>>& outer, const std::vector<std::pair<int, int>>& inner)
+        {
+            std::vector<std::pair<int, int>> result;
+            for (auto& a : outer)
+            {
+                for (auto& b : inner)
+                {
+                    if (a.first == b.first) result.push_back(combine(a, b));
+                }
+            }
+            return result;
+        };
+
+        std::list<std::pair<int, int>> small_list(small.begin(), small.end());
+
+        return cinq::from(big).join(small, key, key, combine).to_vector() == nested(big, small)
+            && cinq::from(small).join(big, key, key, combine).to_vector() == nested(small, big)
+            && cinq::from(small).join(cinq::from(big).where([](const std::pair<int, int>& p) { return p.second % 2 == 0; }), key, key, combine).to_vector()
+                == nested(small, cinq::from(big).where([](const std::pair<int, int>& p) { return p.second % 2 == 0; }).to_vector())
+            && cinq::from(small_list).join(big, key, key, combine).to_vector() == nested(small, big)
+            && cinq::from(big).join(small_list, key, key, combine).to_vector() == nested(big, small);
+    }));
+
+    tests.push_back(test("merge_join() on sorted inputs matches join()", []
+    {
+        std::vector<std::pair<int, int>> left, right, none;
+        for (int i = 0; i < 3000; i++) left.push_back(std::make_pair((i * 7919) % 500, i));
+        for (int i = 0; i < 800; i++) right.push_back(std::make_pair((i * 31) % 600, -i));
+
+        auto key = [](const std::pair<int, int>& p) { return p.first; };
+        auto combine = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return std::make_pair(a.second, b.second); };
+
+        auto sorted_left = cinq::from(left).order_by(key).to_vector();
+        std::list<std::pair<int, int>> sorted_right;
+        for (auto& p : cinq::from(right).order_by(key).to_vector()) sorted_right.push_back(p);
+
+        return cinq::from(left).order_by(key).merge_join(cinq::from(right).order_by(key), key, key, combine).to_vector()
+                == cinq::from(sorted_left).join(sorted_right, key, key, combine).to_vector()
+            && cinq::from(sorted_left).merge_join(sorted_right, key, key, combine).to_vector()
+                == cinq::from(sorted_left).join(sorted_right, key, key, combine).to_vector()
+            && cinq::from(sorted_left).merge_join(none, key, key, combine).to_vector().empty();
+    }));
+
+    tests.push_back(test("merge_intersect(), merge_except() and merge_union() on sorted inputs", []
+    {
+        std::vector<int> a { 1, 1, 2, 4, 4, 4, 7, 9, 9 };
+        std::list<int> b { 0, 1, 4, 5, 5, 9, 10 };
+        std::vector<int> none;
+
+        return cinq::from(a).merge_intersect(b).to_vector() == std::vector<int> { 1, 4, 9 }
+            && cinq::from(a).merge_except(b).to_vector() == std::vector<int> { 2, 7 }
+            && cinq::from(a).merge_union(b).to_vector() == std::vector<int> { 0, 1, 2, 4, 5, 7, 9, 10 }
+            && cinq::from(b).merge_except(cinq::from(a).where([](int x) { return x > 3; })).to_vector() == std::vector<int> { 0, 1, 5, 10 }
+            && cinq::from(a).merge_union(none).to_vector() == std::vector<int> { 1, 2, 4, 7, 9 }
+            && cinq::from(none).merge_intersect(a).to_vector().empty();
+    }));
+
+    tests.push_back(test("distinct() keeps the first of each element in order", []
+    {
+        auto first_of_each = [](const auto& items, auto key_of)
+        {
+            using TElement = typename std::decay<decltype(*items.begin())>::type;
+            std::vector<TElement> result;
+            for (auto& x : items)
+            {
+                bool seen = false;
+                for (auto& y : result) seen = seen || key_of(x) == key_of(y);
+                if (!seen) result.push_back(x);
+            }
+            return result;
+        };
+        auto self = [](const auto& x) { return x; };
+
+        std::vector<int> small, wide;
+        for (int i = 0; i < 3000; i++)
+        {
+            small.push_back((i * 7919) % 300 - 150);
+            wide.push_back((i % 500) * 40000000 - 2000000000);
+        }
+        std::vector<std::string> words { "b", "a", "b", "c", "a", "" };
+        std::vector<int> none;
+        std::list<int> small_list(small.begin(), small.end());
+        auto tens = [](int x) { return x / 10; };
+
+        return cinq::from(small).distinct().to_vector() == first_of_each(small, self)
+            && cinq::from(wide).distinct().to_vector() == first_of_each(wide, self)
+            && cinq::from(words).distinct().to_vector() == first_of_each(words, self)
+            && cinq::from(small).distinct(tens).to_vector() == first_of_each(small, tens)
+            && cinq::from(small_list).distinct().to_vector() == first_of_each(small, self)
+            && cinq::from(none).distinct().to_vector().empty();
+    }));
+
+    tests.push_back(test("union_with(), intersect() and except() keep the first of each element in order", []
+    {
+        std::vector<int> a { 4, 1, 4, 9, 2, 1, 7, 9 };
+        std::list<int> b { 9, 0, 5, 1, 5, 10 };
+        std::vector<int> none;
+
+        return cinq::from(a).union_with(b).to_vector() == std::vector<int> { 4, 1, 9, 2, 7, 0, 5, 10 }
+            && cinq::from(a).intersect(b).to_vector() == std::vector<int> { 1, 9 }
+            && cinq::from(a).except(b).to_vector() == std::vector<int> { 4, 2, 7 }
+            && cinq::from(b).except(cinq::from(a).where([](int x) { return x > 3; })).to_vector() == std::vector<int> { 0, 5, 1, 10 }
+            && cinq::from(a).intersect(none).to_vector().empty()
+            && cinq::from(none).union_with(b).to_vector() == std::vector<int> { 9, 0, 5, 1, 10 };
+    }));
+
+    tests.push_back(test("from_csv() binds columns by header name", []
+    {
+        struct row { int id; double price; std::string name; bool active; int other; };
+
+        std::string path = "cinq_from_csv_test.csv";
+        std::ofstream file(path, std::ios::binary);
+        file << "name,id,unused,price,active\r\n"
+             << "widget,1,x,2.5,true\r\n"
+             << "\"gadget, large\",2,,-0.25,0\r\n"
+             << "\r\n"
+             << "\"say \"\"hi\"\"\",3,y,,\n"
+             << "cut,4";
+        file.close();
+
+        auto rows = cinq::from_csv<row>(path,
+            cinq::column("id", &row::id),
+            cinq::column("price", &row::price),
+            cinq::column("name", &row::name),
+            cinq::column("active", &row::active),
+            cinq::column("unused", [](std::string_view cell, row& r) { r.other = (int)cell.size(); })).to_vector();
+
+        bool read = rows.size() == 3
+            && rows[0].id == 1 && rows[0].price == 2.5 && rows[0].name == "widget" && rows[0].active && rows[0].other == 1
+            && rows[1].id == 2 && rows[1].price == -0.25 && rows[1].name == "gadget, large" && !rows[1].active && rows[1].other == 0
+            && rows[2].id == 3 && rows[2].price == 0 && rows[2].name == "say \"hi\"" && !rows[2].active;
+
+        auto fails = [&](auto query)
+        {
+            try
+            {
+                query();
+                return false;
+            }
+            catch (const std::exception& e)
+            {
+                return std::string(e.what()).find("cinq: ") == 0;
+            }
+        };
+
+        bool missing_column = fails([&] { cinq::from_csv<row>(path, cinq::column("missing", &row::id)); });
+        bool bad_number = fails([&] { cinq::from_csv<row>(path, cinq::column("name", &row::id)); });
+        std::remove(path.c_str());
+        bool missing_file = fails([&] { cinq::from_csv<row>(path, cinq::column("id", &row::id)); });
+
+        return read && missing_column && bad_number && missing_file;
+    }));
+
+    tests.push_back(test("load_weather() reads the same days as the stream based loader", []
+    {
+        auto slow = load_weather_with_streams("../data/weather_kjfk_1948-2014.csv");
+        auto same_days = [&](const std::vector<weather_point>& fast)
+        {
+            if (fast.size() != slow.size() || fast.empty()) return false;
+            for (size_t i = 0; i < fast.size(); i++)
+            {
+                const weather_point& a = fast[i];
+                const weather_point& b = slow[i];
+                bool same = a.date.tm_year == b.date.tm_year && a.date.tm_mon == b.date.tm_mon && a.date.tm_mday == b.date.tm_mday
+                    && a.date.tm_yday == b.date.tm_yday && a.date.tm_wday == b.date.tm_wday
+                    && a.temp_max == b.temp_max && a.temp_avg == b.temp_avg && a.temp_min == b.temp_min
+                    && a.dew_max == b.dew_max && a.dew_avg == b.dew_avg && a.dew_min == b.dew_min
+                    && a.humidity_max == b.humidity_max && a.humidity_avg == b.humidity_avg && a.humidity_min == b.humidity_min
+                    && a.pressure_max == b.pressure_max && a.pressure_avg == b.pressure_avg && a.pressure_min == b.pressure_min
+                    && a.visibility_max == b.visibility_max && a.visibility_avg == b.visibility_avg && a.visibility_min == b.visibility_min
+                    && a.windspeed_max == b.windspeed_max && a.windspeed_avg == b.windspeed_avg && a.gustspeed_max == b.gustspeed_max
+                    && a.precipitation == b.precipitation && a.cloud_cover == b.cloud_cover && a.wind_direction == b.wind_direction
+                    && a.fog == b.fog && a.rain == b.rain && a.thunderstorm == b.thunderstorm && a.snow == b.snow;
+                if (!same) return false;
+            }
+            return true;
+        };
+
+        // The file is about 2 MB, so par(4) parses it in 4 chunks.
+        return same_days(load_weather("../data/weather_kjfk_1948-2014.csv"))
+            && same_days(load_weather("../data/weather_kjfk_1948-2014.csv", cinq::par(4)))
+            && same_days(load_weather("../data/weather_kjfk_1948-2014.csv", cinq::par(7)));
+    }));
+
+    tests.push_back(test("from_csv() in parallel matches reading on one thread", []
+    {
+        struct row { int id; int twice; };
+
+        // Blank lines and the short last line fall in different chunks.
+        std::string path = "cinq_from_csv_parallel_test.csv";
+        std::ofstream file(path, std::ios::binary);
+        file << "id,twice\n";
+        for (int i = 0; i < 200000; i++)
+        {
+            file << i << "," << i * 2 << "\n";
+            if (i % 30011 == 0) file << "\n\r\n";
+        }
+        file << "200000";
+        file.close();
+
+        auto columns = [&](auto policy)
+        {
+            return cinq::from_csv<row>(path, policy, cinq::column("id", &row::id), cinq::column("twice", &row::twice)).to_vector();
+        };
+        auto one = columns(cinq::par(1));
+        auto four = columns(cinq::par(4));
+
+        bool same = one.size() == 200000 && four.size() == one.size();
+        for (size_t i = 0; same && i < one.size(); i++) same = one[i].id == (int)i && four[i].id == (int)i && four[i].twice == (int)i * 2;
+
+        // Errors report the line in the whole file, not in the chunk.
+        std::string error;
+        try
+        {
+            cinq::from_csv<row>(path, cinq::par(4), cinq::column("id", [](std::string_view cell, row& r)
+            {
+                cinq::csv::parse(cell, r.id);
+                if (r.id == 150000) throw std::invalid_argument("cinq: too large");
+            }));
+        }
+        catch (const std::invalid_argument& e)
+        {
+            error = e.what();
+        }
+        std::remove(path.c_str());
+
+        // Line 1 is the header, and 5 pairs of blank lines come before id 150000.
+        return same && error.find(" line 150012,") != std::string::npos;
+    }));
+
+    tests.push_back(test("schema().save() and open() round-trip records through a snapshot", []
+    {
+        enum class shade : short { light = -1, dark = 1 };
+        struct row { int id; double price; bool active; unsigned char grade; shade tone; long serial; };
+
+        std::vector<row> rows;
+        for (int i = 0; i < 5000; i++)
+        {
+            rows.push_back(row { i, i * 0.5, i % 3 == 0, (unsigned char)(i % 200), i % 2 ? shade::dark : shade::light, i });
+        }
+
+        auto schema = cinq::schema(cinq::column("id", &row::id), cinq::column("price", &row::price), cinq::column("active", &row::active),
+                                   cinq::column("grade", &row::grade), cinq::column("tone", &row::tone), cinq::column("serial", &row::serial));
+        std::string path = "cinq_snapshot_test.snapshot";
+        schema.save(path, rows);
+        auto snapshot = schema.open(path);
+
+        bool same = snapshot.size() == rows.size();
+        for (size_t i = 0; same && i < rows.size(); i++)
+        {
+            row r = snapshot[i];
+            same = r.id == rows[i].id && r.price == rows[i].price && r.active == rows[i].active && r.grade == rows[i].grade
+                && r.tone == rows[i].tone && r.serial == rows[i].serial;
+        }
+
+        // Queries run on the rebuilt records or straight on one column's mapped array.
+        auto ids = snapshot.column(&row::id);
+        bool aligned = (uintptr_t)&*ids.begin() % 4096 == 0;
+        bool queried = cinq::from(snapshot).where([](const row& r) { return r.active; }).count() == 1667
+            && cinq::from(ids).sum() == 4999 * 5000 / 2
+            && cinq::from(snapshot, cinq::par(3)).select([](const row& r) { return r.price; }).to_vector()
+                == cinq::from(rows).select([](const row& r) { return r.price; }).to_vector();
+
+        // A query result can be saved too, and the header is checked against the fields.
+        schema.save(path, cinq::from(rows).where([](const row& r) { return r.id < 10; }));
+        bool resaved = schema.open(path).size() == 10;
+
+        auto fails = [&](auto open)
+        {
+            try
+            {
+                open();
+                return false;
+            }
+            catch (const std::exception& e)
+            {
+                return std::string(e.what()).find("cinq: ") == 0;
+            }
+        };
+        bool wrong_type = fails([&] { cinq::schema(cinq::column("id", &row::price)).open(path); });
+        bool missing = fails([&] { cinq::schema(cinq::column("ignored", &row::serial)).open(path); });
+        std::ofstream(path) << "id,price\n1,2\n";
+        bool not_snapshot = fails([&] { schema.open(path); });
+
+        std::vector<row> none;
+        schema.save(path, none);
+        auto reopened = schema.open(path);
+        auto no_ids = reopened.column(&row::id);
+        bool empty = reopened.size() == 0 && cinq::from(no_ids).count() == 0;
+        std::remove(path.c_str());
+
+        return same && aligned && queried && resaved && wrong_type && missing && not_snapshot && empty;
+    }));
+
+    tests.push_back(test("load_weather_snapshot() keeps dates as day numbers and rebuilds them", []
+    {
+        std::string csv = "../data/weather_kjfk_1948-2014.csv";
+        std::string path = "cinq_weather_test.snapshot";
+        std::remove(path.c_str());
+        auto days = load_weather(csv);
+        auto reopened = load_weather_snapshot(csv, path);
+
+        tm first = date_of_day(day_number(1948, 7, 1));
+        bool same = !days.empty() && reopened.size() == days.size()
+            && first.tm_year == 48 && first.tm_mon == 6 && first.tm_mday == 1 && first.tm_wday == 4;
+        for (size_t i = 0; same && i < days.size(); i++)
+        {
+            tm a = days[i].date;
+            tm b = reopened[i].date;
+            same = a.tm_year == b.tm_year && a.tm_mon == b.tm_mon && a.tm_mday == b.tm_mday
+                && a.tm_yday == b.tm_yday && a.tm_wday == b.tm_wday && b.tm_zone == nullptr
+                && days[i].temp_max == reopened[i].temp_max;
+        }
+        std::remove(path.c_str());
+        return same;
+    }));
+
+    tests.push_back(test("to_columns() answers queries by member from one array per member", []
+    {
+        struct row { int id; double price; bool active; long ignored; };
+
+        std::vector<row> rows;
+        for (int i = 0; i < 5000; i++) rows.push_back(row { i, (i % 100) * 0.5, i % 3 == 0, i });
+
+        // Whole records are only rebuilt from columns of all their members.
+        auto columns = cinq::to_columns(rows, &row::id, &row::price, &row::active);
+        auto whole = cinq::to_columns(rows, &row::id, &row::price, &row::active, &row::ignored);
+        bool same = !columns.stores_every_member && whole.stores_every_member && whole.size() == rows.size();
+        for (size_t i = 0; same && i < rows.size(); i++)
+        {
+            row r = whole[i];
+            same = r.id == rows[i].id && r.price == rows[i].price && r.active == rows[i].active && r.ignored == rows[i].ignored;
+        }
+
+        auto cheap = [](double price) { return price < 10; };
+        auto expected = cinq::from(rows).where([&](const row& r) { return r.active && cheap(r.price); })
+                                        .select([](const row& r) { return r.id; }).to_vector();
+
+        // where() by member keeps the matching rows, which later members are read at.
+        bool filtered = true;
+        for (size_t threads : { 1, 3 })
+        {
+            auto query = cinq::from(columns, cinq::par(threads)).where(&row::active, [](bool active) { return active; })
+                                                                .where(&row::price, cheap);
+            auto whole_query = cinq::from(whole, cinq::par(threads)).where(&row::active, [](bool active) { return active; })
+                                                                    .where(&row::price, cheap);
+            filtered = filtered && query.count() == expected.size()
+                && query.select(&row::id).to_vector() == expected
+                && query.max(&row::id) == expected.back() && query.min(&row::id) == expected.front()
+                && whole_query.select([](const row& r) { return r.id; }).to_vector() == expected;
+        }
+
+        // parallel() returns a plain enumerable, which outlives the column_enumerable it was copied from.
+        auto sliced = cinq::from(whole).where(&row::active, [](bool active) { return active; }).parallel(2);
+        filtered = filtered && sliced.count([&](const row& r) { return cheap(r.price); }) == expected.size();
+
+        // Without a filter the member's whole array is reduced.
+        bool reduced = cinq::from(columns).max(&row::id) == 4999 && cinq::from(columns).min(&row::price) == 0
+            && cinq::from(columns).sum(&row::id) == 4999 * 5000 / 2 && cinq::from(columns).average(&row::id) == 2499.5
+            && cinq::from(columns).count() == 5000
+            && cinq::from(whole).where([](const row& r) { return r.id < 10; }).count() == 10;
+
+        bool missing = false;
+        try
+        {
+            columns.column(&row::ignored);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            missing = std::string(e.what()).find("cinq: ") == 0;
+        }
+
+        // Snapshots are queried the same way.
+        std::string path = "cinq_columns_test.snapshot";
+        auto schema = cinq::schema(cinq::column("id", &row::id), cinq::column("active", &row::active));
+        schema.save(path, rows);
+        auto snapshot = schema.open(path);
+        bool mapped = cinq::from(snapshot).where(&row::active, [](bool active) { return active; }).sum(&row::id)
+            == cinq::from(rows).where([](const row& r) { return r.active; }).sum([](const row& r) { return r.id; });
+        std::remove(path.c_str());
+
+        return same && filtered && reduced && missing && mapped;
+    }));
+
+    tests.push_back(test("compact_weather_point keeps every reading of the weather in less space", []
+    {
+        auto days = load_weather("../data/weather_kjfk_1948-2014.csv");
+        bool same = !days.empty() && sizeof(compact_weather_point) < sizeof(weather_point) / 3;
+        for (size_t i = 0; same && i < days.size(); i++)
+        {
+            const weather_point& a = days[i];
+            compact_weather_point b(a);
+            auto close = [](double x, float y) { return std::abs(x - y) <= std::abs(x) * 1e-6; };
+            same = b.year == a.date.tm_year + 1900 && b.month == a.date.tm_mon + 1 && b.day == a.date.tm_mday
+                && b.day_of_year == a.date.tm_yday && b.weekday == a.date.tm_wday
+                && b.temp_max == a.temp_max && b.temp_avg == a.temp_avg && b.temp_min == a.temp_min
+                && b.dew_max == a.dew_max && b.dew_avg == a.dew_avg && b.dew_min == a.dew_min
+                && b.humidity_max == a.humidity_max && b.humidity_avg == a.humidity_avg && b.humidity_min == a.humidity_min
+                && close(a.pressure_max, b.pressure_max) && close(a.pressure_avg, b.pressure_avg) && close(a.pressure_min, b.pressure_min)
+                && b.visibility_max == a.visibility_max && b.visibility_avg == a.visibility_avg && b.visibility_min == a.visibility_min
+                && b.windspeed_max == a.windspeed_max && b.windspeed_avg == a.windspeed_avg && b.gustspeed_max == a.gustspeed_max
+                && close(a.precipitation, b.precipitation) && b.cloud_cover == a.cloud_cover && b.wind_direction == a.wind_direction
+                && b.has(fog) == a.fog && b.has(rain) == a.rain && b.has(thunderstorm) == a.thunderstorm && b.has(snow) == a.snow;
+        }
+
+        weather_point scorching = days.front();
+        scorching.temp_max = 200;
+        bool too_hot = false;
+        try
+        {
+            compact_weather_point b(scorching);
+        }
+        catch (const std::out_of_range& e)
+        {
+            too_hot = std::string(e.what()).find("cinq: temp_max") == 0;
+        }
+
+        return same && too_hot;
+    }));
+
+    tests.push_back(test("late() filters to positions and reads the kept elements in place", []
+    {
+        std::vector<counted_weather_point> days;
+        for (int i = 0; i < 5000; i++)
+        {
+            weather_point w {};
+            w.temp_max = i % 120;
+            w.temp_min = i % 50;
+            w.snow = i % 7 == 0;
+            days.push_back(counted_weather_point(w));
+        }
+
+        auto snowed = [](const counted_weather_point& w) { return w.point.snow; };
+        auto cold = [](const counted_weather_point& w) { return w.point.temp_min < 10; };
+        auto temp_min = [](const counted_weather_point& w) { return w.point.temp_min; };
+        auto expected = cinq::from(days).where(snowed).where(cold).select(temp_min).to_vector();
+
+        bool same = true;
+        counted_weather_point::copies = 0;
+        for (size_t threads : { 1, 3 })
+        {
+            auto query = cinq::from(days, cinq::par(threads)).late().where(snowed).where(cold);
+            same = same && query.count() == expected.size() && query.select(temp_min).to_vector() == expected
+                && query.max(temp_min) == 9 && query.rows().front() == 0 && query.rows()[1] == 7;
+
+            // skip() and take() narrow the query they are called on, as on any enumerable.
+            same = same && query.skip(2).take(3).select(temp_min).to_vector() == std::vector<int>(expected.begin() + 2, expected.begin() + 5);
+        }
+        bool uncopied = counted_weather_point::copies == 0;
+
+        // parallel() returns a plain enumerable, which outlives the late_enumerable it was copied from.
+        auto sliced = cinq::from(days).late().where(snowed).parallel(2);
+        same = same && sliced.count(cold) == expected.size();
+
+        std::vector<weather_point> points;
+        for (auto& day : days) points.push_back(day.point);
+        auto snowy = cinq::from(points).late().where([](const weather_point& w) { return w.snow; });
+        bool by_member = snowy.select(&weather_point::temp_min).to_vector()
+                == cinq::from(points).where([](const weather_point& w) { return w.snow; })
+                                     .select([](const weather_point& w) { return w.temp_min; }).to_vector()
+            && snowy.max(&weather_point::temp_max) == 119 && snowy.sum(&weather_point::temp_min) == snowy.sum([](const weather_point& w) { return w.temp_min; });
+
+        bool copied = false;
+        try
+        {
+            cinq::from(points).reverse().late();
+        }
+        catch (const std::logic_error&)
+        {
+            copied = true;
+        }
+
+        return same && uncopied && by_member && copied;
+    }));
+
+    tests.push_back(test("late() over a vector of ints", []
+    {
+        std::vector<int> numbers;
+        for (int i = 0; i < 1000; i++) numbers.push_back((i * 37) % 101);
+        auto even = [](int x) { return x % 2 == 0; };
+        auto expected = cinq::from(numbers).where(even).to_vector();
+
+        auto query = cinq::from(numbers).late().where(even);
+        return query.count() == expected.size() && query.to_vector() == expected
+            && query.sum() == cinq::from(expected).sum() && query.max() == 100
+            && query.select([](int x) { return x / 2; }).max() == 50;
+    }));
+
+    tests.push_back(test("batched() runs where(), select() and reducers a batch at a time", []
+    {
+        // Long enough for several batches and a partial last one.
+        std::vector<int> numbers;
+        for (int i = 0; i < 5000; i++) numbers.push_back((i * 37) % 1001 - 500);
+        std::deque<int> queued(numbers.begin(), numbers.end());
+
+        auto positive = [](int x) { return x > 0; };
+        auto odd = [](int x) { return x % 2 != 0; };
+        auto half = [](int x) { return x / 2.0; };
+        auto eager = cinq::from(numbers).where(positive).where(odd);
+        auto expected = eager.to_vector();
+
+        auto batched = cinq::from(numbers).batched().where(positive).where(odd);
+        bool same = batched.to_vector() == expected && batched.count() == expected.size()
+            && batched.sum() == eager.sum() && batched.min() == eager.min() && batched.max() == eager.max()
+            && batched.average() == eager.average() && batched.first() == expected.front()
+            && batched.select(half).to_vector() == eager.select(half).to_vector()
+            && cinq::from(queued).batched().where(positive).where(odd).to_vector() == expected;
+
+        // Slices that start and end inside batches.
+        bool sliced = batched.skip(500).take(400).to_vector() == std::vector<int>(expected.begin() + 500, expected.begin() + 900)
+            && batched.take(0).count() == 0 && batched.skip(expected.size()).count() == 0
+            && batched.take(expected.size() + 10).count() == expected.size();
+
+        bool reduced = cinq::from(numbers).batched().count(positive) == cinq::from(numbers).count(positive)
+            && cinq::from(numbers).batched().any(positive) && !cinq::from(numbers).batched().all(positive)
+            && cinq::from(numbers).batched().all([](int x) { return x >= -500; })
+            && cinq::from(numbers).batched().max(half) == 250 && cinq::from(numbers).batched().sum() == cinq::from(numbers).sum();
+
+        // Mapping to bool, and a query with nothing selected.
+        auto flags = cinq::from(numbers).batched().select([](int x) { return x > 0; }).to_vector();
+        bool mapped = flags.size() == numbers.size() && flags[1] == (numbers[1] > 0);
+        bool empty = !cinq::from(numbers).batched().where([](int x) { return x > 1000; }).any();
+        try
+        {
+            cinq::from(numbers).batched().where([](int x) { return x > 1000; }).max();
+            empty = false;
+        }
+        catch (const std::length_error&)
+        {
+        }
+
+        return same && sliced && reduced && mapped && empty;
+    }));
+
+    tests.push_back(test("batched() where() only tests the rows earlier steps kept", []
+    {
+        std::vector<int> numbers;
+        for (int i = 0; i < 5000; i++) numbers.push_back((i * 37) % 1001 - 500);
+
+        // The second where() divides by what the first one lets through.
+        auto nonzero = [](int x) { return x != 0; };
+        auto guarded = [](int x) { return 100 / x > 20; };
+        bool divided = cinq::from(numbers).batched().where(nonzero).where(guarded).count()
+            == cinq::from(numbers).where(nonzero).where(guarded).count();
+
+        // After a select(), the rows removed before it hold no mapped value at all.
+        size_t calls = 0;
+        size_t kept = cinq::from(numbers).batched().where([](int x) { return x > 0; })
+                                         .select([](int x) { return x * 2; })
+                                         .where([&calls](int x) { calls++; return x % 3 == 0; }).count();
+        size_t positive = cinq::from(numbers).count([](int x) { return x > 0; });
+        bool mapped = calls == positive && kept == cinq::from(numbers).count([](int x) { return x > 0 && x % 3 == 0; });
+
+        return divided && mapped;
+    }));
+
+    tests.push_back(test("where() on a comparison packs the kept elements on every filter kernel", []
+    {
+        // Filters p with every kernel the CPU has and checks each against a plain loop.
+        auto kernels_agree = [](const auto& values, auto compare, auto bound)
+        {
+            using T = typename std::decay<decltype(values)>::type::value_type;
+            std::vector<T> expected;
+            std::vector<size_t> expected_rows;
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                if (compare(values[i], bound)) { expected.push_back(values[i]); expected_rows.push_back(i + 7); }
+            }
+
+            auto agrees = [&](auto filter, auto filter_rows)
+            {
+                std::vector<T> kept(values.size());
+                std::vector<size_t> rows(values.size());
+                kept.resize(filter(values.data(), values.size(), compare, bound, kept.data()));
+                rows.resize(filter_rows(values.data(), values.size(), compare, bound, 7, rows.data()));
+                auto same_value = [](T a, T b)
+                {
+                    if constexpr (std::is_floating_point<T>::value) return a == b || (std::isnan(a) && std::isnan(b));
+                    else return a == b;
+                };
+                return std::equal(kept.begin(), kept.end(), expected.begin(), expected.end(), same_value) && rows == expected_rows;
+            };
+
+            bool same = agrees([](auto ... a) { return cinq::simd::portable::filter(a...); },
+                               [](auto ... a) { return cinq::simd::portable::filter_rows(a...); });
+            if (cinq::simd::has_avx2())
+            {
+                same = same && agrees([](auto ... a) { return cinq::simd::avx2::filter(a...); },
+                                      [](auto ... a) { return cinq::simd::avx2::filter_rows(a...); });
+            }
+            if (cinq::simd::has_avx512())
+            {
+                same = same && agrees([](auto ... a) { return cinq::simd::avx512::filter(a...); },
+                                      [](auto ... a) { return cinq::simd::avx512::filter_rows(a...); });
+            }
+            return same;
+        };
+
+        // Lengths on both sides of every vector width, and every comparison.
+        for (size_t length = 0; length < 70; length++)
+        {
+            std::vector<int> ints(length);
+            std::vector<float> floats(length);
+            std::vector<double> doubles(length);
+            for (size_t i = 0; i < length; i++)
+            {
+                ints[i] = (int)((i * 7919) % 21) - 10;
+                floats[i] = ints[i] / 2.0f;
+                doubles[i] = i % 5 == 0 ? NAN : ints[i] / 4.0;
+            }
+
+            bool same = kernels_agree(ints, std::less<>(), 3) && kernels_agree(ints, std::less_equal<>(), 3)
+                && kernels_agree(ints, std::greater<>(), -2) && kernels_agree(ints, std::greater_equal<>(), -2)
+                && kernels_agree(ints, std::equal_to<>(), 0) && kernels_agree(ints, std::not_equal_to<>(), 0)
+                && kernels_agree(floats, std::less<>(), 1.5f) && kernels_agree(floats, std::greater_equal<>(), -1.0f)
+                && kernels_agree(doubles, std::greater<>(), 0.5) && kernels_agree(doubles, std::less_equal<>(), 0.5)
+                && kernels_agree(doubles, std::equal_to<>(), 0.25) && kernels_agree(doubles, std::not_equal_to<>(), 0.25);
+            if (!same) return false;
+        }
+
+        std::vector<double> readings(10000);
+        for (size_t i = 0; i < readings.size(); i++) readings[i] = (i * 2654435761u) % 1000 / 10.0;
+        auto above = [](double x) { return x > 50.0; };
+        auto expected = cinq::from(readings).where(above).to_vector();
+
+        // The comparison gives the lambda's result from the source, from copied data and on several threads.
+        bool queried = cinq::from(readings).where(cinq::element > 50.0).to_vector() == expected
+            && cinq::from(readings).where(50.0 < cinq::element).to_vector() == expected
+            && cinq::from(readings).where(cinq::element > 50).to_vector() == expected
+            && cinq::from(readings, cinq::par(3)).where(cinq::element > 50.0).to_vector() == expected
+            && cinq::from(readings).where([](double x) { return x < 90.0; }).where(cinq::element > 50.0).count()
+               == cinq::from(expected).count([](double x) { return x < 90.0; });
+
+        // A bound the elements cannot hold exactly is compared as the lambda would, off the kernels.
+        std::vector<int> ints { 1, 2, 3, 4 };
+        bool converted = cinq::from(ints).where(cinq::element < 2.5).count() == 2
+            && cinq::from(ints).where(cinq::element >= 3).to_vector() == std::vector<int> { 3, 4 };
+
+        // cinq::element is an expression like any other, so it combines and maps too.
+        bool combined = cinq::from(ints).where(cinq::element > 1 && cinq::element != 3).to_vector() == std::vector<int> { 2, 4 }
+            && cinq::from(ints).select(cinq::element * 2).to_vector() == std::vector<int> { 2, 4, 6, 8 };
+
+        // Over a column the kernels keep the numbers of the matching rows.
+        struct row { int id; double reading; };
+        std::vector<row> rows;
+        for (size_t i = 0; i < readings.size(); i++) rows.push_back(row { (int)i, readings[i] });
+        auto columns = cinq::to_columns(rows, &row::id, &row::reading);
+        bool by_column = cinq::from(columns).where(&row::reading, cinq::element > 50.0).select(&row::reading).to_vector() == expected
+            && cinq::from(columns, cinq::par(3)).where(&row::reading, cinq::element > 50.0).count() == expected.size()
+            && cinq::from(columns).where(&row::id, cinq::element < 100).where(&row::reading, cinq::element > 50.0).count()
+               == (size_t)cinq::from(readings).take(100).count(above);
+
+        return queried && converted && combined && by_column;
+    }));
+
+    tests.push_back(test("field() expressions filter and map like the lambdas they replace", []
+    {
+        struct day { int id; int temp_max; double rain; bool snow; };
+        std::vector<day> days;
+        for (int i = 0; i < 5000; i++) days.push_back(day { i, (i * 37) % 120 - 10, (i % 7) * 0.25, i % 11 == 0 });
+
+        auto temp_max = cinq::field(&day::temp_max);
+        auto rain = cinq::field(&day::rain);
+        auto snow = cinq::field(&day::snow);
+
+        auto hot_and_wet = temp_max > 90 && rain > 0.5;
+        auto cold_or_snowy = 0 >= temp_max || snow;
+        auto warmer_than_rain = temp_max * 2 - 10 > rain * 100 && !snow;
+        auto lambda_hot_and_wet = [](const day& d) { return d.temp_max > 90 && d.rain > 0.5; };
+        auto lambda_cold_or_snowy = [](const day& d) { return 0 >= d.temp_max || d.snow; };
+        auto lambda_warmer = [](const day& d) { return d.temp_max * 2 - 10 > d.rain * 100 && !d.snow; };
+
+        // Expressions are predicates and mappers wherever a lambda is.
+        bool callable = cinq::from(days).where(hot_and_wet).count() == cinq::from(days).where(lambda_hot_and_wet).count()
+            && cinq::from(days).count(cold_or_snowy) == cinq::from(days).count(lambda_cold_or_snowy)
+            && cinq::from(days).where(warmer_than_rain).select(temp_max).to_vector()
+               == cinq::from(days).where(lambda_warmer).select([](const day& d) { return d.temp_max; }).to_vector()
+            && cinq::from(days).max(temp_max - 1) == 108;
+
+        // The tree tells which members it reads and what it does with them.
+        std::vector<size_t> read;
+        warmer_than_rain.for_each_field([&](auto member) { read.push_back(sizeof(days[0].*member)); });
+        bool inspected = read == std::vector<size_t> { sizeof(int), sizeof(double), sizeof(bool) }
+            && std::is_same<decltype(hot_and_wet)::operation, std::logical_and<>>::value
+            && hot_and_wet.left.right.value == 90 && hot_and_wet.left.left.member == &day::temp_max
+            && std::is_same<decltype(0 >= temp_max)::operation, std::greater_equal<>>::value;
+
+        // Over columns, comparisons run the filter kernels and the rest reads only the named arrays.
+        auto columns = cinq::to_columns(days, &day::id, &day::temp_max, &day::rain, &day::snow);
+        auto ids = [](const std::vector<day>& source, auto predicate)
+        {
+            return cinq::from(source).where(predicate).select([](const day& d) { return d.id; }).to_vector();
+        };
+        bool by_columns = true;
+        for (size_t threads : { 1, 3 })
+        {
+            by_columns = by_columns
+                && cinq::from(columns, cinq::par(threads)).where(hot_and_wet).select(cinq::field(&day::id)).to_vector() == ids(days, lambda_hot_and_wet)
+                && cinq::from(columns, cinq::par(threads)).where(cold_or_snowy).select(&day::id).to_vector() == ids(days, lambda_cold_or_snowy)
+                && cinq::from(columns, cinq::par(threads)).where(warmer_than_rain).select(&day::id).to_vector() == ids(days, lambda_warmer)
+                && cinq::from(columns, cinq::par(threads)).where(snow).where(90 < temp_max).count()
+                   == cinq::from(days).count([](const day& d) { return d.snow && 90 < d.temp_max; });
+        }
+
+        return callable && inspected && by_columns;
+    }));
+
+    tests.push_back(test("planned() rewrites the plan and matches the eager query", []
+    {
+        std::vector<int> numbers;
+        for (int i = 0; i < 3000; i++) numbers.push_back((int)((i * 7919) % 1000) - 500);
+
+        auto odd = [](int x) { return x % 2 != 0; };
+        auto positive = [](int x) { return x > 0; };
+        size_t mapped = 0;
+        auto square = [&mapped](int x) { mapped++; return (long)x * x; };
+        auto key = [](int x) { return x / 10; };
+
+        // Each rewrite shows in the plan and gives the eager query's elements.
+        auto merged = cinq::from(numbers).planned().where(odd).where(positive);
+        auto sliced = cinq::from(numbers).planned().select(square).skip(5).take(10).skip(2);
+        auto pushed = cinq::from(numbers).planned().order_by(key).where(odd).take(20);
+        bool rewritten = merged.explain() == "source | where"
+            && sliced.explain() == "source | skip 7 | take 8 | select"
+            && pushed.explain() == "source | where | order_by (first 20) | take 20"
+            && cinq::from(numbers).planned().order_by(key).where(odd).explain() == "source | where | order_by"
+            && cinq::from(numbers).planned().select(square).where(positive).take(3).explain() == "source | select | where | take 3"
+            && cinq::from(numbers).planned().skip(2).skip(3).explain() == "source | skip 5";
+
+        bool same = merged.to_vector() == cinq::from(numbers).where(odd).where(positive).to_vector()
+            && pushed.to_vector() == cinq::from(numbers).order_by(key).where(odd).take(20).to_vector()
+            && cinq::from(numbers).planned().order_by(key, [](int x) { return -x; }).skip(100).take(50).to_vector()
+               == cinq::from(numbers).order_by(key, [](int x) { return -x; }).skip(100).take(50).to_vector()
+            && cinq::from(numbers).planned().order_by(key).first() == cinq::from(numbers).order_by(key).first()
+            && cinq::from(numbers).planned().order_by(key).element_at(7) == cinq::from(numbers).order_by(key).element_at(7)
+            && cinq::from(numbers).planned().order_by(key).where(odd).count() == cinq::from(numbers).count(odd)
+            && cinq::from(numbers).planned().order_by(key).max() == cinq::from(numbers).max()
+            && cinq::from(numbers).planned().where(positive).min(square) == cinq::from(numbers).where(positive).min(square)
+            && cinq::from(numbers).planned().sum() == cinq::from(numbers).sum()
+            && cinq::from(numbers).planned().average() == cinq::from(numbers).average()
+            && cinq::from(numbers).planned().all(positive) == false && cinq::from(numbers).planned().any(positive);
+
+        // The mapper only sees the elements which were kept.
+        mapped = 0;
+        bool lazy_mapper = sliced.to_vector() == cinq::from(numbers).select(square).skip(7).take(8).to_vector();
+        mapped = 0;
+        sliced.to_vector();
+        lazy_mapper = lazy_mapper && mapped == 8;
+
+        // Expressions are merged like lambdas.
+        struct day { int temp_max; bool rain; };
+        std::vector<day> days { { 95, true }, { 95, false }, { 70, true } };
+        auto hot_and_wet = cinq::from(days).planned().where(cinq::field(&day::temp_max) > 90).where(cinq::field(&day::rain));
+        bool inspected = hot_and_wet.count() == 1 && hot_and_wet.explain() == "source | where";
+
+        bool empty = false;
+        try
+        {
+            cinq::from(numbers).planned().where([](int x) { return x > 1000; }).order_by(key).first();
+        }
+        catch (const std::out_of_range& e)
+        {
+            empty = std::string(e.what()).find("cinq: ") == 0;
+        }
+
+        return rewritten && same && lazy_mapper && inspected && empty;
+    }));
+
     return tests;
 }
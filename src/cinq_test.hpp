@@ -1,6 +1,8 @@
 #ifndef __cinq_test_hpp__
 #define __cinq_test_hpp__
 
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <vector>
 #include <list>
@@ -8,6 +10,7 @@
 #include <deque>
 #include <functional>
 #include <initializer_list>
+#include <unordered_map>
 
 #include "cinq_enumerable.hpp"
 #include "all_concepts.hpp"
@@ -1,8 +1,139 @@
 #include "test_performance.hpp"
+#include "cinq_columns.hpp"
+#include "cinq_snapshot.hpp"
+
+#include <atomic>
+#include <new>
+
+// Dates are kept in columns and snapshots as day numbers: a struct tm may point to the
+// name of its time zone, which means nothing once written to a file.
+namespace cinq
+{
+    template <>
+    struct column_storage<tm>
+    {
+        using type = int32_t;
+
+        static int32_t store(const tm& date) { return day_number(date.tm_year + 1900, date.tm_mon + 1, date.tm_mday); }
+        static tm load(int32_t days) { return date_of_day(days); }
+    };
+}
+
+// Every member of weather_point, as stored in snapshots of the weather.
+static auto weather_schema()
+{
+    return cinq::schema(
+        cinq::column("date", &weather_point::date),
+        cinq::column("temp_max", &weather_point::temp_max),
+        cinq::column("temp_avg", &weather_point::temp_avg),
+        cinq::column("temp_min", &weather_point::temp_min),
+        cinq::column("dew_max", &weather_point::dew_max),
+        cinq::column("dew_avg", &weather_point::dew_avg),
+        cinq::column("dew_min", &weather_point::dew_min),
+        cinq::column("humidity_max", &weather_point::humidity_max),
+        cinq::column("humidity_avg", &weather_point::humidity_avg),
+        cinq::column("humidity_min", &weather_point::humidity_min),
+        cinq::column("pressure_max", &weather_point::pressure_max),
+        cinq::column("pressure_avg", &weather_point::pressure_avg),
+        cinq::column("pressure_min", &weather_point::pressure_min),
+        cinq::column("visibility_max", &weather_point::visibility_max),
+        cinq::column("visibility_avg", &weather_point::visibility_avg),
+        cinq::column("visibility_min", &weather_point::visibility_min),
+        cinq::column("windspeed_max", &weather_point::windspeed_max),
+        cinq::column("windspeed_avg", &weather_point::windspeed_avg),
+        cinq::column("gustspeed_max", &weather_point::gustspeed_max),
+        cinq::column("precipitation", &weather_point::precipitation),
+        cinq::column("cloud_cover", &weather_point::cloud_cover),
+        cinq::column("rain", &weather_point::rain),
+        cinq::column("thunderstorm", &weather_point::thunderstorm),
+        cinq::column("snow", &weather_point::snow),
+        cinq::column("fog", &weather_point::fog),
+        cinq::column("wind_direction", &weather_point::wind_direction));
+}
+
+size_t counted_weather_point::copies = 0;
+
+static atomic<size_t> allocations(0);
+
+// Replacements for the global allocation functions that count allocations. They are kept
+// out of line so gcc does not pair the inlined malloc() and free() with new and delete.
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+size_t allocation_count()
+{
+    return allocations.load(memory_order_relaxed);
+}
+
+// Runs a query once and describes the heap allocations and element copies it made.
+string count_copies(function<void()> query)
+{
+    size_t allocations_before = allocation_count();
+    counted_weather_point::copies = 0;
+    query();
+    size_t allocated = allocation_count() - allocations_before;
+    size_t copies = counted_weather_point::copies;
+    return to_string(allocated) + " allocations, " + to_string(copies) + " elements ("
+         + to_string(copies * sizeof(counted_weather_point)) + " bytes) copied per query";
+}
+
+// A file written by a benchmark, removed once the last benchmark using it is gone.
+struct temporary_file
+{
+    explicit temporary_file(string path) : path(path)
+    {
+    }
+
+    ~temporary_file()
+    {
+        remove(path.c_str());
+    }
+
+    size_t size() const
+    {
+        ifstream file(path, ios::binary | ios::ate);
+        return file.tellg();
+    }
+
+    string path;
+};
+
+// Hands a query result to an empty asm statement, which the compiler must assume reads
+// it, so that the query is not optimized away.
+template <typename T>
+void consume(const T& value)
+{
+    asm volatile("" : : "g"(value) : "memory");
+}
+
+// The members the two weather layouts store differently, for queries written once for both.
+static int year_of(const weather_point& w) { return w.date.tm_year + 1900; }
+static int year_of(const compact_weather_point& w) { return w.year; }
+static int day_of_year_of(const weather_point& w) { return w.date.tm_yday; }
+static int day_of_year_of(const compact_weather_point& w) { return w.day_of_year; }
+static bool snowed(const weather_point& w) { return w.snow; }
+static bool snowed(const compact_weather_point& w) { return w.has(snow); }
 
 vector<test_perf> make_tests_perf()
 {
-    vector<weather_point> weather_data = load_weather("../data/weather_kjfk_1948-2014.csv");
+    vector<weather_point> weather_data = load_weather_snapshot("../data/weather_kjfk_1948-2014.csv", "weather_kjfk_1948-2014.snapshot");
+
+    // The members the columnar queries below read, each in its own array.
+    auto weather_columns = cinq::to_columns(weather_data, &weather_point::temp_max, &weather_point::temp_min, &weather_point::snow);
 
     vector<test_perf> tests;
 
@@ -21,6 +152,32 @@ vector<test_perf> make_tests_perf()
         }
     }));
 
+    tests.push_back(test_perf("where() by temperature - late", 2000, [=]
+    {
+        consume(cinq::from(weather_data).late().where([](const auto& x) { return x.temp_max > 90; }).count());
+    }));
+
+    tests.push_back(test_perf("where() by temperature - batched", 2000, [=]
+    {
+        consume(cinq::from(weather_data).batched().where([](const auto& x) { return x.temp_max > 90; }).to_vector().size());
+    }));
+
+    tests.push_back(test_perf("where() by temperature - columns", 2000, [=]
+    {
+        consume(cinq::from(weather_columns).where(&weather_point::temp_max, [](int t) { return t > 90; }).count());
+    }));
+
+    tests.push_back(test_perf("where() by temperature - expression", 2000, [=]
+    {
+        consume(cinq::from(weather_data).where(cinq::field(&weather_point::temp_max) > 90).count());
+    }));
+
+    // The expression lets the column query pick the filter kernel for temp_max's array.
+    tests.push_back(test_perf("where() by temperature - columns, expression", 2000, [=]
+    {
+        consume(cinq::from(weather_columns).where(cinq::field(&weather_point::temp_max) > 90).count());
+    }));
+
     tests.push_back(test_perf("select() mapping weather_point to cloud_cover", 2000, [=]
     {
        cinq::from(weather_data).select([](const auto& x){return x.cloud_cover;});
@@ -35,6 +192,11 @@ vector<test_perf> make_tests_perf()
 
     }));
 
+    tests.push_back(test_perf("select() mapping weather_point to cloud_cover - batched", 2000, [=]
+    {
+        consume(cinq::from(weather_data).batched().select([](const auto& x){return x.cloud_cover;}).to_vector().size());
+    }));
+
     tests.push_back(test_perf("where().average() finding the averge cloud_cover between 1980 and 2000", 500, [=]
     {
 
@@ -59,6 +221,50 @@ vector<test_perf> make_tests_perf()
 
     }));
 
+    tests.push_back(test_perf("where().average() finding the averge cloud_cover between 1980 and 2000 - batched", 500, [=]
+    {
+        consume(cinq::from(weather_data).batched()
+                                        .where([](const auto& wp){return (1980-1900 <wp.date.tm_year && wp.date.tm_year< 2000-1900);})
+                                        .average([](const auto& wp){return wp.cloud_cover;}));
+    }));
+
+    // A yearly report: four statistics of temp_max over the same filtered days.
+    auto in_1980s_1990s = [](const weather_point& wp) { return 1980-1900 < wp.date.tm_year && wp.date.tm_year < 2000-1900; };
+    auto temp_max = [](const weather_point& wp) { return wp.temp_max; };
+
+    tests.push_back(test_perf("where().aggregate() min, max, average and count of temp_max between 1980 and 2000", 500, [=]
+    {
+        auto report = cinq::from(weather_data).where(in_1980s_1990s)
+                                               .aggregate(cinq::min(temp_max), cinq::max(temp_max), cinq::avg(temp_max), cinq::count());
+        consume(get<2>(report));
+    }));
+
+    tests.push_back(test_perf("where().aggregate() min, max, average and count of temp_max between 1980 and 2000 - lazy", 500, [=]
+    {
+        auto report = cinq::from(weather_data).lazy().where(in_1980s_1990s)
+                                               .aggregate(cinq::min(temp_max), cinq::max(temp_max), cinq::avg(temp_max), cinq::count());
+        consume(get<2>(report));
+    }));
+
+    tests.push_back(test_perf("where().aggregate() min, max, average and count of temp_max between 1980 and 2000 - separate calls", 500, [=]
+    {
+        auto days = cinq::from(weather_data).where(in_1980s_1990s);
+        consume(days.min(temp_max));
+        consume(days.max(temp_max));
+        consume(days.average(temp_max));
+        consume(days.count());
+    }));
+
+    // A batched query runs again for each call, so the four statistics read the days four times.
+    tests.push_back(test_perf("where().aggregate() min, max, average and count of temp_max between 1980 and 2000 - batched", 500, [=]
+    {
+        auto days = cinq::from(weather_data).batched().where(in_1980s_1990s);
+        consume(days.min(temp_max));
+        consume(days.max(temp_max));
+        consume(days.average(temp_max));
+        consume(days.count());
+    }));
+
     tests.push_back(test_perf("max(). finding the max temp_max in the data set ", 130000000, [=]
     {
         cinq::from(weather_data).max([](const auto& x){return x.temp_max;});
@@ -85,6 +291,27 @@ vector<test_perf> make_tests_perf()
 
     }));
 
+    tests.push_back(test_perf("max(). finding the max temp_max in the data set - parallel, 4 threads", 20000, [=]
+    {
+        cinq::from(weather_data, cinq::par(4)).max([](const auto& x){return x.temp_max;});
+    }));
+
+    // The runs above leave their result unused, which lets the compiler drop the loop.
+    tests.push_back(test_perf("max(). finding the max temp_max in the data set - result consumed", 20000, [=]
+    {
+        consume(cinq::from(weather_data).max([](const auto& x){return x.temp_max;}));
+    }));
+
+    tests.push_back(test_perf("max(). finding the max temp_max in the data set - batched", 20000, [=]
+    {
+        consume(cinq::from(weather_data).batched().max([](const auto& x){return x.temp_max;}));
+    }));
+
+    tests.push_back(test_perf("max(). finding the max temp_max in the data set - columns", 20000, [=]
+    {
+        consume(cinq::from(weather_columns).max(&weather_point::temp_max));
+    }));
+
     tests.push_back(test_perf("where().select(). get a vector of temp_mins for the days that it snowed", 2000, [=]
     {
         cinq::from(weather_data).where([](const auto& x){return x.snow;}).select([](const auto& x){return x.temp_min;}).to_vector();
@@ -106,6 +333,21 @@ vector<test_perf> make_tests_perf()
 
     }));
 
+    tests.push_back(test_perf("where().select(). get a vector of temp_mins for the days that it snowed - lazy", 2000, [=]
+    {
+        cinq::from(weather_data).lazy().where([](const auto& x){return x.snow;}).select([](const auto& x){return x.temp_min;}).to_vector();
+    }));
+
+    tests.push_back(test_perf("where().select(). get a vector of temp_mins for the days that it snowed - late", 2000, [=]
+    {
+        consume(cinq::from(weather_data).late().where([](const auto& x){return x.snow;}).select(&weather_point::temp_min).to_vector().size());
+    }));
+
+    tests.push_back(test_perf("where().select(). get a vector of temp_mins for the days that it snowed - batched", 2000, [=]
+    {
+        consume(cinq::from(weather_data).batched().where([](const auto& x){return x.snow;}).select([](const auto& x){return x.temp_min;}).to_vector().size());
+    }));
+
     tests.push_back(test_perf("where().select().order_by().take() - 5 coldest rainy days", 100, [=]
     {
         cinq::from(weather_data)
@@ -132,7 +374,710 @@ vector<test_perf> make_tests_perf()
         vector<int> temps;
         for (auto& data : five) temps.push_back(data.temp_min);
     }));
+
+    // Batches filter and project the days, and the temperatures left are sorted.
+    tests.push_back(test_perf("where().select().order_by().take() - 5 coldest rainy days - batched", 100, [=]
+    {
+        auto temps = cinq::from(weather_data).batched()
+                          .where([](const weather_point& w) { return w.rain; })
+                          .select([](const weather_point& w) { return w.temp_min; })
+                          .to_vector();
+        consume(cinq::from(temps).order_by().take(5).to_vector().size());
+    }));
     
+    tests.push_back(test_perf("where().select().order_by().take() - 5 coldest rainy days - planned", 100, [=]
+    {
+        consume(cinq::from(weather_data).planned()
+                     .where([](const weather_point& w) { return w.rain; })
+                     .order_by([](const weather_point& w) { return w.temp_min; })
+                     .take(5)
+                     .select([](const weather_point& w) { return w.temp_min; })
+                     .to_vector().size());
+    }));
+
+    // Filtering after sorting: the eager query sorts every day before where() reads them,
+    // the planned one moves where() below the sort and sorts only the five days it returns.
+    tests.push_back(test_perf("order_by().where().take() - 5 coldest rainy days, filtered after sorting", 100, [=]
+    {
+        consume(cinq::from(weather_data)
+                     .order_by([](const weather_point& w) { return w.temp_min; })
+                     .where([](const weather_point& w) { return w.rain; })
+                     .take(5)
+                     .to_vector().size());
+    }));
+
+    tests.push_back(test_perf("order_by().where().take() - 5 coldest rainy days, filtered after sorting - planned", 100, [=]
+    {
+        consume(cinq::from(weather_data).planned()
+                     .order_by([](const weather_point& w) { return w.temp_min; })
+                     .where([](const weather_point& w) { return w.rain; })
+                     .take(5)
+                     .to_vector().size());
+    }));
+
+    // The eager select() maps every day before skip() and take() drop most of them.
+    tests.push_back(test_perf("select().skip().take() - 10 days described", 2000, [=]
+    {
+        consume(cinq::from(weather_data)
+                     .select([](const weather_point& w) { return to_string(w.date.tm_year + 1900) + "-" + to_string(w.date.tm_mon + 1) + "-" + to_string(w.date.tm_mday); })
+                     .skip(100)
+                     .take(10)
+                     .to_vector().size());
+    }));
+
+    tests.push_back(test_perf("select().skip().take() - 10 days described - planned", 2000, [=]
+    {
+        consume(cinq::from(weather_data).planned()
+                     .select([](const weather_point& w) { return to_string(w.date.tm_year + 1900) + "-" + to_string(w.date.tm_mon + 1) + "-" + to_string(w.date.tm_mday); })
+                     .skip(100)
+                     .take(10)
+                     .to_vector().size());
+    }));
+
+    tests.push_back(test_perf("where().where().count() - hot and dry days", 2000, [=]
+    {
+        consume(cinq::from(weather_data)
+                     .where([](const weather_point& w) { return w.temp_max > 80; })
+                     .where([](const weather_point& w) { return !w.rain; })
+                     .count());
+    }));
+
+    tests.push_back(test_perf("where().where().count() - hot and dry days - planned", 2000, [=]
+    {
+        consume(cinq::from(weather_data).planned()
+                     .where([](const weather_point& w) { return w.temp_max > 80; })
+                     .where([](const weather_point& w) { return !w.rain; })
+                     .count());
+    }));
+
+    tests.push_back(test_perf("order_by().first() - hottest day", 100, [=]
+    {
+        consume(cinq::from(weather_data)
+                     .order_by([](const weather_point& w) { return -w.temp_max; })
+                     .first().temp_max);
+    }));
+
+    tests.push_back(test_perf("order_by().first() - hottest day - manual", 100, [=]
+    {
+        vector<weather_point> result(weather_data);
+        stable_sort(result.begin(), result.end(), [](const auto &a, const auto &b) { return a.temp_max > b.temp_max; });
+        consume(result[0].temp_max);
+    }));
+
+    tests.push_back(test_perf("order_by().first() - hottest day - planned", 100, [=]
+    {
+        consume(cinq::from(weather_data).planned()
+                     .order_by([](const weather_point& w) { return -w.temp_max; })
+                     .first().temp_max);
+    }));
+
+    // Sorting on 1, 2 and 3 keys, against stable_sort with a comparator that calls each
+    // mapper twice per comparison, which is what order_by() used to do.
+    auto by_temp = [](const weather_point& w) { return w.temp_max; };
+    auto by_cloud = [](const weather_point& w) { return w.cloud_cover; };
+    auto by_wind = [](const weather_point& w) { return w.wind_direction; };
+
+    tests.push_back(test_perf("order_by() on 1 key", 100, [=]
+    {
+        cinq::from(weather_data).order_by(by_temp).to_vector();
+    }));
+
+    tests.push_back(test_perf("order_by() on 1 key - comparator", 100, [=]
+    {
+        vector<weather_point> result(weather_data);
+        stable_sort(result.begin(), result.end(), [=](const auto& a, const auto& b) { return by_temp(a) < by_temp(b); });
+    }));
+
+    tests.push_back(test_perf("order_by() on 2 keys", 100, [=]
+    {
+        cinq::from(weather_data).order_by(by_temp, by_cloud).to_vector();
+    }));
+
+    tests.push_back(test_perf("order_by() on 2 keys - comparator", 100, [=]
+    {
+        vector<weather_point> result(weather_data);
+        stable_sort(result.begin(), result.end(), [=](const auto& a, const auto& b)
+        {
+            if (by_temp(a) != by_temp(b)) return by_temp(a) < by_temp(b);
+            return by_cloud(a) < by_cloud(b);
+        });
+    }));
+
+    tests.push_back(test_perf("order_by() on 3 keys", 100, [=]
+    {
+        cinq::from(weather_data).order_by(by_temp, by_cloud, by_wind).to_vector();
+    }));
+
+    tests.push_back(test_perf("order_by() on 3 keys - comparator", 100, [=]
+    {
+        vector<weather_point> result(weather_data);
+        stable_sort(result.begin(), result.end(), [=](const auto& a, const auto& b)
+        {
+            if (by_temp(a) != by_temp(b)) return by_temp(a) < by_temp(b);
+            if (by_cloud(a) != by_cloud(b)) return by_cloud(a) < by_cloud(b);
+            return by_wind(a) < by_wind(b);
+        });
+    }));
+
+    // The daily (temp_min, date) sort, on the weather data repeated to a million rows.
+    auto many_days = make_shared<vector<weather_point>>();
+    while (many_days->size() < 1000000) many_days->insert(many_days->end(), weather_data.begin(), weather_data.end());
+    auto by_temp_min = [](const weather_point& w) { return w.temp_min; };
+    auto by_date = [](const weather_point& w) { return w.date.tm_year * 366 + w.date.tm_yday; };
+
+    tests.push_back(test_perf("order_by() on (temp_min, date) for 1M rows", 3, [=]
+    {
+        cinq::from(*many_days).order_by(by_temp_min, by_date).to_vector();
+    }));
+
+    tests.push_back(test_perf("order_by() on (temp_min, date) for 1M rows - parallel", 3, [=]
+    {
+        cinq::from(*many_days, cinq::par).order_by(by_temp_min, by_date).to_vector();
+    }));
+
+    tests.push_back(test_perf("order_by() on (temp_min, date) for 1M rows - comparator", 3, [=]
+    {
+        vector<weather_point> result(*many_days);
+        stable_sort(result.begin(), result.end(), [=](const auto& a, const auto& b)
+        {
+            if (by_temp_min(a) != by_temp_min(b)) return by_temp_min(a) < by_temp_min(b);
+            return by_date(a) < by_date(b);
+        });
+    }));
+
+    // Average cloud_cover per year, over the 1M rows.
+    auto year = [](const weather_point& w) { return w.date.tm_year; };
+    auto cloud_cover = [](const weather_point& w) { return w.cloud_cover; };
+
+    tests.push_back(test_perf("group_by() year with avg(cloud_cover) for 1M rows", 10, [=]
+    {
+        consume(cinq::from(*many_days).group_by(year, cinq::avg(cloud_cover)).to_vector().size());
+    }));
+
+    tests.push_back(test_perf("group_by() year with avg(cloud_cover) for 1M rows - parallel", 10, [=]
+    {
+        consume(cinq::from(*many_days, cinq::par).group_by(year, cinq::avg(cloud_cover)).to_vector().size());
+    }));
+
+    // Grouping by day gives tens of thousands of groups, so merging the threads' tables counts.
+    auto day = [](const weather_point& w) { return w.date.tm_year * 366 + w.date.tm_yday; };
+
+    tests.push_back(test_perf("group_by() day with max(temp_max) for 1M rows", 10, [=]
+    {
+        consume(cinq::from(*many_days).group_by(day, cinq::max(&weather_point::temp_max)).to_vector().size());
+    }));
+
+    tests.push_back(test_perf("group_by() day with max(temp_max) for 1M rows - parallel", 10, [=]
+    {
+        consume(cinq::from(*many_days, cinq::par).group_by(day, cinq::max(&weather_point::temp_max)).to_vector().size());
+    }));
+
+    tests.push_back(test_perf("group_by() year with avg(cloud_cover) for 1M rows - groups then average()", 10, [=]
+    {
+        auto groups = cinq::from(*many_days).group_by(year).to_vector();
+        for (auto& group : groups) consume(cinq::from(group.elements).average(cloud_cover));
+    }));
+
+    tests.push_back(test_perf("group_by() year with avg(cloud_cover) for 1M rows - unordered_map of vectors", 10, [=]
+    {
+        unordered_map<int, vector<weather_point>> groups;
+        for (const auto& w : *many_days) groups[year(w)].push_back(w);
+        for (auto& group : groups)
+        {
+            double sum = 0;
+            for (auto& w : group.second) sum += w.cloud_cover;
+            consume(sum / group.second.size());
+        }
+    }));
+
+    // The queries above on both record layouts, with every result consumed: compact_weather_point
+    // is 44 bytes to weather_point's 168, so the same scans read far less memory.
+    vector<compact_weather_point> compact_data(weather_data.begin(), weather_data.end());
+    auto many_compact_days = make_shared<vector<compact_weather_point>>(many_days->begin(), many_days->end());
+
+    auto on_both_layouts = [&](string name, int runs, auto query)
+    {
+        tests.push_back(test_perf(name + " - weather_point", runs, [=] { consume(query(weather_data)); }));
+        tests.push_back(test_perf(name + " - compact_weather_point", runs, [=] { consume(query(compact_data)); }));
+    };
+
+    auto on_both_layouts_1m = [&](string name, int runs, auto query)
+    {
+        tests.push_back(test_perf(name + " for 1M rows - weather_point", runs, [=] { consume(query(*many_days)); }));
+        tests.push_back(test_perf(name + " for 1M rows - compact_weather_point", runs, [=] { consume(query(*many_compact_days)); }, [=]
+        {
+            auto megabytes = [](size_t bytes) { return to_string(bytes / 1000000) + " MB"; };
+            return megabytes(many_compact_days->size() * sizeof(compact_weather_point)) + " of records, "
+                + megabytes(many_days->size() * sizeof(weather_point)) + " as weather_point";
+        }));
+    };
+
+    on_both_layouts("where() by temperature", 2000, [](const auto& days)
+    {
+        return cinq::from(days).where([](const auto& w) { return w.temp_max > 90; }).count();
+    });
+
+    on_both_layouts("select() mapping to cloud_cover", 2000, [](const auto& days)
+    {
+        return cinq::from(days).select([](const auto& w) { return w.cloud_cover; }).to_vector().size();
+    });
+
+    on_both_layouts("where().average() of cloud_cover between 1980 and 2000", 500, [](const auto& days)
+    {
+        return cinq::from(days).where([](const auto& w) { return 1980 < year_of(w) && year_of(w) < 2000; })
+                               .average([](const auto& w) { return (int)w.cloud_cover; });
+    });
+
+    on_both_layouts("max() of temp_max", 20000, [](const auto& days)
+    {
+        return cinq::from(days).max([](const auto& w) { return (int)w.temp_max; });
+    });
+
+    on_both_layouts("where().select() temp_min of the days that it snowed", 2000, [](const auto& days)
+    {
+        return cinq::from(days).where([](const auto& w) { return snowed(w); }).select([](const auto& w) { return (int)w.temp_min; })
+                               .to_vector().size();
+    });
+
+    on_both_layouts("order_by().first() - hottest day", 100, [](const auto& days)
+    {
+        return (int)cinq::from(days).order_by([](const auto& w) { return -w.temp_max; }).first().temp_max;
+    });
+
+    on_both_layouts_1m("group_by() year with avg(cloud_cover)", 10, [](const auto& days)
+    {
+        return cinq::from(days).group_by([](const auto& w) { return year_of(w); },
+                                         cinq::avg([](const auto& w) { return (int)w.cloud_cover; })).to_vector().size();
+    });
+
+    on_both_layouts_1m("order_by() on (temp_min, date)", 3, [](const auto& days)
+    {
+        return cinq::from(days).order_by([](const auto& w) { return (int)w.temp_min; },
+                                         [](const auto& w) { return year_of(w) * 366 + day_of_year_of(w); }).to_vector().size();
+    });
+
+    // Joining every day to a calendar table with one row per day, keyed like the weather.
+    struct calendar_day { int day; int weekday; };
+    auto calendar = make_shared<vector<calendar_day>>();
+    for (const auto& w : weather_data) calendar->push_back(calendar_day { day(w), w.date.tm_wday });
+    auto calendar_key = [](const calendar_day& c) { return c.day; };
+    auto with_weekday = [](const weather_point& w, const calendar_day& c) { return make_pair(w.temp_max, c.weekday); };
+
+    tests.push_back(test_perf("join() weather to a per-day calendar", 100, [=]
+    {
+        consume(cinq::from(weather_data).join(*calendar, day, calendar_key, with_weekday).to_vector().size());
+    }));
+
+    // The weather file is in date order, so both sides are already sorted by day.
+    tests.push_back(test_perf("join() weather to a per-day calendar - merge_join()", 100, [=]
+    {
+        consume(cinq::from(weather_data).merge_join(*calendar, day, calendar_key, with_weekday).to_vector().size());
+    }));
+
+    tests.push_back(test_perf("join() weather to a per-day calendar - unordered_map", 100, [=]
+    {
+        unordered_map<int, vector<const calendar_day*>> days;
+        for (const auto& c : *calendar) days[c.day].push_back(&c);
+        vector<pair<int, int>> result;
+        for (const auto& w : weather_data)
+        {
+            auto found = days.find(day(w));
+            if (found == days.end()) continue;
+            for (auto c : found->second) result.push_back(with_weekday(w, *c));
+        }
+        consume(result.size());
+    }));
+
+    tests.push_back(test_perf("join() weather to a per-day calendar - nested loops", 1, [=]
+    {
+        vector<pair<int, int>> result;
+        for (const auto& w : weather_data)
+        {
+            for (const auto& c : *calendar)
+            {
+                if (day(w) == c.day) result.push_back(with_weekday(w, c));
+            }
+        }
+        consume(result.size());
+    }));
+
+    // Set operations on two sorted sequences of a million numbers each.
+    auto evens = make_shared<vector<int>>();
+    auto thirds = make_shared<vector<int>>();
+    for (int i = 0; i < 1000000; i++)
+    {
+        evens->push_back(i * 2);
+        thirds->push_back(i * 3);
+    }
+
+    tests.push_back(test_perf("merge_intersect() of 1M sorted ints", 20, [=]
+    {
+        consume(cinq::from(*evens).merge_intersect(*thirds).count());
+    }));
+
+    tests.push_back(test_perf("merge_intersect() of 1M sorted ints - unordered_set", 20, [=]
+    {
+        unordered_set<int> seen(thirds->begin(), thirds->end());
+        vector<int> result;
+        for (int x : *evens)
+        {
+            if (seen.erase(x)) result.push_back(x);
+        }
+        consume(result.size());
+    }));
+
+    // Wind directions are a few hundred degrees, so distinct() marks them in a bitmap.
+    auto directions = make_shared<vector<int>>();
+    for (const auto& w : *many_days) directions->push_back(w.wind_direction);
+
+    tests.push_back(test_perf("distinct() wind directions of 1M rows", 20, [=]
+    {
+        consume(cinq::from(*directions).distinct().count());
+    }));
+
+    tests.push_back(test_perf("distinct() days of 1M rows", 20, [=]
+    {
+        consume(cinq::from(*many_days).distinct(day).count());
+    }));
+
+    tests.push_back(test_perf("distinct() wind directions of 1M rows - unordered_set", 20, [=]
+    {
+        unordered_set<int> seen;
+        vector<int> result;
+        for (int x : *directions)
+        {
+            if (seen.insert(x).second) result.push_back(x);
+        }
+        consume(result.size());
+    }));
+
+    tests.push_back(test_perf("distinct() wind directions of 1M rows - sort and unique", 20, [=]
+    {
+        vector<int> result(*directions);
+        sort(result.begin(), result.end());
+        consume(unique(result.begin(), result.end()) - result.begin());
+    }));
+
+    vector<counted_weather_point> counted_data(weather_data.begin(), weather_data.end());
+
+    auto chain = [=]
+    {
+        return cinq::from(counted_data)
+                    .where([](const counted_weather_point& w) { return w.point.temp_max > 50; })
+                    .skip(100)
+                    .take(10000)
+                    .reverse()
+                    .to_vector();
+    };
+
+    tests.push_back(test_perf("where().skip().take().reverse().to_vector() on a temporary", 500, [=]
+    {
+        chain();
+    }, [=]
+    {
+        return count_copies(chain);
+    }));
+
+    auto chain_lvalue = [=]
+    {
+        auto query = cinq::from(counted_data);
+        query.where([](const counted_weather_point& w) { return w.point.temp_max > 50; });
+        query.skip(100);
+        query.take(10000);
+        query.reverse();
+        return query.to_vector();
+    };
+
+    tests.push_back(test_perf("where().skip().take().reverse().to_vector() on an lvalue", 500, [=]
+    {
+        chain_lvalue();
+    }, [=]
+    {
+        return count_copies(chain_lvalue);
+    }));
+
+    auto chain_batched = [=]
+    {
+        auto result = cinq::from(counted_data).batched()
+                           .where([](const counted_weather_point& w) { return w.point.temp_max > 50; })
+                           .skip(100)
+                           .take(10000)
+                           .to_vector();
+        std::reverse(result.begin(), result.end());
+        return result;
+    };
+
+    tests.push_back(test_perf("where().skip().take().reverse().to_vector() - batched", 500, [=]
+    {
+        chain_batched();
+    }, [=]
+    {
+        return count_copies(chain_batched);
+    }));
+
+    vector<double> readings(8000000);
+    for (size_t i = 0; i < readings.size(); i++) readings[i] = (i * 2654435761u) % 100000 / 1000.0;
+
+    auto scaled_query = [=](size_t threads)
+    {
+        cinq::from(readings, cinq::par(threads))
+             .where([](double x) { return sqrt(x) > 5.0; })
+             .sum([](double x) { return log1p(x); });
+        return cinq::from(readings, cinq::par(threads)).count([](double x) { return x > 50.0; });
+    };
+
+    tests.push_back(test_perf("where().sum() and count() on 8M doubles - parallel, all threads", 10, [=]
+    {
+        scaled_query(0);
+    }, [=]
+    {
+        // Time the same query at increasing thread counts and report each speedup over one thread.
+        using namespace std::chrono;
+        vector<size_t> thread_counts { 1, 2, 4, 8, cinq::resolve_thread_count(0) };
+        string report;
+        double single = 0;
+        for (size_t threads : thread_counts)
+        {
+            auto begin = high_resolution_clock::now();
+            for (int i = 0; i < 5; i++) scaled_query(threads);
+            double ms = duration_cast<microseconds>(high_resolution_clock::now() - begin).count() / 5000.0;
+            if (threads == 1) single = ms;
+
+            char line[64];
+            snprintf(line, sizeof(line), "%s%zu threads: %.1f ms (%.2fx)", report.empty() ? "" : ", ", threads, ms, single / ms);
+            report += line;
+        }
+        return report;
+    }));
+
+    tests.push_back(test_perf("where().sum() and count() on 8M doubles - batched", 10, [=]
+    {
+        consume(cinq::from(readings).batched()
+                     .where([](double x) { return sqrt(x) > 5.0; })
+                     .sum([](double x) { return log1p(x); }));
+        consume(cinq::from(readings).batched().count([](double x) { return x > 50.0; }));
+    }));
+
+    // Vectorized reductions against the scalar loops they replace, from a sequence that
+    // fits in L1 up to one that only fits in memory.
+    for (size_t size : { 1000, 1000000, 100000000 })
+    {
+        int runs = (int)(200000000 / size) + 2;
+        string elements = size == 1000 ? "1K" : size == 1000000 ? "1M" : "100M";
+
+        auto doubles = make_shared<cinq::aligned_vector<double>>(size);
+        auto ints = make_shared<vector<int>>(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            (*doubles)[i] = (i * 2654435761u) % 100000 / 1000.0;
+            (*ints)[i] = (int)((i * 2654435761u) % 2000001) - 1000000;
+        }
+
+        tests.push_back(test_perf("sum() of " + elements + " doubles", runs, [=]
+        {
+            consume(cinq::from(*doubles).sum());
+        }));
+
+        tests.push_back(test_perf("sum() of " + elements + " doubles - scalar", runs, [=]
+        {
+            double sum = 0;
+            for (double x : *doubles) sum += x;
+            consume(sum);
+        }));
+
+        tests.push_back(test_perf("sum() of " + elements + " doubles - batched", runs, [=]
+        {
+            consume(cinq::from(*doubles).batched().sum());
+        }));
+
+        tests.push_back(test_perf("max() of " + elements + " ints", runs, [=]
+        {
+            consume(cinq::from(*ints).max());
+        }));
+
+        tests.push_back(test_perf("max() of " + elements + " ints - scalar", runs, [=]
+        {
+            int max = numeric_limits<int>::min();
+            for (int x : *ints)
+            {
+                if (x > max) max = x;
+            }
+            consume(max);
+        }));
+
+        tests.push_back(test_perf("max() of " + elements + " ints - batched", runs, [=]
+        {
+            consume(cinq::from(*ints).batched().max());
+        }));
+    }
+
+    // where() with a lambda, which branches on every element, against a comparison the
+    // filter kernels pack without branching, from keeping almost nothing to almost everything.
+    {
+        auto doubles = make_shared<vector<double>>(1000000);
+        auto ints = make_shared<vector<int>>(1000000);
+        for (size_t i = 0; i < doubles->size(); i++)
+        {
+            (*doubles)[i] = (i * 2654435761u) % 100000 / 1000.0;
+            (*ints)[i] = (int)((i * 2654435761u) % 2000001) - 1000000;
+        }
+
+        for (int percent : { 1, 50, 99 })
+        {
+            string kept = to_string(percent) + "%";
+            double double_bound = percent;
+            int int_bound = percent * 20000 - 1000000;
+
+            tests.push_back(test_perf("where() keeping " + kept + " of 1M doubles - branching", 200, [=]
+            {
+                consume(cinq::from(*doubles).where([=](double x) { return x < double_bound; }).to_vector().size());
+            }));
+
+            tests.push_back(test_perf("where() keeping " + kept + " of 1M doubles - compress", 200, [=]
+            {
+                consume(cinq::from(*doubles).where(cinq::element < double_bound).to_vector().size());
+            }));
+
+            tests.push_back(test_perf("where() keeping " + kept + " of 1M ints - branching", 200, [=]
+            {
+                consume(cinq::from(*ints).where([=](int x) { return x < int_bound; }).to_vector().size());
+            }));
+
+            tests.push_back(test_perf("where() keeping " + kept + " of 1M ints - compress", 200, [=]
+            {
+                consume(cinq::from(*ints).where(cinq::element < int_bound).to_vector().size());
+            }));
+        }
+    }
+
+    // Sorting on one thread against sorting runs on every thread and merging them, with
+    // std::stable_sort and std::sort as baselines. Sizes past 10M need several gigabytes for
+    // the keys and merge buffers.
+    for (size_t size : { 1000000, 10000000 })
+    {
+        int runs = size == 1000000 ? 10 : 2;
+        string elements = size == 1000000 ? "1M" : "10M";
+
+        auto numbers = make_shared<vector<pair<int, int>>>(size);
+        for (size_t i = 0; i < size; i++) (*numbers)[i] = make_pair((int)((i * 2654435761u) % 2000001) - 1000000, (int)i);
+        auto number = [](const pair<int, int>& p) { return p.first; };
+
+        tests.push_back(test_perf("order_by() on " + elements + " rows", runs, [=]
+        {
+            consume(cinq::from(*numbers).order_by(number).to_vector().size());
+        }));
+
+        tests.push_back(test_perf("order_by() on " + elements + " rows - parallel", runs, [=]
+        {
+            consume(cinq::from(*numbers, cinq::par).order_by(number).to_vector().size());
+        }));
+
+        tests.push_back(test_perf("order_by_unstable() on " + elements + " rows - parallel", runs, [=]
+        {
+            consume(cinq::from(*numbers, cinq::par).order_by_unstable(number).to_vector().size());
+        }));
+
+        tests.push_back(test_perf("order_by() on " + elements + " rows - stable_sort", runs, [=]
+        {
+            vector<pair<int, int>> result(*numbers);
+            stable_sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            consume(result.size());
+        }));
+
+        tests.push_back(test_perf("order_by_unstable() on " + elements + " rows - sort", runs, [=]
+        {
+            vector<pair<int, int>> result(*numbers);
+            sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            consume(result.size());
+        }));
+    }
+
+    // Loading the whole weather file, which the other benchmarks start from.
+    tests.push_back(test_perf("load_weather() from the KJFK file - from_csv()", 20, [=]
+    {
+        consume(load_weather("../data/weather_kjfk_1948-2014.csv").size());
+    }));
+
+    tests.push_back(test_perf("load_weather() from the KJFK file - getline and stringstream", 20, [=]
+    {
+        consume(load_weather_with_streams("../data/weather_kjfk_1948-2014.csv").size());
+    }));
+
+    // A station file 16 times the size of the KJFK one, parsed on more and more threads.
+    // Rows and bytes per second are measured on one more load after the timed runs.
+    auto large = make_shared<temporary_file>("cinq_weather_large.csv");
+    {
+        ifstream source("../data/weather_kjfk_1948-2014.csv", ios::binary);
+        string header, body;
+        getline(source, header);
+        body.assign(istreambuf_iterator<char>(source), istreambuf_iterator<char>());
+        // Leaves out the cut-off last row, which may only end the file.
+        body = body.substr(0, body.rfind('\n', body.size() - 2) + 1);
+
+        ofstream target(large->path, ios::binary);
+        target << header << '\n';
+        for (int copy = 0; copy < 16; copy++) target << body;
+    }
+
+    auto throughput = [=](function<size_t()> load)
+    {
+        auto begin = chrono::steady_clock::now();
+        size_t rows = load();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        double megabytes = large->size() / 1e6;
+        return to_string((size_t)(rows / seconds)) + " rows/s, " + to_string((size_t)(megabytes / seconds)) + " MB/s";
+    };
+
+    for (size_t threads : { 1, 2, 4, 0 })
+    {
+        string name = threads == 0 ? "all threads" : to_string(threads) + (threads == 1 ? " thread" : " threads");
+        auto load = [=] { return load_weather(large->path, cinq::par(threads)).size(); };
+
+        tests.push_back(test_perf("load_weather() from a 16x KJFK file - from_csv() on " + name, 5, [=]
+        {
+            consume(load());
+        }, [=]
+        {
+            return throughput(load);
+        }));
+    }
+
+    tests.push_back(test_perf("load_weather() from a 16x KJFK file - getline and stringstream", 1, [=]
+    {
+        consume(load_weather_with_streams(large->path).size());
+    }, [=]
+    {
+        return throughput([=] { return load_weather_with_streams(large->path).size(); });
+    }));
+
+    // Reopening the days saved by load_weather_snapshot() instead of parsing the file.
+    auto schema = weather_schema();
+    auto reopen = [=] { return schema.open("weather_kjfk_1948-2014.snapshot"); };
+
+    tests.push_back(test_perf("open() the KJFK snapshot", 2000, [=]
+    {
+        consume(reopen().size());
+    }));
+
+    tests.push_back(test_perf("open() the KJFK snapshot and max() of temp_max", 2000, [=]
+    {
+        auto days = reopen();
+        auto temp_max = days.column(&weather_point::temp_max);
+        consume(cinq::from(temp_max).max());
+    }));
+
+    tests.push_back(test_perf("open() the KJFK snapshot and where() by temperature on whole records", 200, [=]
+    {
+        auto days = reopen();
+        consume(cinq::from(days).where([](const weather_point& w) { return w.temp_max > 90; }).count());
+    }));
+
+    tests.push_back(test_perf("load_weather() and max() of temp_max", 20, [=]
+    {
+        auto days = load_weather("../data/weather_kjfk_1948-2014.csv");
+        consume(cinq::from(days).max([](const weather_point& w) { return w.temp_max; }));
+    }));
+
     return tests;
 }
 
@@ -154,7 +1099,176 @@ string fix(string s)
     else return s;
 }
 
-vector<weather_point> load_weather(string path)
+static const int days_before_month[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+// Days since 1970-01-01, counting years from March so leap days come last.
+int32_t day_number(int year, int month, int day)
+{
+    int y = month <= 2 ? year - 1 : year;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int year_of_era = y - era * 400;
+    int day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// The inverse of day_number(), with the day of the year and of the week filled in as
+// strptime() would, since queries group by them. 1970-01-01 was a Thursday.
+tm date_of_day(int32_t days)
+{
+    int shifted = days + 719468;
+    int era = (shifted >= 0 ? shifted : shifted - 146096) / 146097;
+    int day_of_era = shifted - era * 146097;
+    int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int month_from_march = (5 * day_of_year + 2) / 153;
+    int day = day_of_year - (153 * month_from_march + 2) / 5 + 1;
+    int month = month_from_march < 10 ? month_from_march + 3 : month_from_march - 9;
+    int year = year_of_era + era * 400 + (month <= 2 ? 1 : 0);
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+
+    tm date = tm();
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day;
+    date.tm_yday = days_before_month[month - 1] + day - 1 + (leap && month > 2 ? 1 : 0);
+    date.tm_wday = ((days + 4) % 7 + 7) % 7;
+    return date;
+}
+
+// Dates are written like 1948-7-1.
+static void parse_date(string_view cell, weather_point& p)
+{
+    int year = 0, month = 0, day = 0;
+    const char* last = cell.data() + cell.size();
+    auto parsed = from_chars(cell.data(), last, year);
+    if (parsed.ptr != last && *parsed.ptr == '-') parsed = from_chars(parsed.ptr + 1, last, month);
+    if (parsed.ptr != last && *parsed.ptr == '-') parsed = from_chars(parsed.ptr + 1, last, day);
+    if (parsed.ec != errc() || parsed.ptr != last || month < 1 || month > 12 || day < 1 || day > 31)
+    {
+        throw invalid_argument("cinq: " + string(cell) + " is not a date");
+    }
+
+    p.date = date_of_day(day_number(year, month, day));
+}
+
+template <typename T>
+static T narrow(int value, const char* name)
+{
+    if (value < numeric_limits<T>::min() || value > numeric_limits<T>::max())
+    {
+        throw out_of_range("cinq: " + string(name) + " of " + to_string(value) + " does not fit a compact_weather_point");
+    }
+    return (T)value;
+}
+
+compact_weather_point::compact_weather_point(const weather_point& point)
+    : pressure_max(point.pressure_max), pressure_avg(point.pressure_avg), pressure_min(point.pressure_min),
+      precipitation(point.precipitation),
+      year(narrow<int16_t>(point.date.tm_year + 1900, "year")),
+      day_of_year(narrow<uint16_t>(point.date.tm_yday, "day of year")),
+      wind_direction(narrow<int16_t>(point.wind_direction, "wind_direction")),
+      month(narrow<uint8_t>(point.date.tm_mon + 1, "month")),
+      day(narrow<uint8_t>(point.date.tm_mday, "day")),
+      weekday(narrow<uint8_t>(point.date.tm_wday, "weekday")),
+      events((point.fog << fog) | (point.rain << rain) | (point.thunderstorm << thunderstorm) | (point.snow << snow)),
+      temp_max(narrow<int8_t>(point.temp_max, "temp_max")),
+      temp_avg(narrow<int8_t>(point.temp_avg, "temp_avg")),
+      temp_min(narrow<int8_t>(point.temp_min, "temp_min")),
+      dew_max(narrow<int8_t>(point.dew_max, "dew_max")),
+      dew_avg(narrow<int8_t>(point.dew_avg, "dew_avg")),
+      dew_min(narrow<int8_t>(point.dew_min, "dew_min")),
+      humidity_max(narrow<uint8_t>(point.humidity_max, "humidity_max")),
+      humidity_avg(narrow<uint8_t>(point.humidity_avg, "humidity_avg")),
+      humidity_min(narrow<uint8_t>(point.humidity_min, "humidity_min")),
+      visibility_max(narrow<uint8_t>(point.visibility_max, "visibility_max")),
+      visibility_avg(narrow<uint8_t>(point.visibility_avg, "visibility_avg")),
+      visibility_min(narrow<uint8_t>(point.visibility_min, "visibility_min")),
+      windspeed_max(narrow<uint8_t>(point.windspeed_max, "windspeed_max")),
+      windspeed_avg(narrow<uint8_t>(point.windspeed_avg, "windspeed_avg")),
+      gustspeed_max(narrow<uint8_t>(point.gustspeed_max, "gustspeed_max")),
+      cloud_cover(narrow<uint8_t>(point.cloud_cover, "cloud_cover"))
+{
+}
+
+// Precipitation is T for a trace too small to measure, read as 0.
+static void parse_precipitation(string_view cell, weather_point& p)
+{
+    if (cell == "T") p.precipitation = 0;
+    else cinq::csv::parse(cell, p.precipitation);
+}
+
+static void parse_events(string_view cell, weather_point& p)
+{
+    while (!cell.empty())
+    {
+        size_t dash = cell.find('-');
+        string_view event = cell.substr(0, dash);
+        if (event == "Fog") p.fog = true;
+        if (event == "Rain") p.rain = true;
+        if (event == "Thunderstorm") p.thunderstorm = true;
+        if (event == "Snow") p.snow = true;
+        cell.remove_prefix(dash == string_view::npos ? cell.size() : dash + 1);
+    }
+}
+
+vector<weather_point> load_weather(string path, cinq::parallel_policy policy)
+{
+    return cinq::from_csv<weather_point>(path, policy,
+        cinq::column("EST", parse_date),
+        cinq::column("Max TemperatureF", &weather_point::temp_max),
+        cinq::column("Mean TemperatureF", &weather_point::temp_avg),
+        cinq::column("Min TemperatureF", &weather_point::temp_min),
+        // These next 3 look wrong, but that's actually how Wunderground names their column headers.
+        cinq::column("Max Dew PointF", &weather_point::dew_max),
+        cinq::column("MeanDew PointF", &weather_point::dew_avg),
+        cinq::column("Min DewpointF", &weather_point::dew_min),
+        cinq::column("Max Humidity", &weather_point::humidity_max),
+        cinq::column("Mean Humidity", &weather_point::humidity_avg),
+        cinq::column("Min Humidity", &weather_point::humidity_min),
+        cinq::column("Max Sea Level PressureIn", &weather_point::pressure_max),
+        cinq::column("Mean Sea Level PressureIn", &weather_point::pressure_avg),
+        cinq::column("Min Sea Level PressureIn", &weather_point::pressure_min),
+        cinq::column("Max VisibilityMiles", &weather_point::visibility_max),
+        cinq::column("Mean VisibilityMiles", &weather_point::visibility_avg),
+        cinq::column("Min VisibilityMiles", &weather_point::visibility_min),
+        cinq::column("Max Wind SpeedMPH", &weather_point::windspeed_max),
+        cinq::column("Mean Wind SpeedMPH", &weather_point::windspeed_avg),
+        cinq::column("Max Gust SpeedMPH", &weather_point::gustspeed_max),
+        cinq::column("PrecipitationIn", parse_precipitation),
+        cinq::column("CloudCover", &weather_point::cloud_cover),
+        cinq::column("Events", parse_events),
+        cinq::column("WindDirDegrees", &weather_point::wind_direction)).to_vector();
+}
+
+// Parsing the CSV file is the slowest part of starting the benchmarks, so the days are
+// saved to a snapshot the first time and reopened from it until the CSV file changes. A
+// snapshot written with other columns is written again.
+vector<weather_point> load_weather_snapshot(string path, string snapshot_path)
+{
+    namespace fs = std::filesystem;
+    auto schema = weather_schema();
+    if (!fs::exists(snapshot_path) || fs::last_write_time(snapshot_path) < fs::last_write_time(path))
+    {
+        schema.save(snapshot_path, load_weather(path));
+    }
+
+    try
+    {
+        auto days = schema.open(snapshot_path);
+        return vector<weather_point>(days.begin(), days.end());
+    }
+    catch (const invalid_argument&)
+    {
+        schema.save(snapshot_path, load_weather(path));
+        auto days = schema.open(snapshot_path);
+        return vector<weather_point>(days.begin(), days.end());
+    }
+}
+
+// The original loader, kept as the baseline for load_weather(): getline, a stringstream
+// split into strings and a map of header names per line.
+vector<weather_point> load_weather_with_streams(string path)
 {
     ifstream source(path, ios::in);
     vector<weather_point> parsed;
@@ -1,11 +1,15 @@
 #ifndef __test_performance_hpp__
 #define __test_performance_hpp__
 
+#include <charconv>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "cinq_enumerable.hpp"
 #include "test_shared.hpp"
@@ -33,6 +37,78 @@ public:
     int wind_direction;
 };
 
-vector<weather_point> load_weather(string path);
+// The same day as a weather_point in 44 bytes instead of 168: the date as numbers rather
+// than a struct tm, the events as bits of a byte and every reading in the narrowest type
+// that holds the values seen at KJFK. Members are ordered by size so none need padding.
+class compact_weather_point
+{
+public:
+    compact_weather_point() = default;
+
+    // Throws out_of_range if a reading does not fit its narrower type.
+    explicit compact_weather_point(const weather_point& point);
+
+    bool has(weather_event event) const
+    {
+        return events & (1 << event);
+    }
+
+    float pressure_max, pressure_avg, pressure_min;
+    float precipitation;
+    int16_t year;
+    uint16_t day_of_year;
+    int16_t wind_direction;
+    uint8_t month, day, weekday;
+    uint8_t events;
+    int8_t temp_max, temp_avg, temp_min;
+    int8_t dew_max, dew_avg, dew_min;
+    uint8_t humidity_max, humidity_avg, humidity_min;
+    uint8_t visibility_max, visibility_avg, visibility_min;
+    uint8_t windspeed_max, windspeed_avg;
+    uint8_t gustspeed_max;
+    uint8_t cloud_cover;
+};
+
+vector<weather_point> load_weather(string path, cinq::parallel_policy policy = cinq::par(1));
+vector<weather_point> load_weather_with_streams(string path);
+
+// Days since 1970-01-01 of a date, and back.
+int32_t day_number(int year, int month, int day);
+tm date_of_day(int32_t days);
+
+vector<weather_point> load_weather_snapshot(string path, string snapshot_path);
+
+// A weather_point that counts how many times it is copied, so benchmarks can tell
+// how much data a query moves around besides measuring its time.
+class counted_weather_point
+{
+public:
+    counted_weather_point(const weather_point& point) : point(point)
+    {
+    }
+
+    counted_weather_point(const counted_weather_point& other) : point(other.point)
+    {
+        copies++;
+    }
+
+    counted_weather_point(counted_weather_point&& other) = default;
+
+    counted_weather_point& operator=(const counted_weather_point& other)
+    {
+        point = other.point;
+        copies++;
+        return *this;
+    }
+
+    counted_weather_point& operator=(counted_weather_point&& other) = default;
+
+    weather_point point;
+
+    static size_t copies;
+};
+
+// Number of calls to the global operator new since the program started.
+size_t allocation_count();
 
 #endif
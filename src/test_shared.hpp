@@ -26,6 +26,12 @@ public:
     {
     }
     
+    test_perf(string name, int run_count, function<void()> func, function<string()> report)
+        : test_perf(name, run_count, func)
+    {
+        this->report = report;
+    }
+    
     test_perf(string name, int run_count, function<void()> func)
     {
         this->name = name;
@@ -44,6 +50,9 @@ public:
     string name;
     function<int()> func;
     int runs;
+    
+    // Optional extra measurements, printed under the timing line.
+    function<string()> report;
 };
 
 #endif